@@ -0,0 +1,19 @@
+#version 100
+
+precision mediump float;
+
+varying vec2 fragTexCoord;
+varying vec4 fragColor;
+
+uniform sampler2D texture0;
+uniform vec4 colDiffuse;
+uniform float maxCount;
+
+void main()
+{
+    // red holds the fragment count of RVX_SHADER_OVERDRAW, black where nothing was drawn
+    float count = floor(texture2D(texture0, fragTexCoord).r * 255.0 + 0.5);
+    float t = clamp(count / maxCount, 0.0, 1.0);
+    vec3 heat = clamp(vec3(1.5 - abs(4.0 * t - 3.0), 1.5 - abs(4.0 * t - 2.0), 1.5 - abs(4.0 * t - 1.0)), 0.0, 1.0);
+    gl_FragColor = vec4(count > 0.0 ? heat : vec3(0.0), 1.0) * colDiffuse;
+}
@@ -0,0 +1,15 @@
+#version 330
+in vec2 fragTexCoord;
+in vec4 fragColor;
+out vec4 finalColor;
+uniform sampler2D texture0;
+uniform vec4 colDiffuse;
+uniform float maxCount;
+void main()
+{
+    // red holds the fragment count of RVX_SHADER_OVERDRAW, black where nothing was drawn
+    float count = floor(texture(texture0, fragTexCoord).r * 255.0 + 0.5);
+    float t = clamp(count / maxCount, 0.0, 1.0);
+    vec3 heat = clamp(vec3(1.5 - abs(4.0 * t - 3.0), 1.5 - abs(4.0 * t - 2.0), 1.5 - abs(4.0 * t - 1.0)), 0.0, 1.0);
+    finalColor = vec4(count > 0.0 ? heat : vec3(0.0), 1.0) * colDiffuse;
+}
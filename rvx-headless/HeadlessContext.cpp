@@ -0,0 +1,262 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#include "HeadlessContext.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <zlib.h>
+
+namespace rvx
+{
+
+static bool HasExtension(const char* extensions, const char* name)
+{
+    // whole words only, one name may prefix another
+    size_t length = strlen(name);
+    for(const char* at = extensions; at != nullptr && (at = strstr(at, name)) != nullptr; at += length)
+    {
+        if((at == extensions || at[-1] == ' ') && (at[length] == ' ' || at[length] == 0))
+            return true;
+    }
+    return false;
+}
+
+HeadlessContext::~HeadlessContext()
+{
+    Destroy();
+}
+
+bool HeadlessContext::Fail(const char* error)
+{
+    char message[128];
+    snprintf(message, sizeof(message), "%s (EGL error 0x%x)", error, eglGetError());
+    m_error = message;
+    Destroy();
+    return false;
+}
+
+bool HeadlessContext::Create(int width, int height)
+{
+    Destroy();
+    m_width  = width;
+    m_height = height;
+
+    // Mesa's surfaceless platform needs neither X11 nor a GPU, llvmpipe renders on the CPU
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    bool        surfaceless      = HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless");
+    auto        getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(surfaceless && getPlatformDisplay != nullptr)
+        m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    else
+        m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major;
+    EGLint minor;
+    if(m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor))
+        return Fail("no EGL display");
+
+    const char* extensions       = eglQueryString(m_display, EGL_EXTENSIONS);
+    bool        noSurface        = HasExtension(extensions, "EGL_KHR_surfaceless_context");
+    EGLint      configAttributes[] = {EGL_SURFACE_TYPE,
+                                      noSurface ? 0 : EGL_PBUFFER_BIT,
+                                      EGL_RENDERABLE_TYPE,
+                                      EGL_OPENGL_BIT,
+                                      EGL_RED_SIZE,
+                                      8,
+                                      EGL_GREEN_SIZE,
+                                      8,
+                                      EGL_BLUE_SIZE,
+                                      8,
+                                      EGL_NONE};
+    EGLConfig   config;
+    EGLint      numConfigs = 0;
+    if(!eglChooseConfig(m_display, configAttributes, &config, 1, &numConfigs))
+        return Fail("no EGL config");
+    if(numConfigs == 0)
+    {
+        // surfaceless platforms may have no configs at all, contexts are then created without one
+        if(!noSurface || !HasExtension(extensions, "EGL_KHR_no_config_context"))
+            return Fail("no EGL config");
+        config = EGL_NO_CONFIG_KHR;
+    }
+
+    if(!eglBindAPI(EGL_OPENGL_API))
+        return Fail("no desktop OpenGL in EGL");
+
+    EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                  3,
+                                  EGL_CONTEXT_MINOR_VERSION,
+                                  3,
+                                  EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                  EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                  EGL_NONE};
+    m_context                  = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttributes);
+    if(m_context == EGL_NO_CONTEXT)
+        return Fail("no OpenGL 3.3 core context");
+
+    if(!noSurface)
+    {
+        EGLint surfaceAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+        m_surface                  = eglCreatePbufferSurface(m_display, config, surfaceAttributes);
+        if(m_surface == EGL_NO_SURFACE)
+            return Fail("no pbuffer surface");
+    }
+
+    EGLSurface surface = m_surface != nullptr ? (EGLSurface)m_surface : EGL_NO_SURFACE;
+    if(!eglMakeCurrent(m_display, surface, surface, m_context))
+        return Fail("cannot make the context current");
+    if(!gladLoadGLLoader((GLADloadproc)eglGetProcAddress))
+        return Fail("cannot load OpenGL entry points");
+
+    // same formats as the toolkit's render texture
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glGenRenderbuffers(1, &m_color);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color);
+    glGenRenderbuffers(1, &m_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        return Fail("incomplete framebuffer");
+
+    Bind();
+    return true;
+}
+
+void HeadlessContext::Destroy()
+{
+    if(m_display == nullptr)
+        return;
+
+    if(m_context != nullptr && eglGetCurrentContext() == m_context)
+    {
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteRenderbuffers(1, &m_color);
+        glDeleteRenderbuffers(1, &m_depth);
+    }
+    m_framebuffer = 0;
+    m_color       = 0;
+    m_depth       = 0;
+
+    eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(m_surface != nullptr)
+        eglDestroySurface(m_display, m_surface);
+    if(m_context != nullptr)
+        eglDestroyContext(m_display, m_context);
+    eglTerminate(m_display);
+    m_surface = nullptr;
+    m_context = nullptr;
+    m_display = nullptr;
+}
+
+void HeadlessContext::Bind()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glViewport(0, 0, m_width, m_height);
+
+    // raylib sets this up for the viewer, later draws win depth ties
+    glDepthFunc(GL_LEQUAL);
+}
+
+std::string HeadlessContext::GetRendererName() const
+{
+    auto name = glGetString(GL_RENDERER);
+    return name != nullptr ? (const char*)name : "";
+}
+
+void HeadlessContext::ReadPixels(std::vector<uint8_t>& rgba) const
+{
+    size_t stride = (size_t)m_width * 4;
+    rgba.resize(stride * m_height);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+
+    // GL rows start at the bottom
+    std::vector<uint8_t> row(stride);
+    for(int y = 0; y < m_height / 2; y++)
+    {
+        uint8_t* top    = rgba.data() + y * stride;
+        uint8_t* bottom = rgba.data() + (m_height - 1 - y) * stride;
+        memcpy(row.data(), top, stride);
+        memcpy(top, bottom, stride);
+        memcpy(bottom, row.data(), stride);
+    }
+}
+
+static void WriteChunk(FILE* out, const char* type, const uint8_t* data, uint32_t length)
+{
+    uint8_t header[8] = {(uint8_t)(length >> 24), (uint8_t)(length >> 16), (uint8_t)(length >> 8), (uint8_t)length};
+    memcpy(header + 4, type, 4);
+    uLong crc = crc32(crc32(0, header + 4, 4), data, length);
+
+    uint8_t footer[4] = {(uint8_t)(crc >> 24), (uint8_t)(crc >> 16), (uint8_t)(crc >> 8), (uint8_t)crc};
+    fwrite(header, sizeof(header), 1, out);
+    fwrite(data, 1, length, out);
+    fwrite(footer, sizeof(footer), 1, out);
+}
+
+bool HeadlessContext::WritePNG(const std::filesystem::path& path, const std::vector<uint8_t>& rgba, int width, int height)
+{
+    // 8-bit RGBA, every row unfiltered
+    size_t               stride = (size_t)width * 4;
+    std::vector<uint8_t> rows((stride + 1) * height);
+    for(int y = 0; y < height; y++)
+    {
+        rows[y * (stride + 1)] = 0;
+        memcpy(rows.data() + y * (stride + 1) + 1, rgba.data() + y * stride, stride);
+    }
+
+    uLongf               compressedSize = compressBound((uLong)rows.size());
+    std::vector<uint8_t> compressed(compressedSize);
+    if(compress2(compressed.data(), &compressedSize, rows.data(), (uLong)rows.size(), Z_BEST_SPEED) != Z_OK)
+        return false;
+
+    FILE* out = fopen(path.string().c_str(), "wb");
+    if(out == nullptr)
+        return false;
+
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    uint8_t       header[13]   = {(uint8_t)(width >> 24),
+                                  (uint8_t)(width >> 16),
+                                  (uint8_t)(width >> 8),
+                                  (uint8_t)width,
+                                  (uint8_t)(height >> 24),
+                                  (uint8_t)(height >> 16),
+                                  (uint8_t)(height >> 8),
+                                  (uint8_t)height,
+                                  8 /*bit depth*/,
+                                  6 /*RGBA*/,
+                                  0,
+                                  0,
+                                  0};
+    fwrite(signature, sizeof(signature), 1, out);
+    WriteChunk(out, "IHDR", header, sizeof(header));
+    WriteChunk(out, "IDAT", compressed.data(), (uint32_t)compressedSize);
+    WriteChunk(out, "IEND", nullptr, 0);
+    bool written = ferror(out) == 0;
+    fclose(out);
+    return written;
+}
+
+bool HeadlessContext::WritePNG(const std::filesystem::path& path, const std::vector<uint8_t>& rgba) const
+{
+    return WritePNG(path, rgba, m_width, m_height);
+}
+
+bool HeadlessContext::WritePNG(const std::filesystem::path& path) const
+{
+    std::vector<uint8_t> rgba;
+    ReadPixels(rgba);
+    return WritePNG(path, rgba);
+}
+
+} // namespace rvx
@@ -0,0 +1,48 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#pragma once
+
+#include "rvx-toolkit/stdafx.h"
+#include "rvx/rvx.h"
+
+namespace rvx
+{
+
+// OpenGL 3.3 core context without a window or display server, EGL surfaceless where Mesa offers it and a pbuffer
+// otherwise, draws go to a framebuffer of the requested size
+class HeadlessContext
+{
+public:
+    ~HeadlessContext();
+    bool Create(int width, int height);
+    void Destroy();
+    void Bind(); // framebuffer, viewport and depth test as in the viewer
+    void ReadPixels(std::vector<uint8_t>& rgba) const; // top row first
+    bool WritePNG(const std::filesystem::path& path, const std::vector<uint8_t>& rgba) const;
+    bool WritePNG(const std::filesystem::path& path) const;
+    static bool WritePNG(const std::filesystem::path& path, const std::vector<uint8_t>& rgba, int width, int height);
+
+    int                GetWidth() const { return m_width; }
+    int                GetHeight() const { return m_height; }
+    const std::string& GetError() const { return m_error; }
+    std::string        GetRendererName() const;
+
+private:
+    bool Fail(const char* error);
+
+    void*       m_display = nullptr; // EGLDisplay
+    void*       m_context = nullptr; // EGLContext
+    void*       m_surface = nullptr; // EGLSurface, only without surfaceless support
+    GLuint      m_framebuffer = 0;
+    GLuint      m_color       = 0;
+    GLuint      m_depth       = 0;
+    int         m_width       = 0;
+    int         m_height      = 0;
+    std::string m_error;
+};
+
+} // namespace rvx
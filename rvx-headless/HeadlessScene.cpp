@@ -0,0 +1,81 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#include "HeadlessScene.h"
+#include "rvx-toolkit/VOXLoader.h"
+
+namespace rvx
+{
+
+HeadlessScene::HeadlessScene()
+{
+    m_scene.m_updated = &m_updated;
+}
+
+HeadlessScene::~HeadlessScene()
+{
+    rvx_model_unbind(m_scene.m_model);
+    rvx_model_free(m_scene.m_model);
+}
+
+bool HeadlessScene::Load(const std::filesystem::path& scenePath)
+{
+    m_scene.Load(scenePath);
+    if(m_scene.m_scenePath.empty())
+    {
+        m_error = "not an rvx100 scene: " + scenePath.string();
+        return false;
+    }
+
+    if(m_scene.m_voxFileName.empty())
+    {
+        m_scene.Resize();
+    }
+    else
+    {
+        auto voxPath = m_scene.AssetPath(m_scene.m_voxFileName);
+        auto vox     = VOXLoader::LoadVOX(voxPath.string().c_str(), false);
+        if(vox == nullptr)
+        {
+            m_error = "cannot load " + voxPath.string();
+            return false;
+        }
+        VOXLoader::ImportVOX(vox, m_scene, true);
+        ogt_vox_destroy_scene(vox);
+    }
+
+    // as Viewer::Reset
+    m_scene.cam_x = m_scene.m_params.TARGET_POS[0];
+    m_scene.cam_y = m_scene.m_params.TARGET_POS[1];
+    return true;
+}
+
+void HeadlessScene::Upload(bool colorQuads, bool gpu)
+{
+    m_snapshot.Capture(m_scene);
+    m_snapshot.m_colorQuads = colorQuads;
+    m_snapshot.Populate(m_scene.m_model);
+    if(gpu)
+        rvx_model_upload(m_scene.m_model);
+}
+
+void HeadlessScene::Render(RVX_RENDERER* renderer)
+{
+    // as Renderer::Render
+    renderer->camX = m_scene.cam_x;
+    renderer->camY = m_scene.cam_y;
+
+    // the software renderer clears to opaque black already
+    if(renderer->soft == nullptr)
+        glClearColor(0, 0, 0, 1);
+    rvx_renderer_begin(renderer);
+    rvx_renderer_view(renderer, &m_scene.m_params);
+    rvx_model_render(renderer, m_scene.m_model, 0);
+    rvx_model_render_edges(renderer, m_scene.m_model);
+    rvx_renderer_end(renderer);
+}
+
+} // namespace rvx
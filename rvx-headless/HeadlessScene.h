@@ -0,0 +1,34 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#pragma once
+
+#include "rvx-toolkit/Scene.h"
+#include "rvx-toolkit/SceneSnapshot.h"
+
+namespace rvx
+{
+
+// an .rvx scene imported and drawn the way the viewer does it, needs a current context from Upload on unless drawn
+// by rvx_backend_soft
+class HeadlessScene
+{
+public:
+    HeadlessScene();
+    ~HeadlessScene();
+    bool Load(const std::filesystem::path& scenePath); // imports the .vox or builds the blank construct
+    void Upload(bool colorQuads = false, bool gpu = true); // without gpu the model is left for a software renderer
+    void Render(RVX_RENDERER* renderer); // clears the bound framebuffer first
+
+    ViewerScene   m_scene;
+    SceneSnapshot m_snapshot;
+    std::string   m_error;
+
+private:
+    volatile bool m_updated = false;
+};
+
+} // namespace rvx
@@ -0,0 +1,420 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+// times importing, meshing, populating, exporting and rendering and writes the results as JSON so runs can be compared
+
+#include "HeadlessContext.h"
+#include "HeadlessScene.h"
+#include "rvx-toolkit/Flythrough.h"
+#include "rvx-toolkit/Profiler.h"
+#include "rvx-toolkit/VOXLoader.h"
+#include "rvx/rvx_soft.h"
+
+using namespace rvx;
+
+constexpr const char* c_benchVox   = "samples/enclosure-assets/enclosure.vox";
+constexpr const char* c_benchScene = "samples/enclosure.rvx";
+
+// construct sizes, doubling up to the largest the toolkit accepts
+constexpr int c_benchBoxes[][3] = {{128, 32, 32}, {256, 64, 64}, {512, 128, 128}, {c_maxSizeX, c_maxSizeY, c_maxSizeZ}};
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: rvx-bench [options]\n"
+            "  --out FILE         write JSON to FILE instead of stdout\n"
+            "  --repeat N         timed runs of each step, default 5\n"
+            "  --frames N         headless frames, default 300\n"
+            "  --size WxH         headless frame size, default 2560x1344\n"
+            "  --no-render        skip the headless and software frames\n");
+}
+
+static std::string Format(const char* format, ...)
+{
+    char    text[64];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    return text;
+}
+
+// milliseconds of each timed run
+struct Timings
+{
+    std::vector<double> runs;
+
+    template <typename F>
+    void Measure(int repeat, F func)
+    {
+        for(int r = 0; r < repeat; r++)
+        {
+            auto start = Profiler::Now();
+            func();
+            runs.push_back((Profiler::Now() - start) / 1e6);
+        }
+    }
+
+    double Min() const { return runs.empty() ? 0 : *std::min_element(runs.begin(), runs.end()); }
+    double Average() const { return runs.empty() ? 0 : std::accumulate(runs.begin(), runs.end(), 0.0) / runs.size(); }
+    double Median() const
+    {
+        if(runs.empty())
+            return 0;
+        auto sorted = runs;
+        std::sort(sorted.begin(), sorted.end());
+        return sorted[sorted.size() / 2];
+    }
+};
+
+// one object of the "benchmarks" array, fields are appended in order
+class BenchResult
+{
+public:
+    BenchResult(const char* name) { m_json = "{\"name\":" + Profiler::Quote(name); }
+
+    BenchResult& Field(const char* key, int64_t value) { return Raw(key, std::to_string(value)); }
+    BenchResult& Field(const char* key, double value) { return Raw(key, Format("%.4f", value)); }
+    BenchResult& Field(const char* key, const std::string& value) { return Raw(key, Profiler::Quote(value)); }
+    BenchResult& Times(const Timings& timings)
+    {
+        return Field("runs", (int64_t)timings.runs.size()).Field("min_ms", timings.Min()).Field("median_ms", timings.Median()).Field("avg_ms", timings.Average());
+    }
+    BenchResult& Raw(const char* key, const std::string& value)
+    {
+        m_json += std::string(",\"") + key + "\":" + value;
+        return *this;
+    }
+
+    std::string Json() const { return m_json + "}"; }
+
+private:
+    std::string m_json;
+};
+
+static size_t CountQuads(const Scene& scene)
+{
+    size_t quads = 0;
+    for(const auto& area : scene.m_areas)
+        quads += area.m_quads.Size();
+    return quads;
+}
+
+static size_t QuadBytes(const Scene& scene)
+{
+    size_t bytes = 0;
+    for(const auto& area : scene.m_areas)
+        bytes += area.m_quads.Bytes();
+    return bytes;
+}
+
+static std::string SizeJson(int x, int y, int z)
+{
+    return Format("[%d,%d,%d]", x, y, z);
+}
+
+static void BenchVOX(std::vector<BenchResult>& results, int repeat)
+{
+    Timings load;
+    load.Measure(repeat, [] { ogt_vox_destroy_scene(VOXLoader::LoadVOX(c_benchVox, false)); });
+    results.emplace_back("load_vox").Field("input", std::string(c_benchVox)).Field("file_bytes", (int64_t)std::filesystem::file_size(c_benchVox)).Times(load);
+
+    auto        vox = VOXLoader::LoadVOX(c_benchVox, false);
+    ViewerScene scene;
+    Timings     import;
+    import.Measure(repeat, [&] { VOXLoader::ImportVOX(vox, scene, true); });
+    ogt_vox_destroy_scene(vox);
+    results.emplace_back("import_vox")
+        .Field("input", std::string(c_benchVox))
+        .Field("areas", (int64_t)scene.m_areas.size())
+        .Field("quads", (int64_t)CountQuads(scene))
+        .Field("quad_bytes", (int64_t)QuadBytes(scene))
+        .Times(import);
+}
+
+static void BenchBoxes(std::vector<BenchResult>& results, int repeat)
+{
+    for(const auto& size : c_benchBoxes)
+    {
+        // as ViewerScene::Resize
+        const ogt_vox_scene* vox = nullptr;
+        Timings              generate;
+        generate.Measure(repeat, [&] {
+            if(vox)
+                ogt_vox_destroy_scene(vox);
+            vox = VOXLoader::GenerateBox(size[0], size[1], size[2], true, 4);
+        });
+        results.emplace_back("generate_box").Raw("size", SizeJson(size[0], size[1], size[2])).Times(generate);
+
+        ViewerScene scene;
+        Timings     import;
+        import.Measure(repeat, [&] { VOXLoader::ImportVOX(vox, scene, true); });
+        ogt_vox_destroy_scene(vox);
+        results.emplace_back("import_box")
+            .Raw("size", SizeJson(size[0], size[1], size[2]))
+            .Field("areas", (int64_t)scene.m_areas.size())
+            .Field("quads", (int64_t)CountQuads(scene))
+            .Field("quad_bytes", (int64_t)QuadBytes(scene))
+            .Times(import);
+    }
+}
+
+static void BenchPopulate(std::vector<BenchResult>& results, int repeat, const ViewerScene& scene)
+{
+    std::vector<Voxel> voxels;
+    for(const auto& area : scene.m_areas)
+        area.m_quads.ForEach([&voxels](const Voxel& v) { voxels.push_back(v); });
+    auto palette = reinterpret_cast<Color4*>(const_cast<Color*>(scene.m_palette.data()));
+
+    RVX_MODEL_MEMORY memory;
+    RVX_MODEL*       model = rvx_model_new();
+    Timings          buffer;
+    buffer.Measure(repeat, [&] { rvx_model_populate_buffer(model, voxels.data(), (int)voxels.size(), palette); });
+    rvx_model_memory(model, &memory);
+    results.emplace_back("populate_buffer")
+        .Field("quads", (int64_t)voxels.size())
+        .Field("vertex_bytes", (int64_t)memory.vertexBytes)
+        .Times(buffer)
+        .Field("mquads_per_s", voxels.size() / (buffer.Median() * 1000.0));
+    rvx_model_free(model);
+
+    // what a viewer rebuild runs, areas and edges from the compact quad store
+    SceneSnapshot snapshot;
+    snapshot.Capture(scene);
+    model = rvx_model_new();
+    Timings spans;
+    spans.Measure(repeat, [&] { snapshot.Populate(model); });
+    rvx_model_memory(model, &memory);
+    results.emplace_back("populate_spans")
+        .Field("quads", (int64_t)voxels.size())
+        .Field("edges", (int64_t)snapshot.m_edges.size())
+        .Field("vertex_bytes", (int64_t)memory.vertexBytes)
+        .Field("edge_bytes", (int64_t)memory.edgeBytes)
+        .Times(spans)
+        .Field("mquads_per_s", voxels.size() / (spans.Median() * 1000.0));
+    rvx_model_free(model);
+}
+
+static void BenchExport(std::vector<BenchResult>& results, int repeat, ViewerScene& scene)
+{
+    auto    objName = (std::filesystem::temp_directory_path() / "rvx-bench").string();
+    Timings exportOBJ;
+    exportOBJ.Measure(repeat, [&] { scene.ExportOBJ(objName, false); });
+    results.emplace_back("export_obj")
+        .Field("quads", (int64_t)CountQuads(scene))
+        .Field("file_bytes", (int64_t)std::filesystem::file_size(objName + ".obj"))
+        .Times(exportOBJ);
+    std::filesystem::remove(objName + ".obj");
+    std::filesystem::remove(objName + ".mtl");
+}
+
+static bool BenchFrames(std::vector<BenchResult>& results, HeadlessScene& scene, int frames, int width, int height)
+{
+    HeadlessContext context;
+    if(!context.Create(width, height))
+    {
+        results.emplace_back("headless_frames").Field("skipped", context.GetError());
+        return false;
+    }
+
+    RVX_RENDERER* renderer = rvx_renderer_init(rvx_backend_gl, 0);
+    renderer->timing       = 1;
+    scene.Upload();
+    context.Bind();
+
+    // GPU times arrive RVX_TIMER_FRAMES frames late, the warm-up also builds the programs
+    Timings    upload;
+    RVX_STATS  stats;
+    int        warmup = RVX_TIMER_FRAMES * 2;
+    Timings    cpu;
+    Timings    gpu;
+    int        lastGpuFrame = -1;
+    for(int f = 0; f < warmup + frames; f++)
+    {
+        auto start = Profiler::Now();
+        scene.Render(renderer);
+        glFinish();
+        if(f >= warmup)
+            cpu.runs.push_back((Profiler::Now() - start) / 1e6);
+
+        rvx_renderer_stats(renderer, &stats);
+        if(stats.gpuFrame >= warmup && stats.gpuFrame != lastGpuFrame)
+            gpu.runs.push_back(stats.gpuFrameTime);
+        lastGpuFrame = stats.gpuFrame;
+    }
+    rvx_check_glerror("rvx-bench");
+
+    upload.Measure(1, [&] {
+        rvx_model_upload(scene.m_scene.m_model);
+        glFinish();
+    });
+
+    RVX_MODEL_MEMORY memory;
+    rvx_model_memory(scene.m_scene.m_model, &memory);
+    results.emplace_back("headless_frames")
+        .Field("renderer", context.GetRendererName())
+        .Raw("size", Format("[%d,%d]", width, height))
+        .Field("quads", (int64_t)CountQuads(scene.m_scene))
+        .Field("draw_calls", (int64_t)stats.counters.drawCalls)
+        .Field("triangles", (int64_t)stats.counters.triangles)
+        .Field("gpu_bytes", (int64_t)(memory.gpuVertexBytes + memory.gpuEdgeBytes))
+        .Field("upload_ms", upload.Min())
+        .Times(cpu)
+        .Field("gpu_runs", (int64_t)gpu.runs.size())
+        .Field("gpu_min_ms", gpu.Min())
+        .Field("gpu_median_ms", gpu.Median())
+        .Field("gpu_avg_ms", gpu.Average());
+
+    // the viewer's flythrough, frames end at glFinish instead of a swap
+    Flythrough flythrough;
+    float      frameTime = 0;
+    flythrough.Start(scene.m_scene);
+    rvx_renderer_stats(renderer, &stats);
+    while(flythrough.Advance(scene.m_scene, frameTime, stats))
+    {
+        auto start = Profiler::Now();
+        scene.Render(renderer);
+        glFinish();
+        frameTime = (Profiler::Now() - start) / 1e6f;
+        rvx_renderer_stats(renderer, &stats);
+    }
+
+    const auto& fly = flythrough.GetResult();
+    results.emplace_back("flythrough")
+        .Field("frames", (int64_t)fly.cpu.frames)
+        .Field("min_ms", (double)fly.cpu.min)
+        .Field("avg_ms", (double)fly.cpu.avg)
+        .Field("p99_ms", (double)fly.cpu.p99)
+        .Field("gpu_frames", (int64_t)fly.gpu.frames)
+        .Field("gpu_min_ms", (double)fly.gpu.min)
+        .Field("gpu_avg_ms", (double)fly.gpu.avg)
+        .Field("gpu_p99_ms", (double)fly.gpu.p99);
+
+    // the model's GL objects go with the context
+    rvx_model_unbind(scene.m_scene.m_model);
+    rvx_renderer_free(renderer);
+    context.Destroy();
+    return true;
+}
+
+// rvx_backend_soft on one thread and on every core, raster times are what GL reports as GPU times,
+// a single core only gets the first run as the second would repeat it
+static void BenchSoftFrames(std::vector<BenchResult>& results, HeadlessScene& scene, int frames, int width, int height)
+{
+    const int        cores  = std::clamp<int>(std::thread::hardware_concurrency(), 1, RVX_SOFT_MAX_THREADS);
+    std::vector<int> counts = {1};
+    if(cores > 1)
+        counts.push_back(cores);
+
+    scene.Upload(false, false);
+    for(int threads : counts)
+    {
+        RVX_RENDERER* renderer = rvx_renderer_init(rvx_backend_soft, 0);
+        renderer->timing       = 1;
+        renderer->renderWidth  = width;
+        renderer->renderHeight = height;
+        rvx_soft_set_threads(renderer, threads);
+
+        Timings   cpu;
+        Timings   raster;
+        RVX_STATS stats;
+        for(int f = 0; f < frames; f++)
+        {
+            auto start = Profiler::Now();
+            scene.Render(renderer);
+            cpu.runs.push_back((Profiler::Now() - start) / 1e6);
+
+            rvx_renderer_stats(renderer, &stats);
+            raster.runs.push_back(stats.gpuFrameTime);
+        }
+
+        results.emplace_back("soft_frames")
+            .Field("threads", (int64_t)threads)
+            .Raw("size", Format("[%d,%d]", width, height))
+            .Field("triangles", (int64_t)stats.counters.triangles)
+            .Times(cpu)
+            .Field("raster_min_ms", raster.Min())
+            .Field("raster_median_ms", raster.Median())
+            .Field("raster_avg_ms", raster.Average());
+        rvx_renderer_free(renderer);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* outPath = nullptr;
+    int         repeat  = 5;
+    int         frames  = 300;
+    int         width   = 320 * 8;
+    int         height  = 168 * 8;
+    bool        render  = true;
+    for(int a = 1; a < argc; a++)
+    {
+        std::string option = argv[a];
+        const char* value  = a + 1 < argc ? argv[a + 1] : nullptr;
+        bool        parsed = value != nullptr;
+        if(option == "--no-render")
+        {
+            render = false;
+            continue;
+        }
+        if(option == "--out")
+            outPath = value;
+        else if(option == "--repeat")
+            parsed = parsed && sscanf(value, "%d", &repeat) == 1 && repeat > 0;
+        else if(option == "--frames")
+            parsed = parsed && sscanf(value, "%d", &frames) == 1 && frames > 0;
+        else if(option == "--size")
+            parsed = parsed && sscanf(value, "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+        else
+            parsed = false;
+
+        if(!parsed)
+        {
+            Usage();
+            return 1;
+        }
+        a++;
+    }
+
+    if(!std::filesystem::exists(c_benchVox))
+    {
+        fprintf(stderr, "rvx-bench: %s not found, run from the repository root\n", c_benchVox);
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    BenchVOX(results, repeat);
+    BenchBoxes(results, repeat);
+
+    HeadlessScene scene;
+    if(!scene.Load(c_benchScene))
+    {
+        fprintf(stderr, "rvx-bench: %s\n", scene.m_error.c_str());
+        return 1;
+    }
+    BenchPopulate(results, repeat, scene.m_scene);
+    BenchExport(results, repeat, scene.m_scene);
+    if(render)
+    {
+        BenchFrames(results, scene, frames, width, height);
+        BenchSoftFrames(results, scene, frames, width, height);
+    }
+
+    FILE* out = outPath ? fopen(outPath, "w") : stdout;
+    if(out == nullptr)
+    {
+        fprintf(stderr, "rvx-bench: cannot write %s\n", outPath);
+        return 1;
+    }
+    fprintf(out, "{\"scene\":%s,\"repeat\":%d,\"benchmarks\":[\n", Profiler::Quote(c_benchScene).c_str(), repeat);
+    for(size_t r = 0; r < results.size(); r++)
+        fprintf(out, "%s%s\n", results[r].Json().c_str(), r + 1 < results.size() ? "," : "");
+    fprintf(out, "]}\n");
+    if(outPath)
+        fclose(out);
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+// renders an .rvx scene to a PNG without a window, for batch renders and golden-image checks on build servers
+
+#include "HeadlessContext.h"
+#include "HeadlessScene.h"
+#include "rvx-toolkit/Model.h"
+
+#include <cmath>
+
+using namespace rvx;
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: rvx-render <scene.rvx> <out.png> [options]\n"
+            "  --size WxH         output size, default 2560x1344\n"
+            "  --target X,Y       camera target, moves the camera with it\n"
+            "  --height H         camera height\n"
+            "  --dist D           camera distance\n"
+            "  --fov F            field of view in degrees\n"
+            "  --mode M           shaded, overdraw or quads\n"
+            "  --capture FILE     record the rvx calls of the frame for rvx-replay\n"
+            "  --soft             draw with the software rasterizer, needs no GL driver\n"
+            "  --threads N        software rasterizer threads, default one per core\n");
+}
+
+// same ramp as resources/shaders/glsl330/heatmap.fs
+static void ApplyHeatmap(std::vector<uint8_t>& rgba)
+{
+    for(size_t p = 0; p < rgba.size(); p += 4)
+    {
+        float count = rgba[p];
+        float t     = std::clamp(count / HEATMAP_MAX_COUNT, 0.0f, 1.0f);
+        float heat[3] = {1.5f - std::fabs(4.0f * t - 3.0f), 1.5f - std::fabs(4.0f * t - 2.0f), 1.5f - std::fabs(4.0f * t - 1.0f)};
+        for(int c = 0; c < 3; c++)
+            rgba[p + c] = count > 0 ? (uint8_t)(std::clamp(heat[c], 0.0f, 1.0f) * 255.0f + 0.5f) : 0;
+        rgba[p + 3] = 255;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        Usage();
+        return 1;
+    }
+
+    int         width  = 320 * 8;
+    int         height = 168 * 8;
+    std::string mode   = "shaded";
+    float       target[2];
+    bool        hasTarget = false;
+    float       camHeight = -1;
+    float       camDist   = -1;
+    float       fov       = -1;
+    const char* capture   = nullptr;
+    bool        soft      = false;
+    int         threads   = 0;
+    for(int a = 3; a < argc; a++)
+    {
+        std::string option = argv[a];
+        const char* value  = a + 1 < argc ? argv[a + 1] : nullptr;
+        bool        parsed = value != nullptr;
+        if(option == "--soft")
+        {
+            soft = true;
+            continue;
+        }
+        if(option == "--size")
+            parsed = parsed && sscanf(value, "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+        else if(option == "--target")
+            parsed = parsed && (hasTarget = sscanf(value, "%f,%f", &target[0], &target[1]) == 2);
+        else if(option == "--height")
+            parsed = parsed && sscanf(value, "%f", &camHeight) == 1;
+        else if(option == "--dist")
+            parsed = parsed && sscanf(value, "%f", &camDist) == 1;
+        else if(option == "--fov")
+            parsed = parsed && sscanf(value, "%f", &fov) == 1;
+        else if(option == "--mode")
+            parsed = parsed && ((mode = value) == "shaded" || mode == "overdraw" || mode == "quads");
+        else if(option == "--capture")
+            capture = value;
+        else if(option == "--threads")
+            parsed = parsed && sscanf(value, "%d", &threads) == 1 && threads > 0;
+        else
+            parsed = false;
+
+        if(!parsed)
+        {
+            Usage();
+            return 1;
+        }
+        a++;
+    }
+
+    HeadlessContext context;
+    if(!soft && !context.Create(width, height))
+    {
+        fprintf(stderr, "rvx-render: %s\n", context.GetError().c_str());
+        return 1;
+    }
+
+    int status = 0;
+    {
+        HeadlessScene scene;
+        if(!scene.Load(argv[1]))
+        {
+            fprintf(stderr, "rvx-render: %s\n", scene.m_error.c_str());
+            return 1;
+        }
+
+        auto& params = scene.m_scene.m_params;
+        if(hasTarget)
+        {
+            params.TARGET_POS[0] = scene.m_scene.cam_x = target[0];
+            params.TARGET_POS[1] = scene.m_scene.cam_y = target[1];
+        }
+        if(camHeight >= 0)
+            params.CAM_HEIGHT = camHeight;
+        if(camDist >= 0)
+            params.CAM_DIST = camDist;
+        if(fov > 0)
+            params.CAM_FOV = fov;
+
+        RVX_RENDERER* renderer = rvx_renderer_init(soft ? rvx_backend_soft : rvx_backend_gl, 0);
+        renderer->shaderFlags  = mode == "overdraw" ? RVX_SHADER_OVERDRAW : 0;
+        if(soft)
+        {
+            renderer->renderWidth  = width;
+            renderer->renderHeight = height;
+            rvx_soft_set_threads(renderer, threads);
+        }
+        scene.Upload(mode == "quads", !soft);
+
+        if(capture != nullptr && !rvx_capture_begin(capture, 1))
+        {
+            fprintf(stderr, "rvx-render: cannot write %s\n", capture);
+            status = 1;
+        }
+
+        if(!soft)
+            context.Bind();
+        scene.Render(renderer);
+        rvx_capture_end();
+
+        std::vector<uint8_t> rgba;
+        if(soft)
+        {
+            rgba.resize((size_t)width * height * 4);
+            rvx_soft_read_pixels(renderer, rgba.data());
+        }
+        else
+        {
+            rvx_check_glerror("rvx-render");
+            context.ReadPixels(rgba);
+        }
+        if(mode == "overdraw")
+            ApplyHeatmap(rgba);
+        if(!HeadlessContext::WritePNG(argv[2], rgba, width, height))
+        {
+            fprintf(stderr, "rvx-render: cannot write %s\n", argv[2]);
+            status = 1;
+        }
+        rvx_renderer_free(renderer);
+    }
+    context.Destroy();
+    return status;
+}
@@ -0,0 +1,704 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+// replays a file written by rvx_capture_begin offscreen and reports how long its frames take, so workloads recorded
+// in a game can be profiled without it
+
+#include "HeadlessContext.h"
+#include "rvx-toolkit/Flythrough.h"
+#include "rvx-toolkit/Profiler.h"
+#include "rvx/rvx_capture.h"
+
+using namespace rvx;
+
+static void Usage()
+{
+    fprintf(stderr,
+            "usage: rvx-replay <capture> [options]\n"
+            "  --repeat N         times to replay the capture, default 1\n"
+            "  --size WxH         framebuffer size, default the largest captured viewport\n"
+            "  --png FILE         write the last frame\n"
+            "  --out FILE         write JSON to FILE instead of stdout\n");
+}
+
+// bounds-checked reads from one record, arrays are copied so they are aligned for rvx
+class RecordReader
+{
+public:
+    RecordReader(const std::vector<char>& data, size_t offset, size_t size) : m_at(data.data() + offset), m_end(m_at + size) { }
+
+    template <typename T>
+    bool Read(T& value)
+    {
+        return ReadBytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    bool ReadArray(std::vector<T>& values, int count)
+    {
+        if(count < 0)
+            return false;
+        values.resize(count);
+        return ReadBytes(values.data(), count * sizeof(T));
+    }
+
+    // Voxel has no default constructor
+    bool ReadArray(std::vector<Voxel>& values, int count)
+    {
+        if(count < 0 || (size_t)(m_end - m_at) < count * sizeof(Voxel))
+            return false;
+        values.assign(count, Voxel(0, 0, 0, 0, 0, 0, 0));
+        return ReadBytes(values.data(), count * sizeof(Voxel));
+    }
+
+private:
+    bool ReadBytes(void* data, size_t size)
+    {
+        if((size_t)(m_end - m_at) < size)
+            return false;
+        memcpy(data, m_at, size);
+        m_at += size;
+        return true;
+    }
+
+    const char* m_at;
+    const char* m_end;
+};
+
+struct CapturedModel
+{
+    RVX_CAPTURE_MODEL_STATE state;
+    std::vector<float>      buffer;
+    std::vector<RVX_AREA>   areas;
+    std::vector<RVX_EDGE>   edges;
+    std::vector<float>      edgeBuffer;
+};
+
+struct CapturedSpan
+{
+    RVX_CAPTURE_SPAN      head;
+    std::vector<Voxel>    voxels;
+    std::vector<uint8_t>  colorIndex;
+    std::vector<int16_t>  sx;
+    std::vector<uint16_t> width;
+    std::vector<int16_t>  sz;
+    std::vector<uint16_t> height;
+    std::vector<int16_t>  rowY;
+    std::vector<uint32_t> rowStart;
+};
+
+struct CapturedPopulate
+{
+    RVX_CAPTURE_POPULATE      head;
+    std::vector<RVX_EDGE>     edges;
+    std::vector<Color4>       palette;
+    std::vector<Voxel>        voxels;
+    std::vector<CapturedSpan> spans;
+    std::vector<RVX_QUADS>    quads;
+    std::vector<RVX_SPAN>     rvxSpans;
+};
+
+struct CapturedCall
+{
+    uint32_t                          type;
+    std::vector<char>                 fixed; // payloads of a single struct
+    std::unique_ptr<CapturedModel>    model;
+    std::unique_ptr<CapturedPopulate> populate;
+    std::vector<RVX_CAPTURE_INSTANCE> instances;
+};
+
+static bool ReadSpan(RecordReader& reader, CapturedSpan& span)
+{
+    if(!reader.Read(span.head))
+        return false;
+    if(span.head.count >= 0)
+        return reader.ReadArray(span.voxels, span.head.count);
+
+    int quads = span.head.numQuads;
+    int rows  = span.head.numRows;
+    return reader.ReadArray(span.colorIndex, quads) && reader.ReadArray(span.sx, quads) && reader.ReadArray(span.width, quads) &&
+           reader.ReadArray(span.sz, quads) && reader.ReadArray(span.height, quads) && reader.ReadArray(span.rowY, rows) &&
+           reader.ReadArray(span.rowStart, rows);
+}
+
+static bool ReadPopulate(RecordReader& reader, uint32_t type, CapturedPopulate& populate)
+{
+    if(!reader.Read(populate.head) || !reader.ReadArray(populate.edges, populate.head.numEdges) || !reader.ReadArray(populate.palette, 256))
+        return false;
+    if(type == RVX_CAPTURE_POPULATE_BUFFER)
+        return reader.ReadArray(populate.voxels, populate.head.count);
+
+    populate.spans.resize(std::max(0, populate.head.count));
+    for(auto& span : populate.spans)
+    {
+        if(!ReadSpan(reader, span))
+            return false;
+    }
+
+    // views into the copies, built once they stopped moving
+    populate.quads.resize(populate.spans.size());
+    populate.rvxSpans.resize(populate.spans.size());
+    for(size_t s = 0; s < populate.spans.size(); s++)
+    {
+        const auto& span  = populate.spans[s];
+        auto&       quads = populate.quads[s];
+        quads.numQuads    = span.head.numQuads;
+        quads.colorIndex  = span.colorIndex.data();
+        quads.sx          = span.sx.data();
+        quads.width       = span.width.data();
+        quads.sz          = span.sz.data();
+        quads.height      = span.height.data();
+        quads.numRows     = span.head.numRows;
+        quads.rowY        = span.rowY.data();
+        quads.rowStart    = span.rowStart.data();
+
+        auto& rvxSpan   = populate.rvxSpans[s];
+        rvxSpan.area_no = span.head.area_no;
+        rvxSpan.voxels  = span.head.count >= 0 ? span.voxels.data() : nullptr;
+        rvxSpan.count   = std::max(0, span.head.count);
+        rvxSpan.quads   = span.head.count >= 0 ? nullptr : &quads;
+    }
+    return true;
+}
+
+static bool ReadCapture(const std::vector<char>& data, std::vector<CapturedCall>& calls, std::string& error)
+{
+    RVX_CAPTURE_HEADER header;
+    if(data.size() < sizeof(header))
+    {
+        error = "not a capture";
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if(header.magic != RVX_CAPTURE_MAGIC || header.version != RVX_CAPTURE_VERSION)
+    {
+        error = "not a capture or an unsupported version";
+        return false;
+    }
+    if(header.sceneParamsSize != sizeof(SceneParams) || header.voxelSize != sizeof(Voxel) || header.areaSize != sizeof(RVX_AREA) ||
+       header.edgeSize != sizeof(RVX_EDGE))
+    {
+        error = "captured by a build with different rvx structures";
+        return false;
+    }
+
+    size_t offset = sizeof(header);
+    while(offset + sizeof(RVX_CAPTURE_RECORD) <= data.size())
+    {
+        RVX_CAPTURE_RECORD record;
+        memcpy(&record, data.data() + offset, sizeof(record));
+        offset += sizeof(record);
+        if(record.size > data.size() - offset)
+            break; // cut short, the calls before it still replay
+
+        RecordReader reader(data, offset, record.size);
+        auto&        call = calls.emplace_back();
+        bool         read = true;
+        call.type         = record.type;
+        if(record.type == RVX_CAPTURE_MODEL)
+        {
+            call.model  = std::make_unique<CapturedModel>();
+            auto& model = *call.model;
+            read        = reader.Read(model.state) && reader.ReadArray(model.buffer, model.state.bufferSize / (int)sizeof(float)) &&
+                   reader.ReadArray(model.areas, model.state.numAreas) && reader.ReadArray(model.edges, model.state.numEdges) &&
+                   reader.ReadArray(model.edgeBuffer, model.state.edgeBufferSize / (int)sizeof(float));
+        }
+        else if(record.type == RVX_CAPTURE_POPULATE_BUFFER || record.type == RVX_CAPTURE_POPULATE_SPANS)
+        {
+            call.populate = std::make_unique<CapturedPopulate>();
+            read          = ReadPopulate(reader, record.type, *call.populate);
+        }
+        else if(record.type == RVX_CAPTURE_DRAW_INSTANCES)
+        {
+            RVX_CAPTURE_OBJECT object;
+            read = reader.Read(object) && reader.ReadArray(call.instances, object.value);
+            call.fixed.assign((const char*)&object, (const char*)&object + sizeof(object));
+        }
+        else
+        {
+            call.fixed.assign(data.begin() + offset, data.begin() + offset + record.size);
+        }
+
+        if(!read)
+        {
+            error = "damaged record at offset " + std::to_string(offset);
+            return false;
+        }
+        offset += record.size;
+    }
+    return true;
+}
+
+template <typename T>
+static T Fixed(const CapturedCall& call)
+{
+    T value;
+    memset(&value, 0, sizeof(T));
+    memcpy(&value, call.fixed.data(), std::min(sizeof(T), call.fixed.size()));
+    return value;
+}
+
+// replays calls against renderers and models made here, ids index both
+class Replayer
+{
+public:
+    ~Replayer()
+    {
+        for(auto model : m_models)
+        {
+            if(model != nullptr)
+            {
+                rvx_model_unbind(model);
+                rvx_model_free(model);
+            }
+        }
+        for(auto renderer : m_renderers)
+        {
+            if(renderer != nullptr)
+                rvx_renderer_free(renderer);
+        }
+    }
+
+    void Execute(const CapturedCall& call, HeadlessContext& context);
+    void DrainTimers(); // after glFinish, GPU times of the last frames that no later frame read back
+
+    std::vector<float> m_cpuTimes; // rvx_renderer_begin to rvx_renderer_end
+    std::vector<float> m_frameTimes; // to glFinish after rvx_renderer_end
+    std::vector<float> m_gpuTimes;
+    double             m_populateTime = 0;
+    double             m_uploadTime   = 0;
+    RVX_STATS          m_stats {};
+    std::map<int, int> m_callCounts;
+
+private:
+    RVX_MODEL*    Model(int id);
+    RVX_RENDERER* Renderer(int id);
+    void          ApplyState(const RVX_CAPTURE_STATE& state);
+    void          ApplyModel(const CapturedModel& captured);
+    void          ApplyPopulate(const CapturedPopulate& populate, RVX_MODEL* model);
+
+    std::vector<RVX_MODEL*>    m_models;
+    std::vector<RVX_RENDERER*> m_renderers;
+    std::vector<RVX_INSTANCE>  m_instances;
+    uint64_t                   m_frameStart   = 0;
+    int                        m_lastGpuFrame = -1;
+};
+
+void Replayer::DrainTimers()
+{
+    for(auto renderer : m_renderers)
+    {
+        while(renderer != nullptr && rvx_renderer_drain_timers(renderer, &m_stats))
+            m_gpuTimes.push_back((float)m_stats.gpuFrameTime);
+    }
+}
+
+RVX_MODEL* Replayer::Model(int id)
+{
+    if(id <= 0)
+        return nullptr;
+    if((size_t)id > m_models.size())
+        m_models.resize(id, nullptr);
+    if(m_models[id - 1] == nullptr)
+        m_models[id - 1] = rvx_model_new();
+    return m_models[id - 1];
+}
+
+RVX_RENDERER* Replayer::Renderer(int id)
+{
+    if(id <= 0)
+        return nullptr;
+    if((size_t)id > m_renderers.size())
+        m_renderers.resize(id, nullptr);
+    if(m_renderers[id - 1] == nullptr)
+    {
+        m_renderers[id - 1]         = rvx_renderer_init(rvx_backend_gl, 0);
+        m_renderers[id - 1]->timing = 1;
+    }
+    return m_renderers[id - 1];
+}
+
+void Replayer::ApplyState(const RVX_CAPTURE_STATE& state)
+{
+    auto renderer          = Renderer(state.renderer);
+    renderer->camX         = state.camX;
+    renderer->camY         = state.camY;
+    renderer->alpha        = state.alpha;
+    renderer->cullFar      = state.cullFar;
+    renderer->cullNear     = state.cullNear;
+    renderer->aspectW      = state.aspectW;
+    renderer->aspectH      = state.aspectH;
+    renderer->shaderFlags  = state.shaderFlags;
+    renderer->deferred     = state.deferred;
+    renderer->renderWidth  = state.renderWidth;
+    renderer->renderHeight = state.renderHeight;
+}
+
+template <typename T>
+static void CopyArray(T*& array, const std::vector<T>& values)
+{
+    free(array);
+    array = nullptr;
+    if(!values.empty())
+    {
+        array = (T*)malloc(values.size() * sizeof(T));
+        memcpy(array, values.data(), values.size() * sizeof(T));
+    }
+}
+
+void Replayer::ApplyModel(const CapturedModel& captured)
+{
+    // as the model was when first seen, uploaded again on its next draw
+    auto        model   = Model(captured.state.id);
+    const auto& state   = captured.state;
+    model->params       = state.params;
+    model->numVoxels    = state.numVoxels;
+    model->modelLength  = state.modelLength;
+    model->edgesLength  = state.edgesLength;
+    model->edgeRows     = state.edgeRows;
+    memcpy(model->edgeBucketStart, state.edgeBucketStart, sizeof(state.edgeBucketStart));
+    memcpy(model->edgeBucketRows, state.edgeBucketRows, sizeof(state.edgeBucketRows));
+    CopyArray(model->buffer, captured.buffer);
+    model->bufferSize     = state.bufferSize;
+    model->bufferCapacity = state.bufferSize;
+    CopyArray(model->areas, captured.areas);
+    model->numAreas = state.numAreas;
+    CopyArray(model->edges, captured.edges);
+    model->numEdges = state.numEdges;
+    CopyArray(model->edgeBuffer, captured.edgeBuffer);
+    model->edgeBufferSize     = state.edgeBufferSize;
+    model->edgeBufferCapacity = state.edgeBufferSize;
+
+    // the GL layout of the edges follows the instancing flag
+    if(model->edgeInstancing != state.edgeInstancing)
+        rvx_model_unbind(model);
+    model->edgeInstancing = state.edgeInstancing;
+    model->bound          = 0;
+}
+
+void Replayer::ApplyPopulate(const CapturedPopulate& populate, RVX_MODEL* model)
+{
+    model->params = populate.head.params;
+    if(model->edgeInstancing != populate.head.edgeInstancing)
+        rvx_model_unbind(model);
+    model->edgeInstancing = populate.head.edgeInstancing;
+    CopyArray(model->edges, populate.edges);
+    model->numEdges = (int)populate.edges.size();
+}
+
+void Replayer::Execute(const CapturedCall& call, HeadlessContext& context)
+{
+    m_callCounts[call.type]++;
+    switch(call.type)
+    {
+    case RVX_CAPTURE_RENDERER: {
+        auto captured = Fixed<RVX_CAPTURE_RENDERER_STATE>(call);
+        auto renderer = Renderer(captured.id);
+        if(captured.hasPalette)
+        {
+            Color4 palette[256];
+            for(int c = 0; c < 256; c++)
+                palette[c] = Color4 {(uint8_t)captured.palette[c], (uint8_t)(captured.palette[c] >> 8), (uint8_t)(captured.palette[c] >> 16), (uint8_t)(captured.palette[c] >> 24)};
+            rvx_renderer_set_palette(renderer, palette);
+        }
+        break;
+    }
+    case RVX_CAPTURE_MODEL:
+        ApplyModel(*call.model);
+        break;
+    case RVX_CAPTURE_MODEL_FREE: {
+        int id = Fixed<RVX_CAPTURE_OBJECT>(call).id;
+        if(id > 0 && (size_t)id <= m_models.size() && m_models[id - 1] != nullptr)
+        {
+            rvx_model_unbind(m_models[id - 1]);
+            rvx_model_free(m_models[id - 1]);
+            m_models[id - 1] = nullptr;
+        }
+        break;
+    }
+    case RVX_CAPTURE_POPULATE_BUFFER:
+    case RVX_CAPTURE_POPULATE_SPANS: {
+        const auto& populate = *call.populate;
+        auto        model    = Model(populate.head.model);
+        auto        palette  = const_cast<Color4*>(populate.palette.data());
+        ApplyPopulate(populate, model);
+
+        auto start = Profiler::Now();
+        if(call.type == RVX_CAPTURE_POPULATE_BUFFER)
+            rvx_model_populate_buffer(model, const_cast<Voxel*>(populate.voxels.data()), (int)populate.voxels.size(), palette);
+        else
+            rvx_model_populate_spans(model, populate.rvxSpans.data(), (int)populate.rvxSpans.size(), palette);
+        m_populateTime += (Profiler::Now() - start) / 1e6;
+        break;
+    }
+    case RVX_CAPTURE_COLOR_QUADS:
+        rvx_model_color_quads(Model(Fixed<RVX_CAPTURE_OBJECT>(call).id));
+        break;
+    case RVX_CAPTURE_SWAP_BUFFERS: {
+        auto swap = Fixed<RVX_CAPTURE_SWAP>(call);
+        rvx_model_swap_buffers(Model(swap.model), Model(swap.other));
+        break;
+    }
+    case RVX_CAPTURE_UPLOAD: {
+        auto start = Profiler::Now();
+        rvx_model_upload(Model(Fixed<RVX_CAPTURE_OBJECT>(call).id));
+        m_uploadTime += (Profiler::Now() - start) / 1e6;
+        break;
+    }
+    case RVX_CAPTURE_UNBIND:
+        rvx_model_unbind(Model(Fixed<RVX_CAPTURE_OBJECT>(call).id));
+        break;
+    case RVX_CAPTURE_BIND: {
+        auto draw = Fixed<RVX_CAPTURE_DRAW>(call);
+        rvx_model_bind(Renderer(draw.renderer), Model(draw.model));
+        break;
+    }
+    case RVX_CAPTURE_SET_PALETTE: {
+        auto palette = Fixed<RVX_CAPTURE_PALETTE>(call);
+        rvx_renderer_set_palette(Renderer(palette.renderer), palette.palette);
+        break;
+    }
+    case RVX_CAPTURE_BEGIN: {
+        auto state = Fixed<RVX_CAPTURE_STATE>(call);
+        ApplyState(state);
+        context.Bind();
+        glViewport(state.viewport[0], state.viewport[1], state.viewport[2], state.viewport[3]);
+        glClearColor(0, 0, 0, 1);
+        m_frameStart = Profiler::Now();
+        rvx_renderer_begin(Renderer(state.renderer));
+        break;
+    }
+    case RVX_CAPTURE_END: {
+        auto renderer = Renderer(Fixed<RVX_CAPTURE_OBJECT>(call).id);
+        rvx_renderer_end(renderer);
+        m_cpuTimes.push_back((Profiler::Now() - m_frameStart) / 1e6f);
+        glFinish();
+        m_frameTimes.push_back((Profiler::Now() - m_frameStart) / 1e6f);
+
+        // GPU times of earlier frames come back a few frames later
+        rvx_renderer_stats(renderer, &m_stats);
+        if(m_stats.gpuFrame >= 0 && m_stats.gpuFrame != m_lastGpuFrame)
+            m_gpuTimes.push_back((float)m_stats.gpuFrameTime);
+        m_lastGpuFrame = m_stats.gpuFrame;
+        break;
+    }
+    case RVX_CAPTURE_FLUSH:
+        rvx_renderer_flush(Renderer(Fixed<RVX_CAPTURE_OBJECT>(call).id));
+        break;
+    case RVX_CAPTURE_BEGIN_PASS: {
+        auto pass = Fixed<RVX_CAPTURE_PASS>(call);
+        pass.name[RVX_CAPTURE_NAME_SIZE - 1] = 0;
+        rvx_renderer_begin_pass(Renderer(pass.renderer), pass.pass, pass.name[0] ? pass.name : nullptr);
+        break;
+    }
+    case RVX_CAPTURE_END_PASS:
+        rvx_renderer_end_pass(Renderer(Fixed<RVX_CAPTURE_OBJECT>(call).id));
+        break;
+    case RVX_CAPTURE_VIEW: {
+        auto        state = Fixed<RVX_CAPTURE_STATE>(call);
+        SceneParams params;
+        memcpy(&params, call.fixed.data() + sizeof(RVX_CAPTURE_STATE), std::min(sizeof(params), call.fixed.size() - sizeof(RVX_CAPTURE_STATE)));
+        ApplyState(state);
+        rvx_renderer_view(Renderer(state.renderer), &params);
+        break;
+    }
+    case RVX_CAPTURE_TRANSLATE:
+    case RVX_CAPTURE_AFFINE: {
+        auto t = Fixed<RVX_CAPTURE_TRANSFORM>(call);
+        if(call.type == RVX_CAPTURE_TRANSLATE)
+            rvx_renderer_translate(Renderer(t.renderer), t.delta[0], t.delta[1], t.delta[2]);
+        else
+            rvx_renderer_affine(Renderer(t.renderer), t.delta[0], t.delta[1], t.delta[2], t.scale[0], t.scale[1], t.scale[2], t.shadow);
+        break;
+    }
+    case RVX_CAPTURE_DRAW_INSTANCES: {
+        m_instances.resize(call.instances.size());
+        for(size_t i = 0; i < call.instances.size(); i++)
+        {
+            const auto& captured = call.instances[i];
+            m_instances[i]       = RVX_INSTANCE {Model(captured.model),
+                                           captured.area,
+                                           captured.position[0],
+                                           captured.position[1],
+                                           captured.position[2],
+                                           captured.scale[0],
+                                           captured.scale[1],
+                                           captured.scale[2],
+                                           captured.shadow};
+        }
+        rvx_renderer_draw_instances(Renderer(Fixed<RVX_CAPTURE_OBJECT>(call).id), m_instances.data(), (int)m_instances.size());
+        break;
+    }
+    case RVX_CAPTURE_RENDER:
+    case RVX_CAPTURE_RENDER_EDGES: {
+        auto draw = Fixed<RVX_CAPTURE_DRAW>(call);
+        if(call.type == RVX_CAPTURE_RENDER)
+            rvx_model_render(Renderer(draw.renderer), Model(draw.model), draw.area);
+        else
+            rvx_model_render_edges(Renderer(draw.renderer), Model(draw.model));
+        break;
+    }
+    default:
+        // newer record types are skipped
+        break;
+    }
+}
+
+static const char* CallName(int type)
+{
+    static const char* names[] = {"",         "renderer",   "model",     "model_free", "populate_buffer", "populate_spans",
+                                  "color_quads", "swap_buffers", "upload", "unbind",     "bind",            "set_palette",
+                                  "begin",    "end",        "flush",     "begin_pass", "end_pass",        "view",
+                                  "translate", "affine",    "draw_instances", "render", "render_edges"};
+    return type > 0 && type < (int)(sizeof(names) / sizeof(names[0])) ? names[type] : "unknown";
+}
+
+static void WriteTimes(FILE* out, const char* name, const std::vector<float>& times)
+{
+    auto summary = FrameTimes::From(times);
+    fprintf(out,
+            "\"%s\":{\"frames\":%d,\"min_ms\":%.4f,\"avg_ms\":%.4f,\"p99_ms\":%.4f},\n",
+            name,
+            summary.frames,
+            summary.min,
+            summary.avg,
+            summary.p99);
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        Usage();
+        return 1;
+    }
+
+    int         repeat  = 1;
+    int         width   = 0;
+    int         height  = 0;
+    const char* pngPath = nullptr;
+    const char* outPath = nullptr;
+    for(int a = 2; a < argc; a++)
+    {
+        std::string option = argv[a];
+        const char* value  = a + 1 < argc ? argv[a + 1] : nullptr;
+        bool        parsed = value != nullptr;
+        if(option == "--repeat")
+            parsed = parsed && sscanf(value, "%d", &repeat) == 1 && repeat > 0;
+        else if(option == "--size")
+            parsed = parsed && sscanf(value, "%dx%d", &width, &height) == 2 && width > 0 && height > 0;
+        else if(option == "--png")
+            pngPath = value;
+        else if(option == "--out")
+            outPath = value;
+        else
+            parsed = false;
+
+        if(!parsed)
+        {
+            Usage();
+            return 1;
+        }
+        a++;
+    }
+
+    std::ifstream file(argv[1], std::ios::binary);
+    if(!file)
+    {
+        fprintf(stderr, "rvx-replay: cannot open %s\n", argv[1]);
+        return 1;
+    }
+    std::vector<char>         data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<CapturedCall> calls;
+    std::string               error;
+    if(!ReadCapture(data, calls, error))
+    {
+        fprintf(stderr, "rvx-replay: %s: %s\n", argv[1], error.c_str());
+        return 1;
+    }
+
+    // big enough for every viewport the capture draws into
+    if(width == 0)
+    {
+        for(const auto& call : calls)
+        {
+            if(call.type == RVX_CAPTURE_BEGIN)
+            {
+                auto state = Fixed<RVX_CAPTURE_STATE>(call);
+                width      = std::max(width, state.viewport[0] + state.viewport[2]);
+                height     = std::max(height, state.viewport[1] + state.viewport[3]);
+            }
+        }
+        if(width <= 0 || height <= 0)
+        {
+            fprintf(stderr, "rvx-replay: %s has no frames\n", argv[1]);
+            return 1;
+        }
+    }
+
+    HeadlessContext context;
+    if(!context.Create(width, height))
+    {
+        fprintf(stderr, "rvx-replay: %s\n", context.GetError().c_str());
+        return 1;
+    }
+
+    int status = 0;
+    {
+        Replayer replayer;
+        auto     start = Profiler::Now();
+        for(int r = 0; r < repeat; r++)
+        {
+            for(const auto& call : calls)
+                replayer.Execute(call, context);
+        }
+        glFinish();
+        replayer.DrainTimers();
+        double total = (Profiler::Now() - start) / 1e6;
+        rvx_check_glerror("rvx-replay");
+
+        if(pngPath != nullptr && !context.WritePNG(pngPath))
+        {
+            fprintf(stderr, "rvx-replay: cannot write %s\n", pngPath);
+            status = 1;
+        }
+
+        FILE* out = outPath ? fopen(outPath, "w") : stdout;
+        if(out == nullptr)
+        {
+            fprintf(stderr, "rvx-replay: cannot write %s\n", outPath);
+            return 1;
+        }
+        fprintf(out,
+                "{\"capture\":%s,\"renderer\":%s,\"size\":[%d,%d],\"repeat\":%d,\n",
+                Profiler::Quote(argv[1]).c_str(),
+                Profiler::Quote(context.GetRendererName()).c_str(),
+                width,
+                height,
+                repeat);
+        fprintf(out, "\"total_ms\":%.4f,\"populate_ms\":%.4f,\"upload_ms\":%.4f,\n", total, replayer.m_populateTime, replayer.m_uploadTime);
+        WriteTimes(out, "cpu", replayer.m_cpuTimes);
+        WriteTimes(out, "frame", replayer.m_frameTimes);
+        WriteTimes(out, "gpu", replayer.m_gpuTimes);
+        fprintf(out, "\"last_frame\":{\"draw_calls\":%d,\"triangles\":%d,\"program_switches\":%d,\"vao_binds\":%d},\n",
+                replayer.m_stats.counters.drawCalls,
+                replayer.m_stats.counters.triangles,
+                replayer.m_stats.counters.programSwitches,
+                replayer.m_stats.counters.vaoBinds);
+        fprintf(out, "\"calls\":{");
+        bool first = true;
+        for(const auto& [type, count] : replayer.m_callCounts)
+        {
+            fprintf(out, "%s\"%s\":%d", first ? "" : ",", CallName(type), count / repeat);
+            first = false;
+        }
+        fprintf(out, "}}\n");
+        if(outPath)
+            fclose(out);
+    }
+    context.Destroy();
+    return status;
+}
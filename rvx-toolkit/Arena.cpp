@@ -0,0 +1,90 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#include "Arena.h"
+
+constexpr size_t c_arenaAlignment = 16;
+constexpr size_t c_arenaMinBlock  = 1 << 20;
+
+namespace rvx
+{
+
+Arena::~Arena()
+{
+    for(auto& b : m_blocks)
+        free(b.data);
+}
+
+void* Arena::Alloc(size_t size)
+{
+    size = (size + c_arenaAlignment - 1) & ~(c_arenaAlignment - 1);
+
+    while(m_block < m_blocks.size() && m_offset + size > m_blocks[m_block].size)
+    {
+        m_block++;
+        m_offset = 0;
+    }
+
+    if(m_block == m_blocks.size())
+    {
+        // geometric growth, blocks are merged into one on the next reset
+        size_t blockSize = m_blocks.empty() ? c_arenaMinBlock : m_blocks.back().size * 2;
+        blockSize        = std::max(blockSize, size);
+
+        auto data = (uint8_t*)malloc(blockSize);
+        if(data == nullptr)
+            abort();
+
+        m_blocks.push_back(Block {data, blockSize});
+        m_block  = m_blocks.size() - 1;
+        m_offset = 0;
+    }
+
+    void* ptr = m_blocks[m_block].data + m_offset;
+    m_offset += size;
+    m_live++;
+    return ptr;
+}
+
+void Arena::Free(void* ptr)
+{
+    if(ptr == nullptr)
+        return;
+
+    if(--m_live == 0)
+        Reset();
+}
+
+void Arena::Reset()
+{
+    if(m_blocks.size() > 1)
+    {
+        // coalesce so the next cycle fits in a single block
+        size_t total = Capacity();
+        for(auto& b : m_blocks)
+            free(b.data);
+        m_blocks.clear();
+
+        auto data = (uint8_t*)malloc(total);
+        if(data == nullptr)
+            abort();
+        m_blocks.push_back(Block {data, total});
+    }
+
+    m_block  = 0;
+    m_offset = 0;
+    m_live   = 0;
+}
+
+size_t Arena::Capacity() const
+{
+    size_t total = 0;
+    for(const auto& b : m_blocks)
+        total += b.size;
+    return total;
+}
+
+} // namespace rvx
@@ -0,0 +1,40 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#pragma once
+
+#include "stdafx.h"
+
+namespace rvx
+{
+
+// bump allocator which rewinds itself once every allocation has been freed,
+// memory is kept between uses so steady-state reloads do not touch the heap
+class Arena
+{
+public:
+    ~Arena();
+
+    void* Alloc(size_t size);
+    void  Free(void* ptr);
+    void  Reset();
+
+    size_t Capacity() const;
+
+private:
+    struct Block
+    {
+        uint8_t* data;
+        size_t   size;
+    };
+
+    std::vector<Block> m_blocks;
+    size_t             m_block  = 0; // current block
+    size_t             m_offset = 0; // offset within current block
+    int                m_live   = 0; // allocations not yet freed
+};
+
+} // namespace rvx
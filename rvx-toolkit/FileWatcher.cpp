@@ -0,0 +1,215 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#include "FileWatcher.h"
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+constexpr int c_debounceMs = 30; // quiet time after the last write before the file is read
+constexpr int c_idleMs     = 100; // how often the thread checks for Stop while nothing happens
+constexpr int c_retryMs    = 100; // wait before reading an incomplete file again
+constexpr int c_maxRetries = 50;
+constexpr int c_webPollMs  = 1000; // Update on the web, reads on the UI thread so kept rare
+
+namespace rvx
+{
+
+using WatchClock = std::chrono::steady_clock;
+
+FileWatcher::~FileWatcher()
+{
+    Stop();
+}
+
+void FileWatcher::Start(const std::filesystem::path& path, Callback callback)
+{
+    Stop();
+
+    m_path     = path;
+    m_callback = std::move(callback);
+    m_quit     = false;
+#if defined(PLATFORM_WEB)
+    std::error_code ec;
+    m_lastTime = std::filesystem::last_write_time(m_path, ec);
+    m_lastSize = ec ? 0 : std::filesystem::file_size(m_path, ec);
+    m_nextPoll = WatchClock::now() + std::chrono::milliseconds(c_webPollMs);
+#else
+    m_running = true;
+    m_thread  = std::thread(&FileWatcher::Run, this);
+#endif
+}
+
+void FileWatcher::Stop()
+{
+    RequestStop();
+    if(m_thread.joinable())
+        m_thread.join();
+    m_path.clear();
+}
+
+void FileWatcher::RequestStop()
+{
+    m_quit = true;
+}
+
+bool FileWatcher::IsStopped() const
+{
+    return !m_running;
+}
+
+bool FileWatcher::IsWatching(const std::filesystem::path& path) const
+{
+    return !m_quit && !m_path.empty() && m_path == path;
+}
+
+void FileWatcher::Update()
+{
+#if defined(PLATFORM_WEB)
+    auto now = WatchClock::now();
+    if(m_quit || m_path.empty() || now < m_nextPoll)
+        return;
+
+    m_nextPoll = now + std::chrono::milliseconds(c_webPollMs);
+    if(Poll(0) && !Settle())
+    {
+        // read again on the next poll, the save may not have finished
+        m_lastTime = {};
+        m_lastSize = 0;
+    }
+    m_pending = false;
+#endif
+}
+
+void FileWatcher::Changed(int delayMs)
+{
+    m_pending  = true;
+    m_deadline = WatchClock::now() + std::chrono::milliseconds(delayMs);
+}
+
+bool FileWatcher::Poll(int timeoutMs)
+{
+    bool changed = false;
+#if defined(__linux__)
+    pollfd pfd {m_inotify, POLLIN, 0};
+    if(poll(&pfd, 1, timeoutMs) <= 0)
+        return false;
+
+    alignas(inotify_event) char events[4096];
+    ssize_t                     length;
+    while((length = read(m_inotify, events, sizeof(events))) > 0)
+    {
+        for(char* ptr = events; ptr < events + length;)
+        {
+            auto event = reinterpret_cast<const inotify_event*>(ptr);
+            if(event->len > 0 && m_fileName == event->name)
+                changed = true;
+            ptr += sizeof(inotify_event) + event->len;
+        }
+    }
+#else
+    // no change notifications, compare the file's stamp instead
+    if(timeoutMs > 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(std::min(timeoutMs, c_debounceMs)));
+
+    std::error_code ec;
+    auto            time = std::filesystem::last_write_time(m_path, ec);
+    auto            size = ec ? 0 : std::filesystem::file_size(m_path, ec);
+    if(!ec && (time != m_lastTime || size != m_lastSize))
+    {
+        m_lastTime = time;
+        m_lastSize = size;
+        changed    = true;
+    }
+#endif
+
+    if(changed)
+        Changed(c_debounceMs);
+    return changed;
+}
+
+bool FileWatcher::IsSuperseded()
+{
+    // the write is picked up again once the callback returns
+    return Poll(0) || m_quit;
+}
+
+bool FileWatcher::Settle()
+{
+    // a file still being written changes size while it is read, or fails to parse
+    std::error_code ec;
+    auto            size = std::filesystem::file_size(m_path, ec);
+    if(ec)
+        return false;
+
+    bool accepted = m_callback(m_path);
+    return accepted && std::filesystem::file_size(m_path, ec) == size && !ec;
+}
+
+void FileWatcher::Run()
+{
+    int retries = 0;
+    m_pending   = false;
+
+#if defined(__linux__)
+    // editors may replace the file instead of rewriting it, so the whole directory is watched
+    auto directory = m_path.has_parent_path() ? m_path.parent_path() : std::filesystem::path(".");
+    m_fileName     = m_path.filename().string();
+    m_inotify      = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(m_inotify < 0 || inotify_add_watch(m_inotify, directory.c_str(), IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_CREATE) < 0)
+    {
+        if(m_inotify >= 0)
+            close(m_inotify);
+        m_inotify = -1;
+        m_running = false;
+        return;
+    }
+#else
+    std::error_code ec;
+    m_lastTime = std::filesystem::last_write_time(m_path, ec);
+    m_lastSize = ec ? 0 : std::filesystem::file_size(m_path, ec);
+#endif
+
+    while(!m_quit)
+    {
+        int timeout = c_idleMs;
+        if(m_pending)
+        {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(m_deadline - WatchClock::now()).count();
+            timeout   = (int)std::clamp<long long>(left, 0, c_idleMs);
+        }
+
+        // every write restarts the debounce
+        if(Poll(timeout) || !m_pending || WatchClock::now() < m_deadline)
+            continue;
+
+        m_pending = false;
+        if(Settle())
+        {
+            retries = 0;
+        }
+        else if(++retries < c_maxRetries)
+        {
+            if(!m_pending)
+                Changed(c_retryMs);
+        }
+        else
+        {
+            retries = 0;
+        }
+    }
+
+#if defined(__linux__)
+    close(m_inotify);
+    m_inotify = -1;
+#endif
+    m_running = false;
+}
+
+} // namespace rvx
@@ -0,0 +1,58 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#pragma once
+
+#include "stdafx.h"
+
+namespace rvx
+{
+
+// watches a single file from a background thread and calls back once writes to it have settled,
+// the callback runs on the watcher thread and returns false if the file was still incomplete,
+// the web build has no threads so Update polls the file and calls back on the caller's thread instead
+class FileWatcher
+{
+public:
+    using Callback = std::function<bool(const std::filesystem::path&)>;
+
+    ~FileWatcher();
+    void Start(const std::filesystem::path& path, Callback callback);
+    void Stop(); // waits for the thread, a callback in progress is finished first
+    void RequestStop(); // returns at once, Stop is then instant once IsStopped
+    bool IsStopped() const;
+    bool IsWatching(const std::filesystem::path& path) const;
+    bool IsSuperseded(); // from the callback, true if the file was written again since it was read
+    void Update(); // every frame, web only
+
+private:
+    void Run();
+    bool Poll(int timeoutMs); // waits for writes, true if the file changed
+    bool Settle(); // true once the callback accepted the file
+    void Changed(int delayMs);
+
+    std::filesystem::path m_path;
+    Callback              m_callback;
+    std::thread           m_thread;
+    std::atomic<bool>     m_quit {false};
+    std::atomic<bool>     m_running {false}; // until Run returns
+
+    // watcher thread only
+    bool                                  m_pending = false;
+    std::chrono::steady_clock::time_point m_deadline;
+#if defined(__linux__)
+    int         m_inotify = -1;
+    std::string m_fileName;
+#else
+    std::filesystem::file_time_type m_lastTime;
+    std::uintmax_t                  m_lastSize = 0;
+#endif
+#if defined(PLATFORM_WEB)
+    std::chrono::steady_clock::time_point m_nextPoll;
+#endif
+};
+
+} // namespace rvx
@@ -0,0 +1,164 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#include "Flythrough.h"
+#include "Profiler.h"
+
+#include <cmath>
+
+namespace rvx
+{
+
+// key moves at MOVING_SPEED as in Viewer::Tick, x right, y up, z camera height
+struct FlyMove
+{
+    int   vx;
+    int   vy;
+    int   vz;
+    float seconds;
+};
+
+// pans across, climbs over and dips into the scene, then comes back to where it started
+constexpr FlyMove c_flyPath[] = {
+    {1, 0, 0, 2.0f},
+    {-1, 0, 0, 4.0f},
+    {1, 0, 0, 2.0f},
+    {0, 1, 0, 1.0f},
+    {0, -1, 0, 2.0f},
+    {0, 1, 0, 1.0f},
+    {0, 0, 1, 1.0f},
+    {1, 0, -1, 2.0f},
+    {-1, 0, 1, 1.0f},
+    {-1, 1, 0, 1.0f},
+    {1, -1, 0, 1.0f},
+};
+
+FrameTimes FrameTimes::From(std::vector<float> times)
+{
+    FrameTimes result;
+    if(times.empty())
+        return result;
+
+    std::sort(times.begin(), times.end());
+    result.frames = (int)times.size();
+    result.min    = times.front();
+    result.avg    = std::accumulate(times.begin(), times.end(), 0.0f) / times.size();
+    result.p99    = times[std::min(times.size() - 1, (size_t)std::ceil(times.size() * 0.99) - 1)];
+    return result;
+}
+
+void Flythrough::Start(const Scene& scene)
+{
+    m_start[0] = scene.cam_x;
+    m_start[1] = scene.cam_y;
+    m_start[2] = scene.m_params.TARGET_POS[0];
+    m_start[3] = scene.m_params.TARGET_POS[1];
+    m_start[4] = scene.m_params.CAM_HEIGHT;
+
+    // positions are integrated the same way every run, independent of how long frames take
+    float          speed    = scene.m_params.MOVING_SPEED * c_flyStep;
+    CameraPosition position = {0, 0, 0};
+    m_positions.clear();
+    for(const auto& move : c_flyPath)
+    {
+        for(int s = (int)std::lround(move.seconds / c_flyStep); s > 0; s--)
+        {
+            position.x += move.vx * speed;
+            position.y += move.vy * speed;
+            position.height += move.vz * speed;
+            m_positions.push_back(position);
+        }
+    }
+
+    m_cpuTimes.clear();
+    m_gpuTimes.clear();
+    m_cpuTimes.reserve(m_positions.size());
+    m_gpuTimes.reserve(m_positions.size());
+    m_step         = 0;
+    m_lastGpuFrame = -1;
+    m_running      = true;
+}
+
+void Flythrough::Stop(Scene& scene)
+{
+    scene.cam_x                  = m_start[0];
+    scene.cam_y                  = m_start[1];
+    scene.m_params.TARGET_POS[0] = m_start[2];
+    scene.m_params.TARGET_POS[1] = m_start[3];
+    scene.m_params.CAM_HEIGHT    = m_start[4];
+    m_running                    = false;
+}
+
+bool Flythrough::Advance(Scene& scene, float frameTime, const RVX_STATS& stats)
+{
+    if(!m_running)
+        return false;
+
+    const int positions = (int)m_positions.size();
+    // stats describe the frame just finished, the first path position is rendered by the next one
+    if(m_step == 0)
+        m_firstFrame = stats.frame + 1;
+    else if(m_step <= positions)
+        m_cpuTimes.push_back(frameTime);
+
+    if(stats.gpuFrame != m_lastGpuFrame && stats.gpuFrame >= m_firstFrame && stats.gpuFrame < m_firstFrame + positions)
+        m_gpuTimes.push_back((float)stats.gpuFrameTime);
+    m_lastGpuFrame = stats.gpuFrame;
+
+    // after the path the camera holds still until the GPU times of its last frames are read back
+    bool gpuPending = stats.gpuFrame >= 0 && m_lastGpuFrame < m_firstFrame + positions - 1;
+    if(m_step < positions || (gpuPending && m_step < positions + RVX_TIMER_FRAMES * 2))
+    {
+        const auto& position         = m_positions[std::min(m_step, positions - 1)];
+        scene.cam_x                  = m_start[0] + position.x;
+        scene.cam_y                  = m_start[1] + position.y;
+        scene.m_params.TARGET_POS[0] = m_start[2] + position.x;
+        scene.m_params.TARGET_POS[1] = m_start[3] + position.y;
+        scene.m_params.CAM_HEIGHT    = m_start[4] + position.height;
+        m_step++;
+        return true;
+    }
+
+    m_result.cpu = FrameTimes::From(m_cpuTimes);
+    m_result.gpu = FrameTimes::From(m_gpuTimes);
+    Stop(scene);
+    return false;
+}
+
+static void WriteTimes(FILE* out, const char* name, const FrameTimes& times, const std::vector<float>& frames)
+{
+    fprintf(out,
+            "\"%s\":{\"frames\":%d,\"min_ms\":%.4f,\"avg_ms\":%.4f,\"p99_ms\":%.4f,\"frame_ms\":[",
+            name,
+            times.frames,
+            times.min,
+            times.avg,
+            times.p99);
+    for(size_t f = 0; f < frames.size(); f++)
+        fprintf(out, "%s%.4f", f ? "," : "", frames[f]);
+    fprintf(out, "]}");
+}
+
+bool Flythrough::WriteResult(const std::filesystem::path& path, const std::string& sceneName) const
+{
+    FILE* out = fopen(path.string().c_str(), "w");
+    if(out == nullptr)
+        return false;
+
+    fprintf(out,
+            "{\"scene\":%s,\"step_ms\":%.4f,\"positions\":%d,\n",
+            Profiler::Quote(sceneName).c_str(),
+            c_flyStep * 1000.0f,
+            (int)m_positions.size());
+    WriteTimes(out, "cpu", m_result.cpu, m_cpuTimes);
+    fprintf(out, ",\n");
+    WriteTimes(out, "gpu", m_result.gpu, m_gpuTimes);
+    fprintf(out, "}\n");
+    fclose(out);
+    return true;
+}
+
+} // namespace rvx
@@ -0,0 +1,67 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#pragma once
+
+#include "Scene.h"
+
+namespace rvx
+{
+
+constexpr float c_flyStep = 1.0f / 60.0f; // seconds of camera movement per frame, whatever the frame rate
+
+// min, average and 99th percentile of one kind of frame time, milliseconds
+struct FrameTimes
+{
+    int   frames = 0;
+    float min    = 0;
+    float avg    = 0;
+    float p99    = 0;
+
+    static FrameTimes From(std::vector<float> times);
+};
+
+struct FlythroughResult
+{
+    FrameTimes cpu; // start of one frame to the start of the next
+    FrameTimes gpu; // rvx passes, first to last timestamp
+};
+
+// replays the same camera path at a fixed timestep so frame times of two runs (or scene revisions) are comparable,
+// the path is a script of arrow and page key moves starting from where the camera is
+class Flythrough
+{
+public:
+    void Start(const Scene& scene);
+    void Stop(Scene& scene); // puts the camera back
+    // records the frame just finished and moves the camera for the next one, false once the path is done
+    bool Advance(Scene& scene, float frameTime, const RVX_STATS& stats);
+    bool WriteResult(const std::filesystem::path& path, const std::string& sceneName) const;
+
+    bool                    IsRunning() const { return m_running; }
+    float                   GetProgress() const { return m_positions.empty() ? 0 : std::min(1.0f, (float)m_step / m_positions.size()); }
+    const FlythroughResult& GetResult() const { return m_result; }
+
+private:
+    struct CameraPosition
+    {
+        float x;
+        float y;
+        float height;
+    };
+
+    bool                        m_running      = false;
+    int                         m_step         = 0; // positions applied so far
+    int                         m_firstFrame   = 0; // renderer frame drawn at the first position
+    int                         m_lastGpuFrame = -1;
+    float                       m_start[5]; // cam_x, cam_y, TARGET_POS x and y, CAM_HEIGHT
+    std::vector<CameraPosition> m_positions; // offsets from the start, one per frame
+    std::vector<float>          m_cpuTimes;
+    std::vector<float>          m_gpuTimes;
+    FlythroughResult            m_result;
+};
+
+} // namespace rvx
@@ -14,6 +14,8 @@
 
 #define RENDER_SHADER_PATH_VS "resources/shaders/glsl%i/render.vs"
 #define RENDER_SHADER_PATH_FS "resources/shaders/glsl%i/render.fs"
+#define HEATMAP_SHADER_PATH_FS "resources/shaders/glsl%i/heatmap.fs"
+#define HEATMAP_MAX_COUNT 16.0f // fragments per pixel shown as the hottest color
 
 #define WINDOW_TITLE "RVX Toolkit v1.0"
 #define FULLSCREEN_KEY KEY_F11
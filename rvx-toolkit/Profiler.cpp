@@ -0,0 +1,155 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#include "Profiler.h"
+#include "rvx/rvx.h"
+
+constexpr size_t c_traceRingSize  = 1 << 14; // events kept per thread
+constexpr int    c_traceMaxDepth = 64; // nesting of rvx begin/end pairs
+
+namespace rvx
+{
+
+struct TraceEvent
+{
+    const char* name;
+    uint64_t    start;
+    uint64_t    end;
+};
+
+// written only by its thread, readers use head to skip events overwritten or half written while they copy
+struct TraceRing
+{
+    int                   threadId;
+    std::atomic<uint64_t> head {0};
+    TraceEvent            events[c_traceRingSize];
+    TraceRing*            next;
+};
+
+std::atomic<bool> Profiler::s_enabled {false};
+
+// rings are never freed so the writer never takes a lock, there is one per thread that ever recorded
+static std::atomic<TraceRing*> s_traceRings {nullptr};
+static std::atomic<int>        s_traceThreads {0};
+static thread_local TraceRing* t_traceRing = nullptr;
+
+// open rvx sections of this thread, tracked while disabled too so toggling never unbalances them,
+// sections opened while disabled have no start and are not recorded
+static thread_local uint64_t t_rvxStarts[c_traceMaxDepth];
+static thread_local int      t_rvxDepth = 0;
+
+static TraceRing* GetTraceRing()
+{
+    if(t_traceRing == nullptr)
+    {
+        auto ring      = new TraceRing();
+        ring->threadId = ++s_traceThreads;
+        ring->next     = s_traceRings.load(std::memory_order_relaxed);
+        while(!s_traceRings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)) { }
+        t_traceRing = ring;
+    }
+    return t_traceRing;
+}
+
+static void TraceRvx(const char* name, int begin)
+{
+    if(begin)
+    {
+        if(t_rvxDepth < c_traceMaxDepth)
+            t_rvxStarts[t_rvxDepth] = Profiler::IsEnabled() ? Profiler::Now() : 0;
+        t_rvxDepth++;
+    }
+    else if(t_rvxDepth > 0 && --t_rvxDepth < c_traceMaxDepth && t_rvxStarts[t_rvxDepth] != 0)
+    {
+        Profiler::Record(name, t_rvxStarts[t_rvxDepth], Profiler::Now());
+    }
+}
+
+void Profiler::Install()
+{
+    rvx_set_trace(TraceRvx);
+}
+
+void Profiler::Enable(bool enabled)
+{
+    s_enabled = enabled;
+}
+
+void Profiler::Record(const char* name, uint64_t start, uint64_t end)
+{
+    auto     ring = GetTraceRing();
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+    // pairs with the fence in WriteTrace, a reader that sees part of this event also sees its head
+    std::atomic_thread_fence(std::memory_order_release);
+    ring->events[head % c_traceRingSize] = TraceEvent {name, start, end};
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool Profiler::WriteTrace(const std::filesystem::path& path)
+{
+    FILE* out = fopen(path.string().c_str(), "w");
+    if(out == nullptr)
+        return false;
+
+    std::vector<TraceEvent> events;
+    bool                    first = true;
+    fprintf(out, "{\"traceEvents\":[\n");
+    for(auto ring = s_traceRings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+    {
+        uint64_t head  = ring->head.load(std::memory_order_acquire);
+        uint64_t start = head > c_traceRingSize ? head - c_traceRingSize : 0;
+        events.clear();
+        for(uint64_t e = start; e < head; e++)
+            events.push_back(ring->events[e % c_traceRingSize]);
+
+        // whatever the thread wrote meanwhile may have replaced the oldest events, and the event at
+        // after may be half written over the one a ring size before it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after   = ring->head.load(std::memory_order_relaxed);
+        uint64_t skipped = after + 1 > start + c_traceRingSize ? after + 1 - start - c_traceRingSize : 0;
+
+        for(size_t e = (size_t)std::min<uint64_t>(skipped, events.size()); e < events.size(); e++)
+        {
+            const auto& event = events[e];
+            fprintf(out,
+                    "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    first ? "" : ",\n",
+                    event.name,
+                    ring->threadId,
+                    event.start / 1000.0,
+                    (event.end - event.start) / 1000.0);
+            first = false;
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fclose(out);
+    return true;
+}
+
+std::string Profiler::Quote(const std::string& value)
+{
+    std::string quoted = "\"";
+    for(char c : value)
+    {
+        if(c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if((unsigned char)c < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        }
+        else
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+} // namespace rvx
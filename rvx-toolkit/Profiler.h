@@ -0,0 +1,54 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#pragma once
+
+#include "stdafx.h"
+
+namespace rvx
+{
+
+// scoped CPU timings recorded into a ring per thread, written out as Chrome trace-event JSON,
+// names must be string literals as only the pointer is kept
+class Profiler
+{
+public:
+    static void Install(); // hooks rvx sections, call before any other thread uses rvx
+    static void Enable(bool enabled);
+    static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void Record(const char* name, uint64_t start, uint64_t end);
+    static bool WriteTrace(const std::filesystem::path& path);
+    static std::string Quote(const std::string& value); // JSON string with quotes, backslashes and control characters escaped
+
+    static uint64_t Now() // nanoseconds
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+private:
+    static std::atomic<bool> s_enabled;
+};
+
+class ProfileScope
+{
+public:
+    ProfileScope(const char* name) : m_name(name), m_start(Profiler::IsEnabled() ? Profiler::Now() : 0) { }
+    ~ProfileScope()
+    {
+        if(m_start)
+            Profiler::Record(m_name, m_start, Profiler::Now());
+    }
+
+private:
+    const char* m_name;
+    uint64_t    m_start;
+};
+
+} // namespace rvx
+
+#define RVX_PROFILE_CONCAT2(a, b) a##b
+#define RVX_PROFILE_CONCAT(a, b) RVX_PROFILE_CONCAT2(a, b)
+#define RVX_PROFILE(name) rvx::ProfileScope RVX_PROFILE_CONCAT(_profileScope, __LINE__)(name)
@@ -6,10 +6,13 @@
 
 #include "Renderer.h"
 #include "VOXLoader.h"
+#include "Profiler.h"
 
 #include "include/raylib/rlgl.h"
 #include "include/raylib/raymath.h"
 
+constexpr int c_overdrawInterval = 15; // frames between overdraw readbacks
+
 namespace rvx
 {
 
@@ -17,8 +20,19 @@ Renderer::Renderer(const Scene& scene) : m_scene(scene) { }
 
 void Renderer::Load()
 {
-    m_rvx = rvx_renderer_init(rvx_backend_gl, 0);
+    m_rvx           = rvx_renderer_init(rvx_backend_gl, 0);
+    m_rvx->deferred = 1;
+    rvx_renderer_warm(m_rvx, RVX_SHADER_OVERDRAW); // RenderMode::Overdraw must not compile on its first frame
+#if !defined(PLATFORM_WEB)
+    m_rvx->timing = 1;
+#endif
     Resize();
+
+    m_staging    = rvx_model_new();
+    m_workerQuit = false;
+#if !defined(PLATFORM_WEB)
+    m_worker = std::thread(&Renderer::WorkerLoop, this);
+#endif
 }
 
 void Renderer::Resize()
@@ -37,80 +51,102 @@ void Renderer::Resize()
     }
 }
 
-void Renderer::Unload()
+void Renderer::BeginPass(const char* name)
 {
-    rvx_renderer_free(m_rvx);
-    UnloadRenderTexture(m_renderTexture);
+    rvx_renderer_begin_pass(m_rvx, RVX_PASS_USER, name);
 }
 
-void Renderer::Update()
+void Renderer::EndPass()
 {
-    if(m_rebuildRequired)
-    {
-        Rebuild();
-        return;
-    }
+    rvx_renderer_end_pass(m_rvx);
+}
 
-    glBindVertexArray(m_scene.m_model->VAO);
-    PopulateBuffers();
-    glBindBuffer(GL_ARRAY_BUFFER, m_scene.m_model->VBO);
-    glBufferData(GL_ARRAY_BUFFER, m_scene.m_model->bufferSize, m_scene.m_model->buffer, GL_DYNAMIC_DRAW);
+void Renderer::GetStats(RVX_STATS* stats) const
+{
+    rvx_renderer_stats(m_rvx, stats);
 }
 
-void Renderer::PopulateBuffers()
+void Renderer::GetMemory(RVX_MODEL_MEMORY* memory) const
 {
-    int modelVoxels = 0;
-    for(const auto& ar : m_scene.m_areas)
-    {
-        modelVoxels += ar.m_voxels.size();
-    }
+    rvx_model_memory(m_scene.m_model, memory);
 
-    std::vector<Voxel> voxels;
-    for(const auto& ar : m_scene.m_areas)
+    // staging holds the previous rebuild's CPU buffers for reuse, it is only safe to read while the worker is idle
+    if(!m_rebuilding)
     {
-        std::copy(ar.m_voxels.begin(), ar.m_voxels.end(), std::back_inserter(voxels));
+        RVX_MODEL_MEMORY staging;
+        rvx_model_memory(m_staging, &staging);
+        memory->vertexCapacity += staging.vertexCapacity;
+        memory->edgeCapacity += staging.edgeCapacity;
+        memory->metadataBytes += staging.metadataBytes;
     }
-    memcpy(&m_scene.m_model->params, &m_scene.m_params, sizeof(SceneParams));
+}
 
-    // rebuild edges
-    if(m_scene.m_model->numEdges != m_scene.m_edges.size())
-    {
-        if(m_scene.m_model->edges)
-            free(m_scene.m_model->edges);
+size_t Renderer::GetTargetBytes() const
+{
+    return (size_t)m_renderTexture.texture.width * m_renderTexture.texture.height * (4 /*RGBA8*/ + 4 /*depth*/);
+}
 
-        if(m_scene.m_edges.size())
-            m_scene.m_model->edges = (RVX_EDGE*)malloc(m_scene.m_edges.size() * sizeof(RVX_EDGE));
-        else
-            m_scene.m_model->edges = nullptr;
+void Renderer::SetMode(RenderMode mode)
+{
+    // quad colors are baked into the vertices
+    if((mode == RenderMode::Quads) != (m_mode == RenderMode::Quads))
+        m_rebuildRequired = true;
+    m_mode          = mode;
+    m_overdrawFrame = 0;
+}
 
-        m_scene.m_model->numEdges = m_scene.m_edges.size();
-    }
+int Renderer::GetQuadCount() const
+{
+    int quads = 0;
+    for(int an = 0; an < m_scene.m_model->numAreas; an++)
+        quads += m_scene.m_model->areas[an].len;
+    return quads;
+}
 
-    for(int en = 0; en < m_scene.m_edges.size(); en++)
+void Renderer::Unload()
+{
     {
-        RVX_EDGE*   re       = m_scene.m_model->edges + en;
-        const Edge& se       = m_scene.m_edges[en];
-        re->area_no          = se.area_no;
-        re->edge_dir         = se.edge_dir;
-        re->sx               = se.sx;
-        re->ex               = se.ex;
-        re->sy               = se.sy;
-        re->ey               = se.ey;
-        re->sz               = se.sz;
-        re->ez               = se.ez;
-        re->edge_width       = se.edge_width;
-        re->edge_height      = se.edge_height;
-        re->spacing          = se.spacing;
-        re->top_left_col     = se.top_left_col;
-        re->top_right_col    = se.top_right_col;
-        re->bottom_left_col  = se.bottom_left_col;
-        re->bottom_right_col = se.bottom_right_col;
+        std::lock_guard<std::mutex> lock(m_workerMutex);
+        m_workerQuit = true;
+        m_workerSignal.notify_all();
     }
+    if(m_worker.joinable())
+        m_worker.join();
+    rvx_model_free(m_staging);
+    m_staging    = nullptr;
+    m_rebuilding = false;
+    m_jobPending = false;
+    m_jobDone    = false;
+
+    DeleteBuffers();
+#if !defined(PLATFORM_WEB)
+    if(m_overdrawFence != nullptr)
+        glDeleteSync(m_overdrawFence);
+    if(m_overdrawBuffer != 0)
+        glDeleteBuffers(1, &m_overdrawBuffer);
+    m_overdrawFence  = nullptr;
+    m_overdrawBuffer = 0;
+#endif
+    rvx_renderer_free(m_rvx);
+    UnloadRenderTexture(m_renderTexture);
+}
 
-    rvx_model_populate_buffer(m_scene.m_model,
-                              voxels.data(),
-                              modelVoxels,
-                              reinterpret_cast<Color4*>(const_cast<Color*>(m_scene.m_palette.data())));
+void Renderer::Update()
+{
+    // swapped in by a later Render, a running rebuild is finished first
+    if(m_rebuilding)
+        m_rebuildRequired = true;
+    else
+        StartRebuild();
+}
+
+void Renderer::PopulateBuffers(RVX_MODEL* model, SceneSnapshot& snapshot)
+{
+    RVX_PROFILE("Renderer::PopulateBuffers");
+    auto start = Profiler::Now();
+
+    snapshot.Populate(model);
+    m_stagedPopulateTime = (Profiler::Now() - start) / 1e6f;
 }
 
 void Renderer::DeleteBuffers()
@@ -118,36 +154,87 @@ void Renderer::DeleteBuffers()
     rvx_model_unbind(m_scene.m_model);
 }
 
-void Renderer::Rebuild()
+void Renderer::WorkerLoop()
 {
-    m_rebuildRequired = false;
-    DeleteBuffers();
-
-    int numVoxels = 0;
-    for(const auto& ar : m_scene.m_areas)
+    std::unique_lock<std::mutex> lock(m_workerMutex);
+    while(true)
     {
-        numVoxels += (int)ar.m_voxels.size();
+        m_workerSignal.wait(lock, [this] { return m_jobPending || m_workerQuit; });
+        if(m_workerQuit)
+            return;
+
+        lock.unlock();
+        PopulateBuffers(m_staging, m_snapshot);
+        lock.lock();
+
+        m_jobPending = false;
+        m_jobDone    = true;
+        m_workerSignal.notify_all();
     }
+}
 
-    if(numVoxels == 0)
-        return;
+void Renderer::StartRebuild()
+{
+    RVX_PROFILE("Renderer::StartRebuild");
+    m_rebuildRequired = false;
+    m_rebuilding      = true;
 
-    numVoxels++;
-    int numVertices = numVoxels * 6;
+    // only the snapshot copy happens on the render thread
+    m_snapshot.Capture(m_scene);
+    m_snapshot.m_colorQuads   = m_mode == RenderMode::Quads;
+    m_staging->edgeInstancing = m_scene.m_model->edgeInstancing;
 
-    m_scene.m_model->buffer     = new float[numVertices * 6];
-    m_scene.m_model->bufferSize = numVertices * 6 * sizeof(float);
-    m_scene.m_model->numVoxels  = numVoxels;
+#if defined(PLATFORM_WEB)
+    PopulateBuffers(m_staging, m_snapshot);
+    m_jobDone = true;
+#else
+    std::lock_guard<std::mutex> lock(m_workerMutex);
+    m_jobPending = true;
+    m_workerSignal.notify_all();
+#endif
+}
 
-    PopulateBuffers();
+bool Renderer::FinishRebuild(bool wait)
+{
+    if(!m_rebuilding)
+        return false;
 
-    rvx_model_bind(m_rvx, m_scene.m_model);
+    {
+        std::unique_lock<std::mutex> lock(m_workerMutex);
+        if(wait)
+            m_workerSignal.wait(lock, [this] { return m_jobDone; });
+        if(!m_jobDone)
+            return false;
+        m_jobDone = false;
+    }
+
+    // the worker is idle until the next StartRebuild, staging keeps the old buffers for reuse
+    RVX_PROFILE("Renderer::FinishRebuild");
+    auto start = Profiler::Now();
+    rvx_model_swap_buffers(m_scene.m_model, m_staging);
+    rvx_model_upload(m_scene.m_model);
+    m_rebuilding   = false;
+    m_populateTime = m_stagedPopulateTime;
+    m_areaQuads    = m_snapshot.m_areaQuads;
+    m_uploadTime   = (Profiler::Now() - start) / 1e6f;
+    return true;
+}
+
+void Renderer::Rebuild()
+{
+    FinishRebuild(true);
+    StartRebuild();
+    FinishRebuild(true);
 }
 
 void Renderer::Render()
 {
-    if(m_rebuildRequired)
-        Rebuild();
+    RVX_PROFILE("Renderer::Render");
+
+    // a newer request waits for the running rebuild, the previous vertices are drawn until it is swapped in
+    FinishRebuild(false);
+    if(m_rebuildRequired && !m_rebuilding)
+        StartRebuild();
 
     BeginTextureMode(m_renderTexture);
 
@@ -155,13 +242,86 @@ void Renderer::Render()
     m_rvx->camY = m_scene.cam_y;
 
     glClearColor(0, 0, 0, 1);
+    m_rvx->shaderFlags = m_mode == RenderMode::Overdraw ? RVX_SHADER_OVERDRAW : 0;
     rvx_renderer_begin(m_rvx);
     rvx_renderer_view(m_rvx, const_cast<SceneParams*>(&m_scene.m_params));
     rvx_model_render(m_rvx, m_scene.m_model, 0);
     rvx_model_render_edges(m_rvx, m_scene.m_model);
     rvx_renderer_end(m_rvx);
 
+    if(m_mode == RenderMode::Overdraw)
+        MeasureOverdraw();
+
     EndTextureMode();
 }
 
-} // namespace rvx
\ No newline at end of file
+void Renderer::MeasureOverdraw()
+{
+    RVX_PROFILE("Renderer::MeasureOverdraw");
+
+    // the render texture is still bound, red counts the fragments of each pixel
+    int    width  = m_renderTexture.texture.width;
+    int    height = m_renderTexture.texture.height;
+    size_t size   = (size_t)width * height * 4;
+#if defined(PLATFORM_WEB)
+    // WebGL has no fences to poll, so the rare readback waits for the frame
+    if(m_overdrawFrame++ % c_overdrawInterval == 0)
+    {
+        m_overdrawPixels.resize(size);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, m_overdrawPixels.data());
+        CountOverdraw(m_overdrawPixels.data(), size);
+    }
+#else
+    // the copy lands in a pixel pack buffer and is counted once its fence has passed, so the CPU never waits on the GPU
+    if(m_overdrawFence != nullptr)
+    {
+        GLenum status = glClientWaitSync(m_overdrawFence, 0, 0);
+        if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return;
+
+        glDeleteSync(m_overdrawFence);
+        m_overdrawFence = nullptr;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, m_overdrawBuffer);
+        auto pixels = static_cast<const uint8_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_overdrawSize, GL_MAP_READ_BIT));
+        if(pixels != nullptr)
+        {
+            CountOverdraw(pixels, m_overdrawSize);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    if(m_overdrawFrame++ % c_overdrawInterval != 0)
+        return;
+
+    if(m_overdrawBuffer == 0)
+        glGenBuffers(1, &m_overdrawBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, m_overdrawBuffer);
+    if(size != m_overdrawSize)
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+    m_overdrawSize = size;
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_overdrawFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+}
+
+void Renderer::CountOverdraw(const uint8_t* pixels, size_t size)
+{
+    int64_t fragments = 0;
+    int64_t covered   = 0;
+    int     peak      = 0;
+    for(size_t p = 0; p < size; p += 4)
+    {
+        int count = pixels[p];
+        fragments += count;
+        covered += count > 0;
+        peak = std::max(peak, count);
+    }
+
+    m_overdrawAverage  = covered ? (float)fragments / covered : 0.0f;
+    m_overdrawPeak     = peak;
+    m_overdrawCoverage = size ? (float)covered / (size / 4) : 0.0f;
+}
+
+} // namespace rvx
@@ -6,10 +6,18 @@
 
 #include "Model.h"
 #include "Scene.h"
+#include "SceneSnapshot.h"
 
 namespace rvx
 {
 
+enum class RenderMode
+{
+    Shaded,
+    Overdraw, // fragments per pixel, the viewer shows them as a heatmap
+    Quads // colored by area and quad size
+};
+
 class Renderer
 {
 public:
@@ -17,22 +25,69 @@ public:
     void Load();
     void Render();
 
-    void Update(); // update vertices (params change)
-    void Rebuild(); // rebuild vertices (scene/length change)
+    void Update(); // update vertices (params change) without waiting, swapped in on a later frame
+    void Rebuild(); // rebuild vertices (scene/length change), blocks until uploaded
     void Resize(); // resize viewport
     void Unload();
 
+    // GPU-timed region for work outside rvx, such as the viewer's blit
+    void BeginPass(const char* name);
+    void EndPass();
+
+    void   GetStats(RVX_STATS* stats) const; // GPU times trail the counters by a few frames
+    void   GetMemory(RVX_MODEL_MEMORY* memory) const; // scene model and the staging copy's CPU buffers
+    size_t GetTargetBytes() const; // render texture color and depth
+    int    GetQuadCount() const;
+
+    void       SetMode(RenderMode mode);
+    RenderMode GetMode() const { return m_mode; }
+
     Rectangle       m_renderRect;
     RenderTexture2D m_renderTexture;
     int             m_resolution[2]   = {320 * 8, 168 * 8};
     volatile bool   m_rebuildRequired = false;
 
+    // last swapped-in rebuild, milliseconds
+    float m_populateTime = 0;
+    float m_uploadTime   = 0;
+
+    std::vector<AreaQuads> m_areaQuads; // last swapped-in rebuild
+
+    // RenderMode::Overdraw, read back from the render texture every few frames and a few frames late
+    float m_overdrawAverage  = 0; // fragments per covered pixel
+    int   m_overdrawPeak     = 0;
+    float m_overdrawCoverage = 0; // fraction of pixels drawn at all
+
 private:
     RVX_RENDERER* m_rvx;
-    const Scene& m_scene;
+    const Scene&  m_scene;
+    RenderMode    m_mode = RenderMode::Shaded;
+
+    std::vector<uint8_t> m_overdrawPixels; // web only, it reads back synchronously
+    int                  m_overdrawFrame = 0;
+    GLuint               m_overdrawBuffer = 0; // pixel pack buffer of the readback in flight
+    GLsync               m_overdrawFence  = nullptr;
+    size_t               m_overdrawSize   = 0; // bytes read into m_overdrawBuffer
+
+    // background rebuild, the worker fills m_staging from m_snapshot while the scene model keeps drawing
+    SceneSnapshot           m_snapshot;
+    RVX_MODEL*              m_staging    = nullptr;
+    bool                    m_rebuilding = false; // render thread only
+    bool                    m_jobPending = false;
+    bool                    m_jobDone    = false;
+    bool                    m_workerQuit = false;
+    float                   m_stagedPopulateTime = 0; // written before m_jobDone
+    std::mutex              m_workerMutex;
+    std::condition_variable m_workerSignal;
+    std::thread             m_worker;
 
-    void PopulateBuffers();
+    void StartRebuild();
+    bool FinishRebuild(bool wait);
+    void WorkerLoop();
+    void PopulateBuffers(RVX_MODEL* model, SceneSnapshot& snapshot);
     void DeleteBuffers();
+    void MeasureOverdraw();
+    void CountOverdraw(const uint8_t* pixels, size_t size);
 };
 
 } // namespace rvx
\ No newline at end of file
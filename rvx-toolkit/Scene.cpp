@@ -17,6 +17,86 @@
 namespace rvx
 {
 
+QuadStore::QuadStore() : m_columns(std::make_shared<Columns>()) { }
+
+QuadStore::Columns& QuadStore::Own()
+{
+    if(m_columns.use_count() > 1)
+        m_columns = std::make_shared<Columns>(*m_columns);
+    return *m_columns;
+}
+
+void QuadStore::Clear()
+{
+    // shared arrays are left to their other owners instead of being copied only to be emptied
+    if(m_columns.use_count() > 1)
+    {
+        m_columns = std::make_shared<Columns>();
+        return;
+    }
+
+    m_columns->color.clear();
+    m_columns->sx.clear();
+    m_columns->width.clear();
+    m_columns->sz.clear();
+    m_columns->height.clear();
+    m_columns->rowY.clear();
+    m_columns->rowStart.clear();
+}
+
+void QuadStore::Reserve(size_t quads)
+{
+    Columns& c = Own();
+    c.color.reserve(quads);
+    c.sx.reserve(quads);
+    c.width.reserve(quads);
+    c.sz.reserve(quads);
+    c.height.reserve(quads);
+}
+
+void QuadStore::Add(uint8_t color, int sx, int ex, int y, int sz, int ez)
+{
+    Columns& c = Own();
+    if(c.rowY.empty() || c.rowY.back() != y)
+    {
+        c.rowY.push_back((int16_t)y);
+        c.rowStart.push_back((uint32_t)c.color.size());
+    }
+
+    c.color.push_back(color);
+    c.sx.push_back((int16_t)sx);
+    c.width.push_back((uint16_t)(ex - sx));
+    c.sz.push_back((int16_t)sz);
+    c.height.push_back((uint16_t)(ez - sz));
+}
+
+size_t QuadStore::Size() const
+{
+    return m_columns->color.size();
+}
+
+size_t QuadStore::Bytes() const
+{
+    return m_columns->color.size() * (sizeof(uint8_t) + sizeof(int16_t) * 2 + sizeof(uint16_t) * 2) +
+           m_columns->rowY.size() * (sizeof(int16_t) + sizeof(uint32_t));
+}
+
+RVX_QUADS QuadStore::View() const
+{
+    const Columns& c = *m_columns;
+    RVX_QUADS      quads;
+    quads.numQuads   = (int)c.color.size();
+    quads.colorIndex = c.color.data();
+    quads.sx         = c.sx.data();
+    quads.width      = c.width.data();
+    quads.sz         = c.sz.data();
+    quads.height     = c.height.data();
+    quads.numRows    = (int)c.rowY.size();
+    quads.rowY       = c.rowY.data();
+    quads.rowStart   = c.rowStart.data();
+    return quads;
+}
+
 ViewerScene::ViewerScene()
 {
     m_palette.resize(256);
@@ -200,34 +280,28 @@ std::string ViewerScene::ExportOBJ(const std::string& objName, bool sRGB)
     fprintf(out, "mtllib %s.mtl\n", SceneRoot().c_str());
     for(const auto& a : m_areas)
     {
-        for(const auto& v : a.m_voxels)
-        {
-            VoxelOut(out, v);
-        }
+        a.m_quads.ForEach([out](const Voxel& v) { VoxelOut(out, v); });
     }
 
     int f = 0;
     for(const auto& a : m_areas)
     {
-        for(const auto& v : a.m_voxels)
-        {
-            FaceOut(out, v.colorIndex, f++);
-        }
+        a.m_quads.ForEach([out, &f](const Voxel& v) { FaceOut(out, v.colorIndex, f++); });
     }
     fclose(out);
 
     FILE* mat = fopen((objName + ".mtl").c_str(), "wt");
     for(int c = 1; c < 256; c++)
     {
-        fprintf(out, "newmtl c%d\n", c);
+        fprintf(mat, "newmtl c%d\n", c);
         if(sRGB)
-            fprintf(out,
+            fprintf(mat,
                     "Kd %f %f %f\n",
                     pow(m_palette[c].r / 255.0f, 2.2f),
                     pow(m_palette[c].g / 255.0f, 2.2f),
                     pow(m_palette[c].b / 255.0f, 2.2f));
         else
-            fprintf(out, "Kd %f %f %f\n", m_palette[c].r / 255.0f, m_palette[c].g / 255.0f, m_palette[c].b / 255.0f);
+            fprintf(mat, "Kd %f %f %f\n", m_palette[c].r / 255.0f, m_palette[c].g / 255.0f, m_palette[c].b / 255.0f);
     }
     fclose(mat);
 
@@ -16,15 +16,60 @@ constexpr int c_maxSizeZ = 256;
 namespace rvx
 {
 
+// compact structure-of-arrays quad storage, y is stored once per row of quads, copies share the arrays until one of
+// them is changed so scene snapshots are cheap
+class QuadStore
+{
+public:
+    QuadStore();
+    void      Clear();
+    void      Reserve(size_t quads);
+    void      Add(uint8_t color, int sx, int ex, int y, int sz, int ez);
+    size_t    Size() const;
+    size_t    Bytes() const;
+    RVX_QUADS View() const; // valid while this store or a copy shares the arrays
+
+    template <typename F>
+    void ForEach(F func) const
+    {
+        const Columns& c = *m_columns;
+        for(size_t r = 0; r < c.rowY.size(); r++)
+        {
+            const int16_t  y   = c.rowY[r];
+            const uint32_t end = r + 1 < c.rowStart.size() ? c.rowStart[r + 1] : (uint32_t)c.color.size();
+            for(uint32_t q = c.rowStart[r]; q < end; q++)
+            {
+                func(Voxel(c.color[q], c.sx[q], c.sx[q] + c.width[q], y, c.sz[q], c.sz[q] + c.height[q], 0));
+            }
+        }
+    }
+
+private:
+    struct Columns
+    {
+        std::vector<uint8_t>  color;
+        std::vector<int16_t>  sx;
+        std::vector<uint16_t> width;
+        std::vector<int16_t>  sz;
+        std::vector<uint16_t> height;
+        std::vector<int16_t>  rowY;
+        std::vector<uint32_t> rowStart;
+    };
+
+    std::shared_ptr<Columns> m_columns;
+
+    Columns& Own(); // copies the arrays if a copy of the store still shares them
+};
+
 class Area
 {
 public:
-    int                m_no;
-    std::string        m_name;
-    int                m_sx; // space coords of 0,0
-    int                m_sy;
-    int                m_sz;
-    std::vector<Voxel> m_voxels;
+    int         m_no;
+    std::string m_name;
+    int         m_sx; // space coords of 0,0
+    int         m_sy;
+    int         m_sz;
+    QuadStore   m_quads;
 };
 
 class Edge
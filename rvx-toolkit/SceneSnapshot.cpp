@@ -0,0 +1,90 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#include "SceneSnapshot.h"
+
+namespace rvx
+{
+
+void SceneSnapshot::Capture(const Scene& scene)
+{
+    // areas share their quad arrays with the scene, an area edited later gets its own copy then
+    m_params  = scene.m_params;
+    m_areas   = scene.m_areas;
+    m_edges   = scene.m_edges;
+    m_palette = scene.m_palette;
+}
+
+void SceneSnapshot::Populate(RVX_MODEL* model)
+{
+    // areas are emitted in place, views must outlive the populate call
+    m_quadViews.resize(m_areas.size());
+    m_spans.resize(m_areas.size());
+    for(size_t an = 0; an < m_areas.size(); an++)
+    {
+        m_quadViews[an]     = m_areas[an].m_quads.View();
+        m_spans[an].area_no = m_areas[an].m_no;
+        m_spans[an].voxels  = nullptr;
+        m_spans[an].count   = 0;
+        m_spans[an].quads   = &m_quadViews[an];
+    }
+
+    memcpy(&model->params, &m_params, sizeof(SceneParams));
+
+    // rebuild edges
+    if(model->numEdges != (int)m_edges.size())
+    {
+        if(model->edges)
+            free(model->edges);
+
+        if(m_edges.size())
+            model->edges = (RVX_EDGE*)malloc(m_edges.size() * sizeof(RVX_EDGE));
+        else
+            model->edges = nullptr;
+
+        model->numEdges = (int)m_edges.size();
+    }
+
+    for(size_t en = 0; en < m_edges.size(); en++)
+    {
+        RVX_EDGE*   re       = model->edges + en;
+        const Edge& se       = m_edges[en];
+        re->area_no          = se.area_no;
+        re->edge_dir         = se.edge_dir;
+        re->sx               = se.sx;
+        re->ex               = se.ex;
+        re->sy               = se.sy;
+        re->ey               = se.ey;
+        re->sz               = se.sz;
+        re->ez               = se.ez;
+        re->edge_width       = se.edge_width;
+        re->edge_height      = se.edge_height;
+        re->spacing          = se.spacing;
+        re->top_left_col     = se.top_left_col;
+        re->top_right_col    = se.top_right_col;
+        re->bottom_left_col  = se.bottom_left_col;
+        re->bottom_right_col = se.bottom_right_col;
+    }
+
+    rvx_model_populate_spans(model, m_spans.data(), (int)m_spans.size(), reinterpret_cast<Color4*>(m_palette.data()));
+    if(m_colorQuads)
+        rvx_model_color_quads(model);
+
+    m_areaQuads.resize(m_areas.size());
+    for(size_t an = 0; an < m_areas.size(); an++)
+    {
+        const auto& quads = m_quadViews[an];
+        int64_t     size  = 0;
+        for(int q = 0; q < quads.numQuads; q++)
+            size += (int64_t)(quads.width[q] + 1) * (quads.height[q] + 1);
+
+        m_areaQuads[an].no          = m_areas[an].m_no;
+        m_areaQuads[an].quads       = quads.numQuads;
+        m_areaQuads[an].averageSize = quads.numQuads ? (float)size / quads.numQuads : 0.0f;
+    }
+}
+
+} // namespace rvx
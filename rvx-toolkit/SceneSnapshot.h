@@ -0,0 +1,39 @@
+/*
+    RVX Toolkit
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#pragma once
+
+#include "Scene.h"
+
+namespace rvx
+{
+
+// quads of one scene area, computed with every rebuild
+struct AreaQuads
+{
+    int   no;
+    int   quads;
+    float averageSize; // voxels covered per quad
+};
+
+// everything vertices are built from, kept so the scene can change while a rebuild runs, quads are shared not copied
+class SceneSnapshot
+{
+public:
+    void Capture(const Scene& scene);
+    void Populate(RVX_MODEL* model); // fills the model's CPU buffers and m_areaQuads, no GL calls
+
+    SceneParams            m_params;
+    std::vector<Area>      m_areas;
+    std::vector<Edge>      m_edges;
+    std::vector<Color>     m_palette;
+    std::vector<RVX_QUADS> m_quadViews;
+    std::vector<RVX_SPAN>  m_spans;
+    std::vector<AreaQuads> m_areaQuads;
+    bool                   m_colorQuads = false;
+};
+
+} // namespace rvx
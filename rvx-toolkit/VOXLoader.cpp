@@ -7,10 +7,31 @@
 #define OGT_VOX_IMPLEMENTATION
 
 #include "VOXLoader.h"
+#include "Arena.h"
+#include "Profiler.h"
 
 namespace rvx
 {
 
+// all ogt_vox allocations (parsing, generated boxes, exports) are served from one arena per thread,
+// a scene must be destroyed on the thread that loaded it
+static thread_local Arena s_voxArena;
+
+static void* vox_arena_alloc(size_t size)
+{
+    return s_voxArena.Alloc(size);
+}
+
+static void vox_arena_free(void* ptr)
+{
+    s_voxArena.Free(ptr);
+}
+
+static const bool s_voxArenaInstalled = (ogt_vox_set_memory_allocator(vox_arena_alloc, vox_arena_free), true);
+
+// importer scratch, kept between reloads
+static thread_local std::vector<uint64_t> s_consumedMask;
+
 // a helper function to load a magica voxel scene given a filename.
 const ogt_vox_scene* load_vox_scene(const char* filename, uint32_t scene_read_flags = 0)
 {
@@ -31,15 +52,25 @@ const ogt_vox_scene* load_vox_scene(const char* filename, uint32_t scene_read_fl
     fseek(fp, 0, SEEK_SET);
 
     // load the file into a memory buffer
-    uint8_t* buffer = new uint8_t[buffer_size];
-    fread(buffer, buffer_size, 1, fp);
+    uint8_t* buffer = (uint8_t*)ogt_vox_malloc(buffer_size);
+    size_t   read   = fread(buffer, 1, buffer_size, fp);
     fclose(fp);
 
+    // a file still being written is shorter than its MAIN chunk says, ogt_vox would load it partially
+    uint32_t main_size[2] = {0, 0};
+    if(read >= 20)
+        memcpy(main_size, buffer + 12, sizeof(main_size));
+    if(read != buffer_size || read < 20 || read < 20ull + main_size[0] + main_size[1])
+    {
+        ogt_vox_free(buffer);
+        return NULL;
+    }
+
     // construct the scene from the buffer
     const ogt_vox_scene* scene = ogt_vox_read_scene_with_flags(buffer, buffer_size, scene_read_flags);
 
     // the buffer can be safely deleted once the scene is instantiated.
-    delete[] buffer;
+    ogt_vox_free(buffer);
 
     return scene;
 }
@@ -74,6 +105,7 @@ void save_vox_scene(const char* pcFilename, const ogt_vox_scene* scene)
 
 const ogt_vox_scene* VOXLoader::LoadVOX(const char* fileName, bool retry)
 {
+    RVX_PROFILE("VOXLoader::LoadVOX");
     const ogt_vox_scene* scene = nullptr;
     do
     {
@@ -89,19 +121,52 @@ const ogt_vox_scene* VOXLoader::LoadVOX(const char* fileName, bool retry)
     return scene;
 }
 
-bool VOXLoader::AllVoxelsSameColor(
-    uint8_t* data, int sx, int ex, int y, int z, const ogt_vox_model* model, Matrix* inverse, uint8_t c, const int sizes[3])
+bool VOXLoader::AllVoxelsSameColor(const uint8_t*       data,
+                                   const uint64_t*      consumed,
+                                   int                  sx,
+                                   int                  ex,
+                                   int                  y,
+                                   int                  z,
+                                   const ogt_vox_model* model,
+                                   Matrix*              inverse,
+                                   uint8_t              c,
+                                   const int            sizes[3])
 {
     while(sx <= ex)
-        if(data[GetOffset(sx++, y, z, model, inverse, sizes)] != c)
+        if(GetColor(data, consumed, GetOffset(sx++, y, z, model, inverse, sizes)) != c)
             return false;
     return true;
 }
 
-void VOXLoader::RemoveVoxels(uint8_t* data, int sx, int ex, int y, int z, const ogt_vox_model* model, Matrix* inverse, const int sizes[3])
+void VOXLoader::RemoveVoxels(uint64_t* consumed, int sx, int ex, int y, int z, const ogt_vox_model* model, Matrix* inverse, const int sizes[3])
 {
     while(sx <= ex)
-        data[GetOffset(sx++, y, z, model, inverse, sizes)] = 0;
+    {
+        const int off = GetOffset(sx++, y, z, model, inverse, sizes);
+        consumed[off >> 6] |= 1ull << (off & 63);
+    }
+}
+
+int VOXLoader::CountRuns(const ogt_vox_model* model, bool optimize)
+{
+    // upper bound of quads for unrotated models, good enough as a reserve hint otherwise
+    const uint8_t* data  = model->voxel_data;
+    const int      count = model->size_x * model->size_y * model->size_z;
+    int            runs  = 0;
+    for(int i = 0; i < count; i++)
+    {
+        if(data[i] != 0 && (!optimize || i % model->size_x == 0 || data[i - 1] != data[i]))
+            runs++;
+    }
+    return runs;
+}
+
+uint8_t VOXLoader::GetColor(const uint8_t* data, const uint64_t* consumed, int offset)
+{
+    // merged voxels are flagged in the consumed mask instead of being zeroed in a copy of the model
+    if((consumed[offset >> 6] >> (offset & 63)) & 1)
+        return 0;
+    return data[offset];
 }
 
 int VOXLoader::GetOffset(int x, int y, int z, const ogt_vox_model* model, Matrix* inverse, const int sizes[3])
@@ -137,8 +202,25 @@ void VOXLoader::Transform(int& x, int& y, int& z, Matrix* transform)
     z       = (int)tv.z;
 }
 
-void VOXLoader::ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize)
+void ImportProgress::Begin(int instances)
+{
+    m_instance  = 0;
+    m_instances = instances;
+    m_slice     = 0;
+    m_slices    = 0;
+}
+
+bool ImportProgress::IsCancelled() const
+{
+    return m_cancel || (m_superseded && m_superseded());
+}
+
+bool VOXLoader::ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize, ImportProgress* progress)
 {
+    RVX_PROFILE("VOXLoader::ImportVOX");
+    if(progress)
+        progress->Begin(vox->num_instances);
+
     scene.m_palette.clear();
     scene.m_palette.resize(256);
     for(int i = 0; i < 256; i++)
@@ -152,16 +234,20 @@ void VOXLoader::ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize)
 
     int an = 100; // automatic number, if not present
     int en = 0;
-    scene.m_areas.clear();
+
+    // areas of a previous import are reused so their quad arrays keep their capacity
+    scene.m_areas.resize(vox->num_instances);
     scene.m_edges.clear();
     for(uint32_t ii = 0; ii < vox->num_instances; ii++)
     {
-        auto&       area          = scene.m_areas.emplace_back();
+        auto&       area          = scene.m_areas[ii];
         const auto& instance      = vox->instances[ii];
         const auto& model         = vox->models[instance.model_index];
         const auto& ogt_transform = vox->instances[ii].transform;
 
         area.m_no = an++;
+        area.m_name.clear();
+        area.m_quads.Clear();
         if(instance.name != NULL)
         {
             area.m_name = instance.name;
@@ -219,23 +305,42 @@ void VOXLoader::ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize)
         const int dy = -(int)space_size_y / 2 + (int)ogt_transform.m31;
         const int dz = -(int)space_size_z / 2 + (int)ogt_transform.m32;
 
-        // copy in case the are instanced and we modify them
-        uint8_t* voxel_copy = (uint8_t*)malloc(space_size_x * space_size_y * space_size_z);
-        memcpy(voxel_copy, model->voxel_data, space_size_x * space_size_y * space_size_z);
+        // colors are read from the model directly, models can be instanced so merged voxels are only flagged
+        const uint8_t* voxel_data = model->voxel_data;
+        s_consumedMask.assign((space_size_x * space_size_y * space_size_z + 63) / 64, 0);
+        uint64_t* consumed = s_consumedMask.data();
+
+        area.m_quads.Reserve(CountRuns(model, optimize));
 
         // space coords of 0,0,0
         area.m_sx = dx;
         area.m_sy = dy;
         area.m_sz = dz;
 
+        if(progress)
+        {
+            progress->m_slice  = 0;
+            progress->m_slices = space_size_y;
+        }
+
         for(int y = 0; y < space_size_y; y++)
         {
+            if(progress)
+            {
+                if(progress->IsCancelled())
+                {
+                    scene.m_areas.resize(ii);
+                    return false;
+                }
+                progress->m_slice = y;
+            }
+
             for(int z = 0; z < space_size_z; z++)
             {
                 for(int x = 0; x < space_size_x; x++)
                 {
                     const int  off = GetOffset(x, y, z, model, inversep, sizes);
-                    const auto c   = voxel_copy[off];
+                    const auto c   = GetColor(voxel_data, consumed, off);
                     if(c == 0)
                         continue;
 
@@ -251,44 +356,44 @@ void VOXLoader::ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize)
                         Edge e;
 
                         // find x/y/z dimensions of the edge
-                        while(x < space_size_x - 1 && voxel_copy[GetOffset(x + 1, y, z, model, inversep, sizes)] == c)
+                        while(x < space_size_x - 1 && GetColor(voxel_data, consumed, GetOffset(x + 1, y, z, model, inversep, sizes)) == c)
                         {
                             x++;
                         }
 
                         // find ez
-                        while(ez < space_size_z - 1 && AllVoxelsSameColor(voxel_copy, sx, x, y, ez + 1, model, inversep, c, sizes))
+                        while(ez < space_size_z - 1 && AllVoxelsSameColor(voxel_data, consumed, sx, x, y, ez + 1, model, inversep, c, sizes))
                         {
                             // fill in with zeros so we don't redraw later
-                            //RemoveVoxels(voxel_copy, sx, x, y, ez + 1, model, inversep, sizes);
+                            //RemoveVoxels(consumed, sx, x, y, ez + 1, model, inversep, sizes);
                             ez++;
                         }
 
                         // find spacing
                         int spacing = 1;
-                        while(voxel_copy[GetOffset(x, y + 1 + spacing, ez, model, inversep, sizes)] == 0)
+                        while(GetColor(voxel_data, consumed, GetOffset(x, y + 1 + spacing, ez, model, inversep, sizes)) == 0)
                         {
                             spacing++;
                         }
 
                         // take colors from next (y+1) plane
-                        e.top_left_col     = voxel_copy[GetOffset(sx, y + 1, ez, model, inversep, sizes)];
-                        e.top_right_col    = voxel_copy[GetOffset(x, y + 1, ez, model, inversep, sizes)];
-                        e.bottom_left_col  = voxel_copy[GetOffset(sx, y + 1, sz, model, inversep, sizes)];
-                        e.bottom_right_col = voxel_copy[GetOffset(x, y + 1, sz, model, inversep, sizes)];
+                        e.top_left_col     = GetColor(voxel_data, consumed, GetOffset(sx, y + 1, ez, model, inversep, sizes));
+                        e.top_right_col    = GetColor(voxel_data, consumed, GetOffset(x, y + 1, ez, model, inversep, sizes));
+                        e.bottom_left_col  = GetColor(voxel_data, consumed, GetOffset(sx, y + 1, sz, model, inversep, sizes));
+                        e.bottom_right_col = GetColor(voxel_data, consumed, GetOffset(x, y + 1, sz, model, inversep, sizes));
 
                         // find edge_width
                         int width = 0;
                         if(c == RVX_EDGE_L)
                         {
-                            while(voxel_copy[GetOffset(sx + width, y + 1, ez, model, inversep, sizes)] == e.top_left_col)
+                            while(GetColor(voxel_data, consumed, GetOffset(sx + width, y + 1, ez, model, inversep, sizes)) == e.top_left_col)
                             {
                                 width++;
                             }
                         }
                         else if(c == RVX_EDGE_R)
                         {
-                            while(voxel_copy[GetOffset(x - width, y + 1, ez, model, inversep, sizes)] == e.top_right_col)
+                            while(GetColor(voxel_data, consumed, GetOffset(x - width, y + 1, ez, model, inversep, sizes)) == e.top_right_col)
                             {
                                 width++;
                             }
@@ -303,14 +408,14 @@ void VOXLoader::ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize)
                         int height = 0;
                         if(c == RVX_EDGE_L)
                         {
-                            while(voxel_copy[GetOffset(sx, y + 1, ez - height, model, inversep, sizes)] == e.top_left_col)
+                            while(GetColor(voxel_data, consumed, GetOffset(sx, y + 1, ez - height, model, inversep, sizes)) == e.top_left_col)
                             {
                                 height++;
                             }
                         }
                         else if(c == RVX_EDGE_R)
                         {
-                            while(voxel_copy[GetOffset(x, y + 1, ez - height, model, inversep, sizes)] == e.top_right_col)
+                            while(GetColor(voxel_data, consumed, GetOffset(x, y + 1, ez - height, model, inversep, sizes)) == e.top_right_col)
                             {
                                 height++;
                             }
@@ -319,7 +424,7 @@ void VOXLoader::ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize)
                         // we have sx/ex/sz/ez
                         // now find the other edge
                         int ey = y + 1;
-                        while(voxel_copy[GetOffset(sx, ey, sz, model, inversep, sizes)] != c)
+                        while(GetColor(voxel_data, consumed, GetOffset(sx, ey, sz, model, inversep, sizes)) != c)
                         {
                             ey++;
                         }
@@ -346,7 +451,7 @@ void VOXLoader::ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize)
                             int rz = sz;
                             while(rz <= ez)
                             {
-                                RemoveVoxels(voxel_copy, sx, x, ry, rz, model, inversep, sizes);
+                                RemoveVoxels(consumed, sx, x, ry, rz, model, inversep, sizes);
                                 rz++;
                             }
                             ry++;
@@ -358,31 +463,38 @@ void VOXLoader::ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize)
                     if(optimize)
                     {
                         // see how far we can draw on X axis (line)
-                        while(x < space_size_x - 1 && voxel_copy[GetOffset(x + 1, y, z, model, inversep, sizes)] == c)
+                        while(x < space_size_x - 1 && GetColor(voxel_data, consumed, GetOffset(x + 1, y, z, model, inversep, sizes)) == c)
                         {
                             x++;
                         }
                         // see if we can also extend Z axis (rectangle)
-                        while(ez < space_size_z - 1 && AllVoxelsSameColor(voxel_copy, sx, x, y, ez + 1, model, inversep, c, sizes))
+                        while(ez < space_size_z - 1 && AllVoxelsSameColor(voxel_data, consumed, sx, x, y, ez + 1, model, inversep, c, sizes))
                         {
                             // fill in with zeros so we don't redraw later
-                            RemoveVoxels(voxel_copy, sx, x, y, ez + 1, model, inversep, sizes);
+                            RemoveVoxels(consumed, sx, x, y, ez + 1, model, inversep, sizes);
                             ez++;
                         }
                     }
 
-                    const int    _sx = sx + dx;
-                    const int    _ex = x + dx;
-                    const int    _y  = y + dy;
-                    const int    _sz = sz + dz;
-                    const int    _ez = ez + dz;
-                    const int8_t ext = 0;
-                    area.m_voxels.emplace_back(Voxel(c, (int16_t)_sx, (int16_t)_ex, (int16_t)_y, (int16_t)_sz, (int16_t)_ez, ext));
+                    const int _sx = sx + dx;
+                    const int _ex = x + dx;
+                    const int _y  = y + dy;
+                    const int _sz = sz + dz;
+                    const int _ez = ez + dz;
+                    area.m_quads.Add(c, _sx, _ex, _y, _sz, _ez);
                 }
             }
         }
-        free(voxel_copy);
+
+        if(progress)
+        {
+            progress->m_slice    = space_size_y;
+            progress->m_instance = ii + 1;
+            if(progress->m_areaFinished)
+                progress->m_areaFinished(scene, ii);
+        }
     }
+    return true;
 }
 
 struct scene_dim
@@ -397,6 +509,7 @@ struct scene_dim
 
 const ogt_vox_scene* VOXLoader::GenerateBox(int x, int y, int z, bool roof, int margin)
 {
+    RVX_PROFILE("VOXLoader::GenerateBox");
     auto  vox       = const_cast<ogt_vox_scene*>(LoadVOX("resources/box.vox", false));
     auto& instance  = vox->instances[0];
     auto& model     = vox->models[instance.model_index];
@@ -706,11 +819,14 @@ const ogt_vox_scene* VOXLoader::GenerateBox(int x, int y, int z, bool roof, int
     for(uint32_t color_index = 0; color_index < 256; color_index++)
         merged_scene->palette.color[color_index] = vox->palette.color[color_index];
 
+    ogt_vox_destroy_scene(vox);
+
     return merged_scene;
 }
 
 void VOXLoader::ExportVOX(const ogt_vox_scene* vox, const char* fileName)
 {
+    RVX_PROFILE("VOXLoader::ExportVOX");
     save_vox_scene(fileName, vox);
 }
 
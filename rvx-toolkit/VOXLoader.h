@@ -13,21 +13,49 @@
 namespace rvx
 {
 
+// progress of an import running on another thread, and its hooks back into the caller
+class ImportProgress
+{
+public:
+    void Begin(int instances);
+    bool IsCancelled() const;
+
+    std::atomic<int>  m_instance {0}; // instances finished
+    std::atomic<int>  m_instances {0};
+    std::atomic<int>  m_slice {0}; // y slices of the current instance finished
+    std::atomic<int>  m_slices {0};
+    std::atomic<bool> m_cancel {false}; // set by the owner to stop at the next slice
+
+    std::function<bool()>                     m_superseded; // polled every slice, cancels when true
+    std::function<void(const Scene&, size_t)> m_areaFinished; // called on the importing thread with the area index
+};
+
 class VOXLoader
 {
 public:
-    static void                 ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize);
+    // returns false if the import was cancelled, the scene then holds the areas finished so far
+    static bool                 ImportVOX(const ogt_vox_scene* vox, Scene& scene, bool optimize, ImportProgress* progress = nullptr);
     static const ogt_vox_scene* LoadVOX(const char* fileName, bool retry);
     static void                 ExportVOX(const ogt_vox_scene* vox, const char* fileName);
     static const ogt_vox_scene* GenerateBox(int x, int y, int z, bool roof, int margin);
     static std::vector<Vector2> GenerateRoomSlices(int fw, int fh, int nw, int nh, int d);
 
 private:
-    static bool AllVoxelsSameColor(
-        uint8_t* data, int sx, int ex, int y, int z, const ogt_vox_model* model, Matrix* inverse, uint8_t c, const int sizes[3]);
-    static void RemoveVoxels(uint8_t* data, int sx, int ex, int y, int z, const ogt_vox_model* model, Matrix* inverse, const int sizes[3]);
-    static int  GetOffset(int x, int y, int z, const ogt_vox_model* model, Matrix* inverse, const int sizes[3]);
-    static void Transform(int& x, int& y, int& z, Matrix* transform);
+    static bool    AllVoxelsSameColor(const uint8_t*       data,
+                                      const uint64_t*      consumed,
+                                      int                  sx,
+                                      int                  ex,
+                                      int                  y,
+                                      int                  z,
+                                      const ogt_vox_model* model,
+                                      Matrix*              inverse,
+                                      uint8_t              c,
+                                      const int            sizes[3]);
+    static void    RemoveVoxels(uint64_t* consumed, int sx, int ex, int y, int z, const ogt_vox_model* model, Matrix* inverse, const int sizes[3]);
+    static int     CountRuns(const ogt_vox_model* model, bool optimize);
+    static uint8_t GetColor(const uint8_t* data, const uint64_t* consumed, int offset);
+    static int     GetOffset(int x, int y, int z, const ogt_vox_model* model, Matrix* inverse, const int sizes[3]);
+    static void    Transform(int& x, int& y, int& z, Matrix* transform);
 };
 
 } // namespace rvx
\ No newline at end of file
@@ -6,6 +6,7 @@
 
 #include "Viewer.h"
 #include "VOXLoader.h"
+#include "Profiler.h"
 #include "include/raylib/rlgl.h"
 #include "include/nfd/nfd.h"
 
@@ -20,40 +21,54 @@ void Viewer::Load()
 {
     m_scene.m_updated = &m_renderer.m_rebuildRequired;
 
+    Profiler::Install();
     m_renderer.Load();
     m_scene.Resize();
     Reset();
+
+    m_heatmap      = LoadShader(0, TextFormat(HEATMAP_SHADER_PATH_FS, GLSL_VERSION));
+    float maxCount = HEATMAP_MAX_COUNT;
+    SetShaderValue(m_heatmap, GetShaderLocation(m_heatmap, "maxCount"), &maxCount, SHADER_UNIFORM_FLOAT);
 }
 
 void Viewer::Unload()
 {
+    StopReload();
+    UnloadShader(m_heatmap);
     m_renderer.Unload();
 }
 
 void Viewer::Tick(float deltaTime, float totalTime)
 {
+    RVX_PROFILE("Viewer::Tick");
+    auto start = Profiler::Now();
     _totalTime += deltaTime;
 
     m_frameCounter++;
     m_mouseX = GetMouseX();
     m_mouseY = GetMouseY();
 
-    bool secondPassed = false;
-    auto second       = (long)totalTime;
-    if(second != m_lastSecond)
-    {
-        m_lastSecond = second;
-        secondPassed = true;
-    }
-
     if(IsKeyPressed(KEY_TAB))
     {
         m_guiVisible = !m_guiVisible;
     }
 
-    if(m_autoReload && secondPassed)
+    CheckSceneReload();
+
+    // scripted camera, keys are ignored until it finishes
+    if(m_flythrough.IsRunning())
     {
-        CheckSceneReload();
+        RVX_STATS stats;
+        m_renderer.GetStats(&stats);
+        if(!m_flythrough.Advance(m_scene, deltaTime * 1000.0f, stats))
+        {
+            m_flyResults[1] = m_flyResults[0];
+            m_flyResults[0] = m_flythrough.GetResult();
+            m_flyRuns++;
+            m_uncapped = false;
+        }
+        m_tickTime = (Profiler::Now() - start) / 1e6f;
+        return;
     }
 
     int vx = 0;
@@ -82,6 +97,7 @@ void Viewer::Tick(float deltaTime, float totalTime)
     m_scene.m_params.TARGET_POS[1] += dy;
     m_scene.cam_x += dx;
     m_scene.cam_y += dy;
+    m_tickTime = (Profiler::Now() - start) / 1e6f;
 }
 
 void Viewer::RecalculateTarget(Rectangle viewportRect)
@@ -110,26 +126,39 @@ void Viewer::Draw(Rectangle viewportRect, bool viewportResized)
     m_windowResized = false;
     m_renderResized = false;
 
+    auto renderStart = Profiler::Now();
     m_renderer.Render();
+    auto blitStart = Profiler::Now();
+    m_renderTime   = (blitStart - renderStart) / 1e6f;
 
     // resized window
     if(viewportResized)
         RecalculateTarget(viewportRect);
 
-    ClearBackground(DARKGRAY);
-    DrawTexturePro(m_renderer.m_renderTexture.texture, m_renderer.m_renderRect, m_targetRect, Vector2(), 0, WHITE);
-
-    if(m_overlay.id)
-        DrawTexturePro(m_overlay,
-                       Rectangle {0, 0, (float)m_overlay.width, (float)m_overlay.height},
-                       Rectangle {m_targetRect.x,
-                                  m_targetRect.y,
-                                  m_targetRect.width,
-                                  m_targetRect.width * (float)m_overlay.height / (float)m_overlay.width}, // retain ratio
-                       Vector2(),
-                       0,
-                       Color {255, 127, 127, 127});
-    rlDrawRenderBatchActive();
+    {
+        RVX_PROFILE("Viewer::Blit");
+        m_renderer.BeginPass("viewer blit");
+        ClearBackground(DARKGRAY);
+        bool heatmap = m_renderer.GetMode() == RenderMode::Overdraw;
+        if(heatmap)
+            BeginShaderMode(m_heatmap);
+        DrawTexturePro(m_renderer.m_renderTexture.texture, m_renderer.m_renderRect, m_targetRect, Vector2(), 0, WHITE);
+        if(heatmap)
+            EndShaderMode();
+
+        if(m_overlay.id)
+            DrawTexturePro(m_overlay,
+                           Rectangle {0, 0, (float)m_overlay.width, (float)m_overlay.height},
+                           Rectangle {m_targetRect.x,
+                                      m_targetRect.y,
+                                      m_targetRect.width,
+                                      m_targetRect.width * (float)m_overlay.height / (float)m_overlay.width}, // retain ratio
+                           Vector2(),
+                           0,
+                           Color {255, 127, 127, 127});
+        rlDrawRenderBatchActive();
+        m_renderer.EndPass();
+    }
 
     if(m_screenshot.size())
     {
@@ -139,7 +168,12 @@ void Viewer::Draw(Rectangle viewportRect, bool viewportResized)
         m_screenshot.clear();
     }
 
+    auto uiStart = Profiler::Now();
+    m_blitTime   = (uiStart - blitStart) / 1e6f;
     DrawUI();
+    m_uiTime = (Profiler::Now() - uiStart) / 1e6f;
+
+    RecordFrame();
 };
 
 static void HelpMarker(const char* desc)
@@ -170,6 +204,7 @@ void Viewer::DrawUI()
     if(!m_guiVisible)
         return;
 
+    RVX_PROFILE("Viewer::DrawUI");
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -294,6 +329,17 @@ void Viewer::DrawUI()
                 ImGui::SameLine();
                 HelpMarker("Monitor .vox file for changes");
 
+                if(m_reloading)
+                {
+                    int   instances = m_reloadProgress.m_instances;
+                    int   instance  = m_reloadProgress.m_instance;
+                    int   slices    = m_reloadProgress.m_slices;
+                    float fraction  = slices ? (float)m_reloadProgress.m_slice / slices : 0.0f;
+                    char  label[64];
+                    snprintf(label, sizeof(label), "Instance %d/%d", std::min(instance + 1, instances), instances);
+                    ImGui::ProgressBar(instances ? (instance + fraction) / instances : 0.0f, ImVec2(-1.0f, 0.0f), label);
+                }
+
                 if(ImGui::Button("Regenerate VOX"))
                     ImGui::OpenPopup("Regenerate VOX?");
 
@@ -449,6 +495,13 @@ void Viewer::DrawUI()
                 std::to_string(m_renderer.m_resolution[0] / gcd) + ":" + std::to_string(m_renderer.m_resolution[1] / gcd);
             ImGui::InputText("Aspect Ratio", &aspectRatio, ImGuiInputTextFlags_ReadOnly);
 
+            int mode = (int)m_renderer.GetMode();
+            if(ImGui::Combo("Mode", &mode, "Shaded\0Overdraw\0Quads\0"))
+                m_renderer.SetMode((RenderMode)mode);
+            ImGui::SameLine();
+            HelpMarker("Overdraw counts fragments per pixel, blue is one\r\nlayer and red 16 or more. Quads colors each area\r\nin its own hue, brighter for larger quads");
+            DrawModeSummary();
+
             ImGui::TextUnformatted("Scale Window");
             if(ImGui::Button("200%"))
             {
@@ -469,6 +522,59 @@ void Viewer::DrawUI()
             }
             ImGui::TreePop();
         }
+
+        if(ImGui::TreeNode("Performance"))
+        {
+            DrawPerformance();
+            ImGui::Separator();
+            DrawFlythrough();
+            ImGui::Separator();
+
+#if !defined(PLATFORM_WEB)
+            if(ImGui::Checkbox("Record trace", &m_tracing))
+                Profiler::Enable(m_tracing);
+            ImGui::SameLine();
+            if(ImGui::Button("Save trace..."))
+            {
+                nfdchar_t* outPath = NULL;
+                m_dialogPaused     = true;
+                if(NFD_SaveDialog("json", NULL, &outPath) == NFD_OKAY)
+                {
+                    std::filesystem::path tracePath(outPath);
+                    if(tracePath.extension().empty())
+                        tracePath.replace_extension(".json");
+                    Profiler::WriteTrace(tracePath);
+                }
+            }
+            ImGui::SameLine();
+            HelpMarker("Record CPU timings of loading, rebuilding and\r\nrendering, open saved traces in chrome://tracing");
+
+            if(rvx_capture_active())
+            {
+                if(ImGui::Button("Stop capture"))
+                    rvx_capture_end();
+            }
+            else if(ImGui::Button("Capture frames..."))
+            {
+                nfdchar_t* outPath = NULL;
+                m_dialogPaused     = true;
+                if(NFD_SaveDialog("rvxc", NULL, &outPath) == NFD_OKAY)
+                {
+                    std::filesystem::path capturePath(outPath);
+                    if(capturePath.extension().empty())
+                        capturePath.replace_extension(".rvxc");
+                    rvx_capture_begin(capturePath.string().c_str(), m_captureFrames);
+                }
+            }
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(80);
+            ImGui::InputInt("frames", &m_captureFrames);
+            m_captureFrames = std::clamp(m_captureFrames, 1, 3600);
+            ImGui::SameLine();
+            HelpMarker("Record rvx calls and the data given to them,\r\nreplay offscreen with rvx-headless/rvx-replay");
+#endif
+            ImGui::TreePop();
+        }
     }
 
     if(ImGui::TreeNode("Help"))
@@ -493,29 +599,308 @@ void Viewer::DrawUI()
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+void Viewer::DrawModeSummary()
+{
+    if(m_renderer.GetMode() == RenderMode::Overdraw)
+    {
+        ImGui::Text("Overdraw average %.2f, peak %d", m_renderer.m_overdrawAverage, m_renderer.m_overdrawPeak);
+        ImGui::Text("Covered %.1f%% of pixels", m_renderer.m_overdrawCoverage * 100.0f);
+    }
+    else if(m_renderer.GetMode() == RenderMode::Quads)
+    {
+        // costliest areas first
+        auto areas = m_renderer.m_areaQuads;
+        std::sort(areas.begin(), areas.end(), [](const AreaQuads& a, const AreaQuads& b) { return a.quads > b.quads; });
+
+        int quads = 0;
+        for(const auto& area : areas)
+            quads += area.quads;
+        ImGui::Text("%d quads in %d areas, %.1f per area", quads, (int)areas.size(), areas.size() ? (float)quads / areas.size() : 0.0f);
+
+        if(ImGui::BeginTable("Areas", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_ScrollY, ImVec2(0, 160.0f)))
+        {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Area");
+            ImGui::TableSetupColumn("Quads");
+            ImGui::TableSetupColumn("Voxels/quad");
+            ImGui::TableHeadersRow();
+            for(const auto& area : areas)
+            {
+                ImGui::TableNextColumn();
+                ImGui::Text("%d", area.no);
+                ImGui::TableNextColumn();
+                ImGui::Text("%d", area.quads);
+                ImGui::TableNextColumn();
+                ImGui::Text("%.1f", area.averageSize);
+            }
+            ImGui::EndTable();
+        }
+    }
+}
+
+void Viewer::RecordFrame()
+{
+    RVX_STATS stats;
+    m_renderer.GetStats(&stats);
+
+    // GPU times arrive a few frames late, they fill the slot of the frame they were measured in
+    int slot           = m_perfFrame % c_perfHistory;
+    m_cpuHistory[slot] = m_tickTime + m_renderTime + m_blitTime + m_uiTime;
+    if(stats.gpuFrame >= 0 && m_perfFrame - (stats.frame - stats.gpuFrame) >= 0)
+        m_gpuHistory[(m_perfFrame - (stats.frame - stats.gpuFrame)) % c_perfHistory] = (float)stats.gpuFrameTime;
+    m_perfFrame++;
+}
+
+static void PlotHistory(const char* label, const float* values, int offset)
+{
+    float maxTime = 1000.0f / 60.0f;
+    for(int i = 0; i < c_perfHistory; i++)
+        maxTime = std::max(maxTime, values[i]);
+
+    char overlay[32];
+    snprintf(overlay, sizeof(overlay), "%.2f ms", values[(offset + c_perfHistory - 1) % c_perfHistory]);
+    ImGui::PlotLines(label, values, c_perfHistory, offset, overlay, 0.0f, maxTime, ImVec2(0, 60.0f));
+}
+
+void Viewer::DrawPerformance()
+{
+    RVX_STATS        stats;
+    RVX_MODEL_MEMORY memory;
+    m_renderer.GetStats(&stats);
+    m_renderer.GetMemory(&memory);
+
+    ImGui::Text("Frame %.2f ms (%d fps)", GetFrameTime() * 1000.0f, GetFPS());
+
+    // graphs end at the latest frame, the GPU one trails by the query latency
+    int offset = m_perfFrame % c_perfHistory;
+    PlotHistory("CPU", m_cpuHistory, offset);
+    ImGui::SameLine();
+    HelpMarker("Tick, render, blit and UI on the main thread");
+    PlotHistory("GPU", m_gpuHistory, offset);
+
+    if(ImGui::BeginTable("Breakdown", 2, ImGuiTableFlags_SizingStretchSame))
+    {
+        ImGui::TableNextColumn();
+        ImGui::Text("Tick    %6.2f ms", m_tickTime);
+        ImGui::Text("Render  %6.2f ms", m_renderTime);
+        ImGui::Text("Blit    %6.2f ms", m_blitTime);
+        ImGui::Text("UI      %6.2f ms", m_uiTime);
+
+        ImGui::TableNextColumn();
+        if(stats.gpuFrame >= 0)
+        {
+            ImGui::Text("Models    %6.2f ms", stats.gpuTime[RVX_PASS_MODELS]);
+            ImGui::Text("Instances %6.2f ms", stats.gpuTime[RVX_PASS_INSTANCES]);
+            ImGui::Text("Edges     %6.2f ms", stats.gpuTime[RVX_PASS_EDGES]);
+            ImGui::Text("Blit      %6.2f ms", stats.gpuTime[RVX_PASS_USER]);
+        }
+        else
+        {
+            ImGui::TextDisabled("No GPU timings");
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Import %.1f ms", m_importTime.load());
+    ImGui::Text("Rebuild %.1f ms, upload %.1f ms", m_renderer.m_populateTime, m_renderer.m_uploadTime);
+
+    int quads = m_renderer.GetQuadCount();
+    ImGui::Text("Quads %d, vertices %d", quads, quads * 6); // two triangles each
+    ImGui::Text("Draws %d, triangles %d", stats.counters.drawCalls, stats.counters.triangles);
+
+    ImGui::Separator();
+    auto gpuBytes = memory.gpuVertexBytes + memory.gpuEdgeBytes + m_renderer.GetTargetBytes();
+    ImGui::Text("GPU memory %.2f MB", gpuBytes / (1024.0f * 1024.0f));
+    ImGui::SameLine();
+    HelpMarker("Vertex and edge buffers plus the render texture");
+    ImGui::Text("  vertices %.2f MB, edges %.2f MB, target %.2f MB",
+                memory.gpuVertexBytes / (1024.0f * 1024.0f),
+                memory.gpuEdgeBytes / (1024.0f * 1024.0f),
+                m_renderer.GetTargetBytes() / (1024.0f * 1024.0f));
+    ImGui::Text("CPU buffers %.2f MB",
+                (memory.vertexCapacity + memory.edgeCapacity + memory.metadataBytes) / (1024.0f * 1024.0f));
+}
+
+void Viewer::DrawFlythrough()
+{
+    if(m_flythrough.IsRunning())
+    {
+        ImGui::ProgressBar(m_flythrough.GetProgress(), ImVec2(-FLT_MIN, 0), "Flythrough");
+        if(ImGui::Button("Stop"))
+        {
+            m_flythrough.Stop(m_scene);
+            m_uncapped = false;
+        }
+        return;
+    }
+
+    if(ImGui::Button("Run flythrough"))
+    {
+        m_flythrough.Start(m_scene);
+        m_uncapped = true;
+    }
+    ImGui::SameLine();
+    HelpMarker("Moves the camera along a fixed path at a fixed\r\ntimestep with no frame limit or vsync, so runs\r\ncan be compared between scene and renderer changes");
+
+    if(m_flyRuns == 0)
+        return;
+
+#if !defined(PLATFORM_WEB)
+    ImGui::SameLine();
+    if(ImGui::Button("Save results..."))
+    {
+        nfdchar_t* outPath = NULL;
+        m_dialogPaused     = true;
+        if(NFD_SaveDialog("json", NULL, &outPath) == NFD_OKAY)
+        {
+            std::filesystem::path resultPath(outPath);
+            if(resultPath.extension().empty())
+                resultPath.replace_extension(".json");
+            m_flythrough.WriteResult(resultPath, m_scene.m_scenePath.empty() ? "<new>" : m_scene.m_scenePath.filename().string());
+        }
+    }
+#endif
+
+    int columns = m_flyRuns > 1 ? 3 : 2;
+    if(ImGui::BeginTable("Flythrough", columns, ImGuiTableFlags_Borders | ImGuiTableFlags_SizingStretchSame))
+    {
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("Last run");
+        if(columns > 2)
+            ImGui::TableSetupColumn("Previous");
+        ImGui::TableHeadersRow();
+
+        const char* rows[] = {"CPU min", "CPU avg", "CPU p99", "GPU min", "GPU avg", "GPU p99"};
+        for(int r = 0; r < 6; r++)
+        {
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(rows[r]);
+            for(int c = 0; c < columns - 1; c++)
+            {
+                const auto& times = r < 3 ? m_flyResults[c].cpu : m_flyResults[c].gpu;
+                const float values[] = {times.min, times.avg, times.p99};
+                ImGui::TableNextColumn();
+                if(times.frames)
+                    ImGui::Text("%.2f", values[r % 3]);
+                else
+                    ImGui::TextDisabled("-");
+            }
+        }
+        ImGui::EndTable();
+    }
+}
+
 void Viewer::ImportVOX(const char* fileName, bool optimize)
 {
-    auto vox = VOXLoader::LoadVOX(fileName, false);
+    RVX_PROFILE("Viewer::ImportVOX");
+    auto start = Profiler::Now();
+    auto vox   = VOXLoader::LoadVOX(fileName, false);
     VOXLoader::ImportVOX(vox, m_scene, optimize);
     ogt_vox_destroy_scene(vox);
     m_scene.MarkUpdated();
+    m_importTime = (Profiler::Now() - start) / 1e6f;
 }
 
 void Viewer::CheckSceneReload()
 {
-    if(!m_scene.m_voxFileName.empty())
+    RVX_PROFILE("Viewer::CheckSceneReload");
+    std::filesystem::path voxPath;
+    if(m_autoReload && !m_scene.m_voxFileName.empty())
+        voxPath = m_scene._importPath.empty() ? m_scene.AssetPath(m_scene.m_voxFileName) : m_scene._importPath;
+
+    if(voxPath.empty() || !m_watcher.IsWatching(voxPath))
     {
-        auto voxPath = m_scene._importPath.empty() ? m_scene.AssetPath(m_scene.m_voxFileName).string() : m_scene._importPath.string();
-        auto modTime = GetFileModTime(voxPath.c_str());
-        if(modTime > m_lastModTime)
+        // the previous watcher is joined on a later tick once its import has given up, so the frame never waits for it,
+        // and nothing it published may land in this scene
+        m_reloadProgress.m_cancel = true;
+        m_watcher.RequestStop();
+        if(!m_watcher.IsStopped())
+            return;
+
+        StopReload();
+        std::lock_guard<std::mutex> lock(m_reloadMutex);
+        m_reloaded.reset();
+        m_reloadAreas.clear();
+        m_reloadPalette.clear();
+    }
+    if(!voxPath.empty() && !m_watcher.IsWatching(voxPath))
+        m_watcher.Start(voxPath, [this](const std::filesystem::path& path) { return ReloadVOX(path); });
+    m_watcher.Update();
+
+    std::unique_ptr<Scene>               reloaded;
+    std::vector<std::pair<size_t, Area>> areas;
+    std::vector<Color>                   palette;
+    {
+        std::lock_guard<std::mutex> lock(m_reloadMutex);
+        reloaded = std::move(m_reloaded);
+        areas.swap(m_reloadAreas);
+        palette.swap(m_reloadPalette);
+    }
+
+    if(reloaded)
+    {
+        m_scene.m_palette = std::move(reloaded->m_palette);
+        m_scene.m_areas   = std::move(reloaded->m_areas);
+        m_scene.m_edges   = std::move(reloaded->m_edges);
+        m_scene.MarkUpdated();
+    }
+    else if(areas.size() && palette.size() == m_scene.m_palette.size() &&
+            memcmp(palette.data(), m_scene.m_palette.data(), palette.size() * sizeof(Color)) == 0)
+    {
+        // areas not reimported yet keep showing the previous version, with a new palette they
+        // would change color too so then everything waits for the complete import instead
+        for(auto& [an, area] : areas)
         {
-            auto vox = VOXLoader::LoadVOX(voxPath.c_str(), true);
-            VOXLoader::ImportVOX(vox, m_scene, true);
-            ogt_vox_destroy_scene(vox);
-            m_scene.MarkUpdated();
-            m_lastModTime = modTime;
+            if(an >= m_scene.m_areas.size())
+                m_scene.m_areas.resize(an + 1);
+            m_scene.m_areas[an] = std::move(area);
         }
+        m_scene.MarkUpdated();
+    }
+}
+
+bool Viewer::ReloadVOX(const std::filesystem::path& path)
+{
+    RVX_PROFILE("Viewer::ReloadVOX");
+    auto start = Profiler::Now();
+
+    // an incomplete file fails to parse, the watcher tries again once writes settle
+    auto vox = VOXLoader::LoadVOX(path.string().c_str(), false);
+    if(vox == nullptr)
+        return false;
+
+    // a newer save cancels the import, the watcher then reloads it
+    m_reloadProgress.m_superseded   = [this] { return m_watcher.IsSuperseded(); };
+    m_reloadProgress.m_areaFinished = [this](const Scene& importing, size_t an) {
+        std::lock_guard<std::mutex> lock(m_reloadMutex);
+        if(m_reloadPalette.empty())
+            m_reloadPalette = importing.m_palette;
+        m_reloadAreas.emplace_back(an, importing.m_areas[an]);
+    };
+
+    m_reloading   = true;
+    auto scene    = std::make_unique<Scene>();
+    bool complete = VOXLoader::ImportVOX(vox, *scene, true, &m_reloadProgress);
+    ogt_vox_destroy_scene(vox);
+    m_reloading = false;
+
+    if(complete)
+    {
+        std::lock_guard<std::mutex> lock(m_reloadMutex);
+        m_reloaded   = std::move(scene);
+        m_importTime = (Profiler::Now() - start) / 1e6f;
     }
+    return true;
+}
+
+void Viewer::StopReload()
+{
+    // an import in progress gives up at its next slice instead of running to the end first,
+    // waits for the watcher thread unless it has already stopped
+    m_reloadProgress.m_cancel = true;
+    m_watcher.Stop();
+    m_reloadProgress.m_cancel = false;
 }
 
 void Viewer::Reset()
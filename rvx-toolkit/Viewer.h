@@ -10,40 +10,77 @@
 
 #include "Model.h"
 #include "Renderer.h"
+#include "FileWatcher.h"
+#include "VOXLoader.h"
+#include "Flythrough.h"
 
 namespace rvx
 {
 
+constexpr int c_perfHistory = 240; // frames shown in the performance graphs
+
 class Viewer
 {
 protected:
     void LoadScene(const std::filesystem::path& scenePath);
     void ImportVOX(const char* fileName, bool optimize);
     void CheckSceneReload();
+    bool ReloadVOX(const std::filesystem::path& path); // watcher thread
+    void StopReload();
     void DrawUI();
+    void DrawPerformance();
+    void DrawModeSummary();
+    void DrawFlythrough();
+    void RecordFrame();
     void RecalculateTarget(Rectangle viewportRect);
     void Reset();
 
     Renderer    m_renderer;
     std::string m_screenshot;
     ViewerScene m_scene;
-    int         m_frameCounter = 0;
-    int         m_mouseX       = 0;
-    int         m_mouseY       = 0;
-    double      m_screenTime   = 0;
-    bool        m_guiVisible   = true;
-    bool        m_autoReload   = true;
-    bool        m_sRGB         = false;
-    long        m_lastModTime  = 0;
-    long        m_lastSecond   = 0;
+    int         m_frameCounter  = 0;
+    int         m_mouseX        = 0;
+    int         m_mouseY        = 0;
+    double      m_screenTime    = 0;
+    bool        m_guiVisible    = true;
+    bool        m_autoReload    = true;
+    bool        m_sRGB          = false;
+    bool        m_tracing       = false;
+    int         m_captureFrames = 60;
     std::string m_exportPath;
     Rectangle   m_targetRect;
     Texture2D   m_overlay;
+    Shader      m_heatmap;
+
+    // auto-reload, the watcher thread imports and publishes finished areas which Tick moves into the scene
+    FileWatcher                          m_watcher;
+    ImportProgress                       m_reloadProgress;
+    std::atomic<bool>                    m_reloading {false};
+    std::mutex                           m_reloadMutex;
+    std::vector<std::pair<size_t, Area>> m_reloadAreas; // finished since the last tick, by index
+    std::vector<Color>                   m_reloadPalette;
+    std::unique_ptr<Scene>               m_reloaded; // complete import, replaces everything
+
+    // performance panel, milliseconds
+    float              m_tickTime   = 0;
+    float              m_renderTime = 0;
+    float              m_blitTime   = 0;
+    float              m_uiTime     = 0;
+    float              m_cpuHistory[c_perfHistory] {};
+    float              m_gpuHistory[c_perfHistory] {};
+    int                m_perfFrame = 0;
+    std::atomic<float> m_importTime {0}; // last import or reload, set from the watcher thread
+
+    // flythrough benchmark, the last two results side by side
+    Flythrough       m_flythrough;
+    FlythroughResult m_flyResults[2];
+    int              m_flyRuns = 0;
 
 public:
     bool m_renderResized;
     bool m_windowResized;
     bool m_dialogPaused;
+    bool m_uncapped = false; // no frame limit or vsync, while a flythrough runs
 
     Viewer();
     void Load();
@@ -16,7 +16,10 @@
 constexpr int screenWidth  = 320 * 4;
 constexpr int screenHeight = 168 * 4;
 
+constexpr const char* shaderCacheDir = "shadercache";
+
 bool      firstFrame = true;
+bool      uncapped   = false;
 Rectangle viewportRect {0, 0, 0, 0};
 rvx::Viewer    viewer;
 double    totalTime;
@@ -59,6 +62,16 @@ void UpdateDrawFrame()
         firstFrame = false;
     }
     EndDrawing();
+
+#if !defined(PLATFORM_WEB)
+    // benchmark runs measure how fast frames can go
+    if(viewer.m_uncapped != uncapped)
+    {
+        uncapped = viewer.m_uncapped;
+        SetTargetFPS(uncapped ? 0 : TARGET_FPS);
+        glfwSwapInterval(uncapped ? 0 : 1);
+    }
+#endif
 }
 
 int main()
@@ -76,6 +89,16 @@ int main()
     SetWindowMinSize(640, 400);
     UpdateRenderSize();
 
+#if !defined(PLATFORM_WEB)
+    // keep linked shader programs between launches
+    std::error_code cacheError;
+    std::filesystem::create_directories(shaderCacheDir, cacheError);
+    rvx_set_program_cache(cacheError ? nullptr : shaderCacheDir, (rvx_proc_loader)glfwGetProcAddress);
+
+    // named passes for external capture tools
+    rvx_set_debug_groups((rvx_proc_loader)glfwGetProcAddress);
+#endif
+
     viewer.Load();
     totalTime = GetTime();
 
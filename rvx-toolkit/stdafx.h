@@ -23,4 +23,11 @@
 #include <filesystem>
 #include <numeric>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <memory>
 
@@ -11,6 +11,8 @@
 
 #include "rvx.h"
 #include "rvx_shaders.h"
+#include "rvx_capture.h"
+#include "rvx_soft.h"
 
 #ifndef cglm_mat_h
 #include "include/cglm/mat4.h"
@@ -28,12 +30,40 @@
 #define RVX_VOXEL_LENGTH 6
 #define RVX_VOXEL_SIZE (RVX_VOXEL_LENGTH * RVX_VERTEX_SIZE)
 #define RVX_EDGE_SIZE (RVX_EDGE_LENGTH * RVX_EDGE_VERTEX_SIZE)
+#define RVX_EDGE_INSTANCE_SIZE (12 /*bounds, params, shape*/ * sizeof(short) + 4 /*colors*/ * sizeof(Color4))
+#define RVX_EDGE_ROW_LENGTH (4 * RVX_EDGE_LENGTH)
+#define RVX_INSTANCE_SIZE ((4 /*offset, shadow*/ + 4 /*scale*/) * sizeof(float))
+#define RVX_VIEW_BLOCK_BINDING 0
+#define RVX_PALETTE_BLOCK_BINDING 1
+#define RVX_SHADER_DEFINES_SIZE 128
+#define RVX_VIEW_BLOCK_SIZE ((16 /*view*/ + 4 /*alpha, padded*/) * sizeof(float))
+#define RVX_STATE_UNKNOWN ((GLuint)-1)
+#define RVX_DEPTH_BUCKETS 4096
+#define RVX_STREAM_REGION_SIZE (2048 * RVX_INSTANCE_SIZE)
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+#ifndef GL_DEBUG_SOURCE_APPLICATION
+#define GL_DEBUG_SOURCE_APPLICATION 0x824A
+#endif
+#define RVX_PROGRAM_CACHE_MAGIC 0x50585652 /* RVXP */
 
 #define PI 3.14159265358979323846f
 #define DEG2RAD (PI / 180.0f)
 
 const char* rvx_backend_gles3 = "gles3";
 const char* rvx_backend_gl    = "gl";
+const char* rvx_backend_soft  = "soft";
 const int   ALIGN_LEFT        = 1;
 const int   ALIGN_RIGHT       = 2;
 const int   ALIGN_BOTTOM      = 4;
@@ -120,208 +150,1383 @@ inline void qlVertex7f(float   x,
     *(*ptr)        = (ci << 24) + (c->b << 16) + (c->g << 8) + (c->r);
     *(*vertexPtr)++;
 
-    ptr     = (uint32_t**)vertexPtr;
-    *(*ptr) = (alignFlags << 24) + (edgeHeight << 16) + (edgeSpacing << 8) + edgeWidth;
-    *(*vertexPtr)++;
+    ptr     = (uint32_t**)vertexPtr;
+    *(*ptr) = (alignFlags << 24) + (edgeHeight << 16) + (edgeSpacing << 8) + edgeWidth;
+    *(*vertexPtr)++;
+}
+
+// CPU sections reported to rvx_set_trace, a single test when nothing listens,
+// only set before other threads call rvx so it needs no synchronization
+static rvx_trace_func s_trace = NULL;
+
+#define RVX_TRACE_BEGIN(name) do { if(s_trace != NULL) s_trace((name), 1); } while(0)
+#define RVX_TRACE_END(name) do { if(s_trace != NULL) s_trace((name), 0); } while(0)
+
+// calls made inside other rvx calls are replayed by their caller, only the outermost one is captured
+#define RVX_CAPTURE(call) do { if(rvx_capturing && rvx_capture_depth == 0) call; } while(0)
+#define RVX_NESTED(call) do { rvx_capture_depth++; call; rvx_capture_depth--; } while(0)
+
+void rvx_set_trace(rvx_trace_func trace)
+{
+    s_trace = trace;
+}
+
+static int rvx_grow_capacity(int capacity, int size)
+{
+    // geometric growth so repeated rebuilds settle on a single allocation
+    if(size <= capacity)
+        return capacity;
+
+    int grown = capacity + capacity / 2;
+    return grown > size ? grown : size;
+}
+
+static int rvx_get_edge_bucket(int rows)
+{
+    int bucket = 0;
+    while(bucket < RVX_EDGE_BUCKETS - 1 && (1 << bucket) < rows)
+        bucket++;
+    return bucket;
+}
+
+static void rvx_model_populate_edges(RVX_MODEL* model, Color4 palette[256])
+{
+    model->edgeBufferSize = 0;
+
+    if(model->edgeInstancing)
+    {
+        // one record per edge, rows are generated by the vertex shader; records are sorted by bucket so each
+        // bucket is drawn with only as many rows as its longest edge
+        int bucketSizes[RVX_EDGE_BUCKETS] = {0};
+        model->edgeRows                   = 0;
+        model->edgeBufferSize             = model->numEdges * RVX_EDGE_INSTANCE_SIZE;
+        for(int b = 0; b < RVX_EDGE_BUCKETS; b++)
+            model->edgeBucketRows[b] = 0;
+        for(int e = 0; e < model->numEdges; e++)
+        {
+            int rows   = rvx_get_edge_rows(model->edges + e);
+            int bucket = rvx_get_edge_bucket(rows);
+            bucketSizes[bucket]++;
+            if(rows > model->edgeBucketRows[bucket])
+                model->edgeBucketRows[bucket] = rows;
+            if(rows > model->edgeRows)
+                model->edgeRows = rows;
+        }
+        model->edgeBucketStart[0] = 0;
+        for(int b = 0; b < RVX_EDGE_BUCKETS; b++)
+            model->edgeBucketStart[b + 1] = model->edgeBucketStart[b] + bucketSizes[b];
+        model->edgesLength = model->edgeRows * RVX_EDGE_ROW_LENGTH;
+    }
+    else if(model->numEdges > 0)
+    {
+        // if we have edges, reserve buffer for them
+        model->edgesLength = 0;
+        for(int e = 0; e < model->numEdges; e++)
+        {
+            RVX_EDGE* edge     = model->edges + e;
+            int       edge_len = rvx_get_edge_length(edge);
+            model->edgesLength += edge_len;
+            model->edgeBufferSize += edge_len * RVX_EDGE_SIZE;
+        }
+    }
+
+    if(model->edgeBufferSize > model->edgeBufferCapacity)
+    {
+        if(model->edgeBuffer)
+            free(model->edgeBuffer);
+
+        model->edgeBufferCapacity = rvx_grow_capacity(model->edgeBufferCapacity, model->edgeBufferSize);
+        model->edgeBuffer         = (float*)malloc(model->edgeBufferCapacity);
+    }
+
+    if(model->numEdges > 0 && model->edgeInstancing)
+    {
+        int next[RVX_EDGE_BUCKETS];
+        for(int b = 0; b < RVX_EDGE_BUCKETS; b++)
+            next[b] = model->edgeBucketStart[b];
+        for(int e = 0; e < model->numEdges; e++)
+        {
+            RVX_EDGE* edge      = model->edges + e;
+            int       bucket    = rvx_get_edge_bucket(rvx_get_edge_rows(edge));
+            float*    vertexPtr = (float*)((char*)model->edgeBuffer + next[bucket]++ * RVX_EDGE_INSTANCE_SIZE);
+            rvx_update_edge_instance(edge, &vertexPtr, palette);
+        }
+    }
+    else if(model->numEdges > 0)
+    {
+        float* vertexPtr = model->edgeBuffer;
+        for(int e = 0; e < model->numEdges; e++)
+            rvx_update_edge_buffer(model->edges + e, &vertexPtr, palette);
+    }
+}
+
+static void rvx_model_reserve_buffer(RVX_MODEL* model, int modelVoxels)
+{
+    model->numVoxels   = modelVoxels;
+    model->modelLength = modelVoxels * RVX_VOXEL_LENGTH;
+    model->bufferSize  = (modelVoxels)*RVX_VOXEL_SIZE;
+
+    // need new buffer?
+    if(model->bufferSize > model->bufferCapacity)
+    {
+        if(model->buffer)
+            free(model->buffer);
+
+        model->bufferCapacity = rvx_grow_capacity(model->bufferCapacity, model->bufferSize);
+        model->buffer         = (float*)malloc(model->bufferCapacity);
+    }
+}
+
+void rvx_model_populate_buffer(RVX_MODEL* model, Voxel* voxels, int modelVoxels, Color4 palette[256])
+{
+    RVX_CAPTURE(rvx_capture_populate_buffer(model, voxels, modelVoxels, palette));
+    RVX_TRACE_BEGIN("rvx_model_populate_buffer");
+    rvx_model_populate_edges(model, palette);
+    rvx_model_reserve_buffer(model, modelVoxels);
+
+    float* vertexPtr = model->buffer;
+    Voxel* vx        = voxels;
+
+    int min_x = 5000;
+    int max_x = 0;
+    int min_y = 5000;
+    int max_y = 0;
+
+    for(int v = 0; v < modelVoxels; v++)
+    {
+        if(vx->sx < min_x)
+            min_x = vx->sx;
+        if(vx->ex > max_x)
+            max_x = vx->ex;
+        if(vx->y < min_y)
+            min_y = vx->y;
+        if(vx->y > max_y)
+            max_y = vx->y;
+        rvx_emit_voxel(vx, palette + vx->colorIndex, &vertexPtr);
+        vx++;
+    }
+    RVX_TRACE_END("rvx_model_populate_buffer");
+}
+
+void rvx_model_populate_spans(RVX_MODEL* model, const RVX_SPAN* spans, int numSpans, Color4 palette[256])
+{
+    RVX_CAPTURE(rvx_capture_populate_spans(model, spans, numSpans, palette));
+    RVX_TRACE_BEGIN("rvx_model_populate_spans");
+    int modelVoxels = 0;
+    for(int s = 0; s < numSpans; s++)
+    {
+        modelVoxels += spans[s].quads ? spans[s].quads->numQuads : spans[s].count;
+    }
+
+    rvx_model_populate_edges(model, palette);
+    rvx_model_reserve_buffer(model, modelVoxels);
+
+    // one area per span
+    if(model->numAreas != numSpans)
+    {
+        if(model->areas)
+            free(model->areas);
+
+        model->areas    = numSpans ? (RVX_AREA*)malloc(numSpans * sizeof(RVX_AREA)) : NULL;
+        model->numAreas = numSpans;
+    }
+
+    float* vertexPtr = model->buffer;
+    int    start     = 0;
+    for(int s = 0; s < numSpans; s++)
+    {
+        const RVX_SPAN* span = spans + s;
+        RVX_AREA*       area = model->areas + s;
+
+        area->no    = span->area_no;
+        area->start = start;
+        area->len   = span->quads ? span->quads->numQuads : span->count;
+        area->sx    = 0;
+        area->sy    = 0;
+        area->sz    = 0;
+
+        // emit straight from the caller's storage
+        if(span->quads)
+        {
+            rvx_emit_quads(span->quads, palette, &vertexPtr);
+        }
+        else
+        {
+            for(int v = 0; v < span->count; v++)
+            {
+                Voxel* vx = (Voxel*)span->voxels + v;
+                rvx_emit_voxel(vx, palette + vx->colorIndex, &vertexPtr);
+            }
+        }
+
+        start += area->len;
+    }
+    RVX_TRACE_END("rvx_model_populate_spans");
+}
+
+// replaces vertex colors for inspecting the mesh, hue follows the area and brightness the quad's size in voxels,
+// neighbouring quads alternate shades so their borders show, color indices are kept for RVX_SHADER_PALETTE
+void rvx_model_color_quads(RVX_MODEL* model)
+{
+    RVX_CAPTURE(rvx_capture_model(RVX_CAPTURE_COLOR_QUADS, model));
+    for(int a = 0; a < model->numAreas; a++)
+    {
+        const RVX_AREA* area = model->areas + a;
+
+        // golden ratio steps keep consecutive areas apart
+        float hue = fmodf(area->no * 0.618034f, 1.0f) * 6.0f;
+        float r   = fminf(fmaxf(fabsf(hue - 3.0f) - 1.0f, 0.0f), 1.0f);
+        float g   = fminf(fmaxf(2.0f - fabsf(hue - 2.0f), 0.0f), 1.0f);
+        float b   = fminf(fmaxf(2.0f - fabsf(hue - 4.0f), 0.0f), 1.0f);
+
+        for(int q = 0; q < area->len; q++)
+        {
+            uint8_t* quad = (uint8_t*)model->buffer + (size_t)(area->start + q) * RVX_VOXEL_SIZE;
+
+            // first two vertices are opposite corners, see rvx_emit_voxel
+            short start[4];
+            short end[4];
+            memcpy(start, quad, sizeof(start));
+            memcpy(end, quad + RVX_VERTEX_SIZE, sizeof(end));
+            float size  = (float)abs(end[0] - start[0]) * (float)abs(end[2] - start[2]) / 16.0f;
+            float shade = 0.25f + 0.75f * fminf(log2f(fmaxf(size, 1.0f)) / 8.0f, 1.0f);
+            if(q & 1)
+                shade *= 0.85f;
+
+            for(int v = 0; v < RVX_VOXEL_LENGTH; v++)
+            {
+                uint8_t* color = quad + v * RVX_VERTEX_SIZE + 4 * sizeof(short);
+                color[0]       = (uint8_t)(r * shade * 255.0f);
+                color[1]       = (uint8_t)(g * shade * 255.0f);
+                color[2]       = (uint8_t)(b * shade * 255.0f);
+            }
+        }
+    }
+}
+
+RVX_MODEL* rvx_model_new()
+{
+    RVX_MODEL* model = (RVX_MODEL*)malloc(sizeof(RVX_MODEL));
+    if(model == NULL)
+        abort();
+
+    model->loaded                = 1;
+    model->bound                 = 0;
+    model->numVoxels             = 0;
+    model->buffer                = NULL;
+    model->bufferSize            = 0;
+    model->bufferCapacity        = 0;
+    model->VAO                   = 0;
+    model->VBO                   = 0;
+    model->gpuBufferCapacity     = 0;
+    model->areas                 = NULL;
+    model->numAreas              = 0;
+    model->modelLength           = 0;
+    model->numEdges              = 0;
+    model->edges                 = NULL;
+    model->edgesLength           = 0;
+    model->edgeBufferSize        = 0;
+    model->edgeBufferCapacity    = 0;
+    model->edgeBuffer            = NULL;
+    model->edgeVAO               = 0;
+    model->edgeVBO               = 0;
+    model->gpuEdgeBufferCapacity = 0;
+    model->edgeInstancing        = 1;
+    model->edgeRows              = 0;
+    model->instanceVAO           = 0;
+    memset(model->edgeBucketStart, 0, sizeof(model->edgeBucketStart));
+    memset(model->edgeBucketRows, 0, sizeof(model->edgeBucketRows));
+    memset(model->edgeBucketVAOs, 0, sizeof(model->edgeBucketVAOs));
+    model->uploadedBytes         = 0;
+    return model;
+}
+
+void rvx_model_memory(const RVX_MODEL* model, RVX_MODEL_MEMORY* memory)
+{
+    memory->vertexBytes    = model->bufferSize;
+    memory->vertexCapacity = model->bufferCapacity;
+    memory->edgeBytes      = model->edgeBufferSize;
+    memory->edgeCapacity   = model->edgeBufferCapacity;
+    memory->metadataBytes  = model->numAreas * sizeof(RVX_AREA) + model->numEdges * sizeof(RVX_EDGE);
+    memory->gpuVertexBytes = model->gpuBufferCapacity;
+    memory->gpuEdgeBytes   = model->gpuEdgeBufferCapacity;
+}
+
+void rvx_model_free(RVX_MODEL* model)
+{
+    RVX_CAPTURE(rvx_capture_model(RVX_CAPTURE_MODEL_FREE, model));
+    if(model->buffer != NULL)
+        free(model->buffer);
+    if(model->areas != NULL)
+        free(model->areas);
+    if(model->edges != NULL)
+        free(model->edges);
+    if(model->edgeBuffer != NULL)
+        free(model->edgeBuffer);
+
+    free(model);
+}
+
+// exchanges the CPU-side vertex data of two models, GL objects stay with their models
+void rvx_model_swap_buffers(RVX_MODEL* model, RVX_MODEL* other)
+{
+    RVX_CAPTURE(rvx_capture_swap_buffers(model, other));
+    RVX_MODEL swap = *model;
+
+    model->params             = other->params;
+    model->numVoxels          = other->numVoxels;
+    model->buffer             = other->buffer;
+    model->bufferSize         = other->bufferSize;
+    model->bufferCapacity     = other->bufferCapacity;
+    model->numAreas           = other->numAreas;
+    model->areas              = other->areas;
+    model->numEdges           = other->numEdges;
+    model->edges              = other->edges;
+    model->edgeBuffer         = other->edgeBuffer;
+    model->edgeBufferSize     = other->edgeBufferSize;
+    model->edgeBufferCapacity = other->edgeBufferCapacity;
+    model->modelLength        = other->modelLength;
+    model->edgesLength        = other->edgesLength;
+    model->edgeRows           = other->edgeRows;
+    memcpy(model->edgeBucketStart, other->edgeBucketStart, sizeof(model->edgeBucketStart));
+    memcpy(model->edgeBucketRows, other->edgeBucketRows, sizeof(model->edgeBucketRows));
+
+    other->params             = swap.params;
+    other->numVoxels          = swap.numVoxels;
+    other->buffer             = swap.buffer;
+    other->bufferSize         = swap.bufferSize;
+    other->bufferCapacity     = swap.bufferCapacity;
+    other->numAreas           = swap.numAreas;
+    other->areas              = swap.areas;
+    other->numEdges           = swap.numEdges;
+    other->edges              = swap.edges;
+    other->edgeBuffer         = swap.edgeBuffer;
+    other->edgeBufferSize     = swap.edgeBufferSize;
+    other->edgeBufferCapacity = swap.edgeBufferCapacity;
+    other->modelLength        = swap.modelLength;
+    other->edgesLength        = swap.edgesLength;
+    other->edgeRows           = swap.edgeRows;
+    memcpy(other->edgeBucketStart, swap.edgeBucketStart, sizeof(other->edgeBucketStart));
+    memcpy(other->edgeBucketRows, swap.edgeBucketRows, sizeof(other->edgeBucketRows));
+}
+
+// instanced edge layout of the bound VAO, reading records from offset in the bound buffer
+static void rvx_set_edge_instance_attribs(size_t offset)
+{
+    // bounds, params and shape, see RVX_VERTEX_SHADER_BODY
+    for(int a = 0; a < 3; a++)
+    {
+        glVertexAttribIPointer(a, 4, GL_SHORT, RVX_EDGE_INSTANCE_SIZE, (void*)(offset + a * 4 * sizeof(short)));
+        glVertexAttribDivisor(a, 1);
+        glEnableVertexAttribArray(a);
+    }
+    // corner colors
+    for(int a = 3; a < 7; a++)
+    {
+        glVertexAttribPointer(a,
+                              4,
+                              GL_UNSIGNED_BYTE,
+                              GL_TRUE,
+                              RVX_EDGE_INSTANCE_SIZE,
+                              (void*)(offset + 12 * sizeof(short) + (a - 3) * sizeof(Color4)));
+        glVertexAttribDivisor(a, 1);
+        glEnableVertexAttribArray(a);
+    }
+}
+
+static void rvx_upload_buffer(GLuint vbo, const void* data, int size, int* capacity, GLenum usage)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+    // only reallocate storage when the data outgrows it
+    if(size > *capacity)
+    {
+        *capacity = rvx_grow_capacity(*capacity, size);
+        glBufferData(GL_ARRAY_BUFFER, *capacity, NULL, usage);
+    }
+
+    if(size > 0)
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+}
+
+static void rvx_stream_allocate(RVX_STREAM* stream, int regionSize)
+{
+    // fresh storage, draws already issued keep reading the old one
+    stream->regionSize = regionSize;
+    stream->region     = 0;
+    stream->offset     = 0;
+    for(int f = 0; f < RVX_STREAM_FRAMES; f++)
+    {
+        if(stream->fences[f] != 0)
+        {
+            glDeleteSync(stream->fences[f]);
+            stream->fences[f] = 0;
+        }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    glBufferData(GL_ARRAY_BUFFER, regionSize * RVX_STREAM_FRAMES, NULL, GL_STREAM_DRAW);
+}
+
+RVX_STREAM* rvx_stream_new(int regionSize)
+{
+    RVX_STREAM* stream = (RVX_STREAM*)malloc(sizeof(RVX_STREAM));
+    if(stream == NULL)
+        return NULL;
+
+    memset(stream, 0, sizeof(RVX_STREAM));
+    glGenBuffers(1, &stream->buffer);
+    rvx_stream_allocate(stream, regionSize);
+    return stream;
+}
+
+void rvx_stream_free(RVX_STREAM* stream)
+{
+    for(int f = 0; f < RVX_STREAM_FRAMES; f++)
+    {
+        if(stream->fences[f] != 0)
+            glDeleteSync(stream->fences[f]);
+    }
+    glDeleteBuffers(1, &stream->buffer);
+    free(stream);
+}
+
+// copies data into this frame's region and returns its byte offset in stream->buffer
+int rvx_stream_write(RVX_STREAM* stream, const void* data, int size)
+{
+    if(stream->offset + size > stream->regionSize)
+    {
+        // only when a frame outgrows its region, settles after the first few frames
+        rvx_stream_allocate(stream, rvx_grow_capacity(stream->regionSize, stream->offset + size));
+    }
+
+    int offset = stream->region * stream->regionSize + stream->offset;
+    stream->offset += (size + 15) & ~15;
+
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+#ifndef EMSCRIPTEN
+    // the region is not in use by the GPU, so no implicit synchronization is needed
+    void* ptr = glMapBufferRange(
+        GL_ARRAY_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if(ptr != NULL)
+    {
+        memcpy(ptr, data, size);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        return offset;
+    }
+#endif
+    glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+    return offset;
+}
+
+// fences the frame just written and moves to the next region, returns 1 if the GPU had not finished with it yet
+int rvx_stream_next_frame(RVX_STREAM* stream)
+{
+    int waited = 0;
+#ifndef EMSCRIPTEN
+    if(stream->offset > 0)
+        stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+
+    stream->region = (stream->region + 1) % RVX_STREAM_FRAMES;
+    stream->offset = 0;
+
+    GLsync fence = stream->fences[stream->region];
+    if(fence != 0)
+    {
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        while(result == GL_TIMEOUT_EXPIRED)
+        {
+            waited = 1;
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        }
+        glDeleteSync(fence);
+        stream->fences[stream->region] = 0;
+    }
+    return waited;
+}
+
+void rvx_model_bind(RVX_RENDERER* renderer, RVX_MODEL* model)
+{
+    RVX_CAPTURE(rvx_capture_draw(RVX_CAPTURE_BIND, renderer, model, 0));
+    if(model->bound)
+        return;
+
+    // the software rasterizer reads the CPU buffers
+    if(renderer->soft != NULL)
+    {
+        model->bound = 1;
+        return;
+    }
+
+    RVX_NESTED(rvx_model_upload(model));
+    renderer->currentVAO = 0;
+}
+
+void rvx_model_upload(RVX_MODEL* model)
+{
+    RVX_CAPTURE(rvx_capture_model(RVX_CAPTURE_UPLOAD, model));
+    RVX_TRACE_BEGIN("rvx_model_upload");
+    if(model->VAO == 0)
+    {
+        glGenVertexArrays(1, &model->VAO);
+        glGenBuffers(1, &model->VBO);
+
+        glBindVertexArray(model->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, model->VBO);
+
+        // position attribute
+        glVertexAttribPointer(0, 4, GL_SHORT, GL_FALSE, 6 * sizeof(short), (void*)0);
+        glEnableVertexAttribArray(0);
+        // color attribute
+        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 6 * sizeof(short), (void*)(4 * sizeof(short)));
+        glEnableVertexAttribArray(1);
+    }
+
+    rvx_upload_buffer(model->VBO, model->buffer, model->bufferSize, &model->gpuBufferCapacity, GL_STATIC_DRAW);
+    model->uploadedBytes += model->bufferSize;
+
+    // edges
+    if(model->numEdges > 0)
+    {
+        if(model->edgeVAO == 0)
+        {
+            // buffers
+            glGenVertexArrays(1, &model->edgeVAO);
+            glGenBuffers(1, &model->edgeVBO);
+
+            glBindVertexArray(model->edgeVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, model->edgeVBO);
+
+            if(model->edgeInstancing)
+            {
+                rvx_set_edge_instance_attribs(0);
+            }
+            else
+            {
+                // position attribute
+                glVertexAttribPointer(0, 4, GL_SHORT, GL_FALSE, 8 * sizeof(short), (void*)0);
+                glEnableVertexAttribArray(0);
+                // color attribute
+                glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 8 * sizeof(short), (void*)(4 * sizeof(short)));
+                glEnableVertexAttribArray(1);
+                // edge attributes
+                glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_FALSE, 8 * sizeof(short), (void*)(6 * sizeof(short)));
+                glEnableVertexAttribArray(2);
+            }
+        }
+
+        rvx_upload_buffer(
+            model->edgeVBO, model->edgeBuffer, model->edgeBufferSize, &model->gpuEdgeBufferCapacity, GL_DYNAMIC_DRAW);
+        model->uploadedBytes += model->edgeBufferSize;
+
+        // GL 3.3 has no base instance, so every other bucket gets a VAO pointing at its first record
+        for(int b = 1; model->edgeInstancing && b < RVX_EDGE_BUCKETS; b++)
+        {
+            if(model->edgeBucketStart[b] == model->edgeBucketStart[b + 1])
+                continue;
+            if(model->edgeBucketVAOs[b] == 0)
+                glGenVertexArrays(1, &model->edgeBucketVAOs[b]);
+            glBindVertexArray(model->edgeBucketVAOs[b]);
+            glBindBuffer(GL_ARRAY_BUFFER, model->edgeVBO);
+            rvx_set_edge_instance_attribs(model->edgeBucketStart[b] * RVX_EDGE_INSTANCE_SIZE);
+        }
+    }
+
+    glBindVertexArray(0);
+    model->bound = 1;
+    RVX_TRACE_END("rvx_model_upload");
+}
+
+void rvx_model_unbind(RVX_MODEL* model)
+{
+    RVX_CAPTURE(rvx_capture_model(RVX_CAPTURE_UNBIND, model));
+    if(model->VAO != 0)
+    {
+        glDeleteVertexArrays(1, &model->VAO);
+        glDeleteBuffers(1, &model->VBO);
+        model->VAO               = 0;
+        model->VBO               = 0;
+        model->gpuBufferCapacity = 0;
+    }
+    if(model->edgeVAO != 0)
+    {
+        glDeleteVertexArrays(1, &model->edgeVAO);
+        glDeleteBuffers(1, &model->edgeVBO);
+        model->edgeVAO               = 0;
+        model->edgeVBO               = 0;
+        model->gpuEdgeBufferCapacity = 0;
+    }
+    for(int b = 0; b < RVX_EDGE_BUCKETS; b++)
+    {
+        if(model->edgeBucketVAOs[b] != 0)
+        {
+            glDeleteVertexArrays(1, &model->edgeBucketVAOs[b]);
+            model->edgeBucketVAOs[b] = 0;
+        }
+    }
+    if(model->instanceVAO != 0)
+    {
+        glDeleteVertexArrays(1, &model->instanceVAO);
+        model->instanceVAO = 0;
+    }
+    model->bound = 0;
+}
+
+static void rvx_use_program(RVX_RENDERER* renderer, GLuint program)
+{
+    if(renderer->currentProgram == program)
+    {
+        renderer->counters.programSwitchesSkipped++;
+        return;
+    }
+
+    glUseProgram(program);
+    renderer->currentProgram = program;
+    renderer->counters.programSwitches++;
+}
+
+static void rvx_bind_vertex_array(RVX_RENDERER* renderer, GLuint vao)
+{
+    if(renderer->currentVAO == vao)
+    {
+        renderer->counters.vaoBindsSkipped++;
+        return;
+    }
+
+    glBindVertexArray(vao);
+    renderer->currentVAO = vao;
+    renderer->counters.vaoBinds++;
+}
+
+// one upload serves every program, matrix or alpha are left untouched when NULL
+static void rvx_upload_view(RVX_RENDERER* renderer, const float* matrix, const float* alpha)
+{
+    glBindBuffer(GL_UNIFORM_BUFFER, renderer->viewBuffer);
+    if(matrix != NULL)
+    {
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, 16 * sizeof(float), matrix);
+        renderer->uploadedBytes += 16 * sizeof(float);
+    }
+    if(alpha != NULL)
+    {
+        glBufferSubData(GL_UNIFORM_BUFFER, 16 * sizeof(float), sizeof(float), alpha);
+        renderer->uploadedBytes += sizeof(float);
+    }
+    renderer->counters.viewUploads++;
+}
+
+// applies to the following draws, queued ones pick it up when they are flushed
+static void rvx_set_transform(RVX_RENDERER* renderer, const float* matrix, const float* alpha)
+{
+    memcpy(renderer->transformMatrix, matrix, 16 * sizeof(float));
+    if(renderer->soft != NULL)
+        return;
+
+    if(renderer->deferred)
+    {
+        renderer->queueTransform = -1;
+        if(alpha != NULL)
+            rvx_upload_view(renderer, NULL, alpha);
+    }
+    else
+    {
+        rvx_upload_view(renderer, matrix, alpha);
+    }
+}
+
+// debug groups are not part of the GL 3.3 core API, entry points come from rvx_set_debug_groups
+typedef void(APIENTRY* rvx_push_debug_group_func)(GLenum source, GLuint id, GLsizei length, const char* message);
+typedef void(APIENTRY* rvx_pop_debug_group_func)(void);
+
+static rvx_push_debug_group_func s_glPushDebugGroup = NULL;
+static rvx_pop_debug_group_func  s_glPopDebugGroup  = NULL;
+
+static const char* s_pass_names[RVX_PASSES] = {"rvx models", "rvx instances", "rvx edges", "rvx user"};
+
+void rvx_renderer_begin_pass(RVX_RENDERER* renderer, int pass, const char* name)
+{
+    RVX_CAPTURE(rvx_capture_begin_pass(renderer, pass, name));
+
+    // passes do not nest, a new one ends the previous
+    if(renderer->currentPass >= 0)
+        RVX_NESTED(rvx_renderer_end_pass(renderer));
+
+    if(s_glPushDebugGroup != NULL && renderer->soft == NULL)
+        s_glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, pass, -1, name != NULL ? name : s_pass_names[pass]);
+
+#ifndef EMSCRIPTEN
+    RVX_TIMER_FRAME* timer = renderer->timerFrames + renderer->timerFrame;
+    if(renderer->timing && renderer->soft == NULL && timer->numQueries + 2 <= RVX_TIMER_QUERIES)
+    {
+        timer->passes[timer->numQueries / 2] = pass;
+        glQueryCounter(timer->queries[timer->numQueries++], GL_TIMESTAMP);
+    }
+#endif
+
+    renderer->currentPass = pass;
+}
+
+void rvx_renderer_end_pass(RVX_RENDERER* renderer)
+{
+    RVX_CAPTURE(rvx_capture_renderer(RVX_CAPTURE_END_PASS, renderer));
+    if(renderer->currentPass < 0)
+        return;
+
+#ifndef EMSCRIPTEN
+    // an odd count means the begin got a timestamp
+    RVX_TIMER_FRAME* timer = renderer->timerFrames + renderer->timerFrame;
+    if(timer->numQueries & 1)
+        glQueryCounter(timer->queries[timer->numQueries++], GL_TIMESTAMP);
+#endif
+
+    if(s_glPopDebugGroup != NULL && renderer->soft == NULL)
+        s_glPopDebugGroup();
+
+    renderer->currentPass = -1;
+}
+
+// reads back the oldest frame's timestamps if the GPU is done with them and starts recording the next frame
+// moves the results of a timer frame into renderer->stats if they are available, 1 if they were
+static int rvx_renderer_read_timer_frame(RVX_RENDERER* renderer, RVX_TIMER_FRAME* timer)
+{
+#ifndef EMSCRIPTEN
+    GLint available = 0;
+    if(timer->numQueries > 0)
+        glGetQueryObjectiv(timer->queries[timer->numQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+    if(available)
+    {
+        GLuint64 first = 0;
+        GLuint64 last  = 0;
+        for(int p = 0; p < RVX_PASSES; p++)
+            renderer->stats.gpuTime[p] = 0;
+
+        for(int q = 0; q < timer->numQueries; q += 2)
+        {
+            GLuint64 start, end;
+            glGetQueryObjectui64v(timer->queries[q], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(timer->queries[q + 1], GL_QUERY_RESULT, &end);
+            renderer->stats.gpuTime[timer->passes[q / 2]] += (end - start) / 1000000.0;
+            if(q == 0)
+                first = start;
+            last = end;
+        }
+        renderer->stats.gpuFrameTime = (last - first) / 1000000.0;
+        renderer->stats.gpuFrame     = timer->frame;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+static void rvx_renderer_next_timer_frame(RVX_RENDERER* renderer)
+{
+    renderer->timerFrame   = (renderer->timerFrame + 1) % RVX_TIMER_FRAMES;
+    RVX_TIMER_FRAME* timer = renderer->timerFrames + renderer->timerFrame;
+
+    // results still pending are dropped rather than waited for
+    rvx_renderer_read_timer_frame(renderer, timer);
+    timer->numQueries = 0;
+    timer->frame      = renderer->frame;
+}
+
+int rvx_renderer_drain_timers(RVX_RENDERER* renderer, RVX_STATS* stats)
+{
+    // oldest first, the frame after the current one in the ring was begun longest ago
+    for(int f = 1; f <= RVX_TIMER_FRAMES && renderer->soft == NULL; f++)
+    {
+        RVX_TIMER_FRAME* timer = renderer->timerFrames + (renderer->timerFrame + f) % RVX_TIMER_FRAMES;
+        if(timer->numQueries == 0)
+            continue;
+
+        int read          = rvx_renderer_read_timer_frame(renderer, timer);
+        timer->numQueries = 0;
+        if(read)
+        {
+            rvx_renderer_stats(renderer, stats);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void rvx_enter_pass(RVX_RENDERER* renderer, int pass)
+{
+    if(renderer->currentPass != pass)
+        RVX_NESTED(rvx_renderer_begin_pass(renderer, pass, NULL));
+}
+
+static void rvx_execute_item(RVX_RENDERER* renderer, const RVX_DRAW_ITEM* item)
+{
+    rvx_enter_pass(renderer, item->pass);
+
+    rvx_use_program(renderer, item->program);
+    rvx_bind_vertex_array(renderer, item->vao);
+
+    if(item->instanceOffset >= 0)
+    {
+        intptr_t offset = renderer->instanceStreamBase + item->instanceOffset;
+        glBindBuffer(GL_ARRAY_BUFFER, renderer->instanceStream->buffer);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, RVX_INSTANCE_SIZE, (void*)offset);
+        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, RVX_INSTANCE_SIZE, (void*)(offset + 4 * sizeof(float)));
+    }
+
+    if(item->instances > 0)
+        glDrawArraysInstanced(GL_TRIANGLES, item->first, item->count, item->instances);
+    else
+        glDrawArrays(GL_TRIANGLES, item->first, item->count);
+
+    int vertices = item->instances > 0 ? item->count * item->instances : item->count;
+    renderer->counters.drawCalls++;
+    renderer->counters.vertices += vertices;
+    renderer->counters.triangles += vertices / 3;
+}
+
+static int rvx_permutation_pass(int permutation)
+{
+    return (permutation & RVX_SHADER_EDGES)       ? RVX_PASS_EDGES
+           : (permutation & RVX_SHADER_INSTANCED) ? RVX_PASS_INSTANCES
+                                                  : RVX_PASS_MODELS;
+}
+
+// software rasterizer draws are binned right away in submission order, instances are instanceBuffer floats
+static void rvx_submit_soft(
+    RVX_RENDERER* renderer, int permutation, RVX_MODEL* model, int first, int count, const float* instances, int numInstances)
+{
+    rvx_enter_pass(renderer, rvx_permutation_pass(permutation));
+    rvx_soft_draw(renderer, model, permutation | renderer->shaderFlags, first, count, instances, numInstances);
+
+    int vertices = numInstances > 0 ? count * numInstances : count;
+    renderer->counters.drawCalls++;
+    renderer->counters.vertices += vertices;
+    renderer->counters.triangles += vertices / 3;
+}
+
+static void rvx_submit(RVX_RENDERER* renderer, int permutation, GLuint vao, int first, int count, int instances, int instanceOffset)
+{
+    RVX_DRAW_ITEM item;
+    item.program        = rvx_renderer_program(renderer, permutation | renderer->shaderFlags);
+    item.vao            = vao;
+    item.first          = first;
+    item.count          = count;
+    item.instances      = instances;
+    item.instanceOffset = instanceOffset;
+    item.pass           = rvx_permutation_pass(permutation);
+
+    if(!renderer->deferred)
+    {
+        rvx_execute_item(renderer, &item);
+        return;
+    }
+
+    if(renderer->queueTransform < 0)
+    {
+        if(renderer->numQueueTransforms == renderer->queueTransformsCapacity)
+        {
+            renderer->queueTransformsCapacity = rvx_grow_capacity(renderer->queueTransformsCapacity, renderer->numQueueTransforms + 1);
+            renderer->queueTransforms =
+                (float*)realloc(renderer->queueTransforms, renderer->queueTransformsCapacity * 16 * sizeof(float));
+            if(renderer->queueTransforms == NULL)
+                abort();
+        }
+        memcpy(renderer->queueTransforms + renderer->numQueueTransforms * 16, renderer->transformMatrix, 16 * sizeof(float));
+        renderer->queueTransform = renderer->numQueueTransforms++;
+    }
+    item.transform = renderer->queueTransform;
+
+    // clip w of the object origin, so each program is drawn front to back
+    float depth  = renderer->queueTransforms[item.transform * 16 + 15] / renderer->cullFar;
+    int   bucket = depth <= 0.0f ? 0 : depth >= 1.0f ? RVX_DEPTH_BUCKETS - 1 : (int)(depth * (RVX_DEPTH_BUCKETS - 1));
+
+    // models first, edges are drawn over them
+    uint64_t slot = permutation & (RVX_SHADER_EDGES | RVX_SHADER_INSTANCED);
+    slot          = ((slot & RVX_SHADER_EDGES) << 1) | ((slot & RVX_SHADER_INSTANCED) >> 1);
+
+    // key bits: 63 blended, 60-61 slot, 48-59 depth bucket, 32-47 VAO, 0-31 submission order,
+    // blended draws come after every opaque one in submission order, so nearer ones never hide what is behind
+    // them from the depth test and the result matches rvx_submit_soft which never reorders
+    if(renderer->shaderFlags & RVX_SHADER_ALPHA)
+        item.key = ((uint64_t)1 << 63) | (uint64_t)renderer->queueLength;
+    else
+        item.key = (slot << 60) | ((uint64_t)bucket << 48) | ((uint64_t)(vao & 0xFFFF) << 32) | (uint64_t)renderer->queueLength;
+
+    if(renderer->queueLength == renderer->queueCapacity)
+    {
+        renderer->queueCapacity = rvx_grow_capacity(renderer->queueCapacity, renderer->queueLength + 1);
+        renderer->queue         = (RVX_DRAW_ITEM*)realloc(renderer->queue, renderer->queueCapacity * sizeof(RVX_DRAW_ITEM));
+        if(renderer->queue == NULL)
+            abort();
+    }
+    renderer->queue[renderer->queueLength++] = item;
+}
+
+static int rvx_compare_draw_items(const void* a, const void* b)
+{
+    uint64_t ka = ((const RVX_DRAW_ITEM*)a)->key;
+    uint64_t kb = ((const RVX_DRAW_ITEM*)b)->key;
+    return ka < kb ? -1 : ka > kb ? 1 : 0;
+}
+
+void rvx_renderer_flush(RVX_RENDERER* renderer)
+{
+    RVX_CAPTURE(rvx_capture_renderer(RVX_CAPTURE_FLUSH, renderer));
+    if(renderer->soft != NULL)
+    {
+        rvx_soft_flush(renderer);
+        renderer->instanceBufferSize = 0;
+        return;
+    }
+
+    if(renderer->queueLength > 0)
+    {
+        if(renderer->instanceBufferSize > 0)
+        {
+            renderer->instanceStreamBase =
+                rvx_stream_write(renderer->instanceStream, renderer->instanceBuffer, renderer->instanceBufferSize);
+            renderer->uploadedBytes += renderer->instanceBufferSize;
+        }
+
+        qsort(renderer->queue, renderer->queueLength, sizeof(RVX_DRAW_ITEM), rvx_compare_draw_items);
+
+        int transform = -1;
+        for(int i = 0; i < renderer->queueLength; i++)
+        {
+            const RVX_DRAW_ITEM* item = renderer->queue + i;
+            if(item->transform != transform)
+            {
+                transform = item->transform;
+                rvx_upload_view(renderer, renderer->queueTransforms + transform * 16, NULL);
+            }
+            rvx_execute_item(renderer, item);
+        }
+
+        // leave the caller's transform in place for whatever comes next
+        if(memcmp(renderer->queueTransforms + transform * 16, renderer->transformMatrix, 16 * sizeof(float)) != 0)
+            rvx_upload_view(renderer, renderer->transformMatrix, NULL);
+    }
+
+    renderer->queueLength        = 0;
+    renderer->numQueueTransforms = 0;
+    renderer->queueTransform     = -1;
+    renderer->instanceBufferSize = 0;
+}
+
+static void rvx_bind_blocks(GLuint program)
+{
+    GLuint index = glGetUniformBlockIndex(program, "RvxView");
+    if(index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, index, RVX_VIEW_BLOCK_BINDING);
+    index = glGetUniformBlockIndex(program, "RvxPalette");
+    if(index != GL_INVALID_INDEX)
+        glUniformBlockBinding(program, index, RVX_PALETTE_BLOCK_BINDING);
+}
+
+// vertex range of an area, the whole model for area 0, returns 0 if the area does not exist
+static int rvx_model_area_range(RVX_MODEL* model, int area, int* first, int* count)
+{
+    if(area == 0 || model->numAreas == 0)
+    {
+        *first = 0;
+        *count = model->numVoxels * 6;
+        return 1;
+    }
+
+    for(int a = 0; a < model->numAreas; a++)
+    {
+        if(model->areas[a].no == area)
+        {
+            *first = model->areas[a].start * 6;
+            *count = model->areas[a].len * 6;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// model uploads count towards the frame of the first renderer that draws them
+static void rvx_charge_uploads(RVX_RENDERER* renderer, RVX_MODEL* model)
+{
+    renderer->uploadedBytes += model->uploadedBytes;
+    model->uploadedBytes    = 0;
+}
+
+void rvx_model_render(RVX_RENDERER* renderer, RVX_MODEL* model, int area)
+{
+    RVX_CAPTURE(rvx_capture_draw(RVX_CAPTURE_RENDER, renderer, model, area));
+    int buffer_update_required = 0;
+    if(!model->bound)
+    {
+        RVX_NESTED(rvx_model_bind(renderer, model));
+    }
+    rvx_charge_uploads(renderer, model);
+
+    int first, count;
+    if(rvx_model_area_range(model, area, &first, &count) && count > 0)
+    {
+        if(renderer->soft != NULL)
+            rvx_submit_soft(renderer, 0, model, first, count, NULL, 0);
+        else
+            rvx_submit(renderer, 0, model->VAO, first, count, 0, -1);
+        renderer->counters.areasDrawn += area == 0 && model->numAreas > 0 ? model->numAreas : 1;
+    }
+    else
+    {
+        renderer->counters.areasCulled++;
+    }
+}
+
+// program binaries are not part of the GL 3.3 core API, entry points come from rvx_set_program_cache
+typedef void(APIENTRY* rvx_get_program_binary_func)(GLuint program, GLsizei bufSize, GLsizei* length, GLenum* binaryFormat, void* binary);
+typedef void(APIENTRY* rvx_program_binary_func)(GLuint program, GLenum binaryFormat, const void* binary, GLsizei length);
+typedef void(APIENTRY* rvx_program_parameteri_func)(GLuint program, GLenum pname, GLint value);
+typedef void(APIENTRY* rvx_max_shader_compiler_threads_func)(GLuint count);
+
+static char                                 s_programCacheDir[512];
+static int                                  s_programCacheReady  = 0;
+static uint64_t                             s_programCacheDriver = 0;
+static rvx_get_program_binary_func          s_glGetProgramBinary = NULL;
+static rvx_program_binary_func              s_glProgramBinary    = NULL;
+static rvx_program_parameteri_func          s_glProgramParameteri          = NULL;
+static rvx_max_shader_compiler_threads_func s_glMaxShaderCompilerThreads = NULL;
+
+void rvx_set_program_cache(const char* directory, rvx_proc_loader loader)
+{
+    s_programCacheDir[0]        = 0;
+    s_glGetProgramBinary         = NULL;
+    s_glProgramBinary            = NULL;
+    s_glProgramParameteri        = NULL;
+    s_glMaxShaderCompilerThreads = NULL;
+    if(loader == NULL)
+        return;
+
+    if(directory != NULL)
+        snprintf(s_programCacheDir, sizeof(s_programCacheDir), "%s", directory);
+
+    s_glGetProgramBinary  = (rvx_get_program_binary_func)loader("glGetProgramBinary");
+    s_glProgramBinary     = (rvx_program_binary_func)loader("glProgramBinary");
+    s_glProgramParameteri = (rvx_program_parameteri_func)loader("glProgramParameteri");
+    s_glMaxShaderCompilerThreads = (rvx_max_shader_compiler_threads_func)loader("glMaxShaderCompilerThreadsKHR");
+    if(s_glMaxShaderCompilerThreads == NULL)
+        s_glMaxShaderCompilerThreads = (rvx_max_shader_compiler_threads_func)loader("glMaxShaderCompilerThreadsARB");
+}
+
+static int rvx_has_extension(const char* name)
+{
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for(int e = 0; e < numExtensions; e++)
+    {
+        const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, e);
+        if(extension != NULL && strcmp(extension, name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+void rvx_set_debug_groups(rvx_proc_loader loader)
+{
+    // needs the context current, groups are only pushed when KHR_debug is there
+    s_glPushDebugGroup = NULL;
+    s_glPopDebugGroup  = NULL;
+    if(loader == NULL || !rvx_has_extension("GL_KHR_debug"))
+        return;
+
+    s_glPushDebugGroup = (rvx_push_debug_group_func)loader("glPushDebugGroup");
+    s_glPopDebugGroup  = (rvx_pop_debug_group_func)loader("glPopDebugGroup");
+    if(s_glPushDebugGroup == NULL || s_glPopDebugGroup == NULL)
+    {
+        s_glPushDebugGroup = (rvx_push_debug_group_func)loader("glPushDebugGroupKHR");
+        s_glPopDebugGroup  = (rvx_pop_debug_group_func)loader("glPopDebugGroupKHR");
+    }
+    if(s_glPushDebugGroup == NULL || s_glPopDebugGroup == NULL)
+    {
+        s_glPushDebugGroup = NULL;
+        s_glPopDebugGroup  = NULL;
+    }
+}
+
+static uint64_t rvx_hash_string(uint64_t hash, const char* str)
+{
+    // FNV-1a
+    while(str != NULL && *str)
+    {
+        hash ^= (uint8_t)*str++;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// checks what the current context supports, called once the context exists
+static void rvx_program_cache_init(void)
+{
+    if(s_glMaxShaderCompilerThreads != NULL &&
+       (rvx_has_extension("GL_KHR_parallel_shader_compile") || rvx_has_extension("GL_ARB_parallel_shader_compile")))
+    {
+        // let the driver pick the number of threads, programs are then linked in the background
+        s_glMaxShaderCompilerThreads(0xFFFFFFFF);
+    }
+
+    s_programCacheReady = 0;
+    if(s_programCacheDir[0] == 0 || s_glGetProgramBinary == NULL || s_glProgramBinary == NULL)
+        return;
+
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    while(glGetError() != GL_NO_ERROR)
+        numFormats = 0;
+    if(numFormats <= 0)
+        return;
+
+    s_programCacheDriver = rvx_hash_string(0xcbf29ce484222325ULL, (const char*)glGetString(GL_VENDOR));
+    s_programCacheDriver = rvx_hash_string(s_programCacheDriver, (const char*)glGetString(GL_RENDERER));
+    s_programCacheDriver = rvx_hash_string(s_programCacheDriver, (const char*)glGetString(GL_VERSION));
+    s_programCacheReady  = 1;
 }
 
-void rvx_model_populate_buffer(RVX_MODEL* model, Voxel* voxels, int modelVoxels, Color4 palette[256])
+static void rvx_program_cache_path(char* path, size_t size, const char* vertexSource, const char* fragmentSource, const char* defines)
 {
-    int oldBufferSize = 0;
-    if(model->buffer)
-        oldBufferSize = model->bufferSize;
+    uint64_t hash = rvx_hash_string(s_programCacheDriver, vertexSource);
+    hash          = rvx_hash_string(hash, fragmentSource);
+    hash          = rvx_hash_string(hash, defines);
+    snprintf(path, size, "%s/rvx-%016llx.bin", s_programCacheDir, (unsigned long long)hash);
+}
 
-    int oldEdgeBufferSize = 0;
-    if(model->edgeBuffer)
-        oldEdgeBufferSize = model->edgeBufferSize;
+static int rvx_program_cache_load(GLuint program, const char* vertexSource, const char* fragmentSource, const char* defines)
+{
+    char path[600];
+    rvx_program_cache_path(path, sizeof(path), vertexSource, fragmentSource, defines);
 
-    model->numVoxels      = modelVoxels;
-    model->modelLength    = modelVoxels * RVX_VOXEL_LENGTH;
-    model->bufferSize     = (modelVoxels)*RVX_VOXEL_SIZE;
-    model->edgeBufferSize = 0;
+    FILE* file = fopen(path, "rb");
+    if(file == NULL)
+        return 0;
 
-    // if we have edges, reserve buffer for them
-    if(model->numEdges > 0)
+    // magic, format, length
+    uint32_t header[3];
+    void*    binary = NULL;
+    if(fread(header, sizeof(header), 1, file) == 1 && header[0] == RVX_PROGRAM_CACHE_MAGIC && header[2] > 0)
     {
-        model->edgesLength = 0;
-        for(int e = 0; e < model->numEdges; e++)
+        binary = malloc(header[2]);
+        if(binary != NULL && fread(binary, header[2], 1, file) != 1)
         {
-            RVX_EDGE* edge     = model->edges + e;
-            int       edge_len = rvx_get_edge_length(edge);
-            model->edgesLength += edge_len;
-            model->edgeBufferSize += edge_len * RVX_EDGE_SIZE;
+            free(binary);
+            binary = NULL;
         }
     }
+    fclose(file);
+    if(binary == NULL)
+        return 0;
+
+    s_glProgramBinary(program, header[1], binary, header[2]);
+    free(binary);
+
+    // a driver update rejects old binaries, fall back to compiling
+    GLint success = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    while(glGetError() != GL_NO_ERROR)
+        success = 0;
+    return success;
+}
 
-    if(oldEdgeBufferSize != model->edgeBufferSize)
-    {
-        if(model->edgeBuffer)
-            free(model->edgeBuffer);
-
-        model->edgeBuffer = (float*)malloc(model->edgeBufferSize);
-    }
-
-    if(model->numEdges > 0)
-    {
-        float* vertexPtr = model->edgeBuffer;
-        for(int e = 0; e < model->numEdges; e++)
-        {
-            RVX_EDGE* edge = model->edges + e;
-            rvx_update_edge_buffer(edge, &vertexPtr, palette);
-        }
-    }
+static void rvx_program_cache_save(GLuint program, const char* vertexSource, const char* fragmentSource, const char* defines)
+{
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
 
-    // need new buffer?
-    if(oldBufferSize != model->bufferSize)
-    {
-        if(model->buffer)
-            free(model->buffer);
+    void* binary = malloc(length);
+    if(binary == NULL)
+        return;
 
-        model->buffer = (float*)malloc(model->bufferSize);
-    }
-    float* vertexPtr = model->buffer;
-    Voxel* vx        = voxels;
+    GLenum format = 0;
+    s_glGetProgramBinary(program, length, &length, &format, binary);
 
-    int min_x = 5000;
-    int max_x = 0;
-    int min_y = 5000;
-    int max_y = 0;
+    char path[600];
+    rvx_program_cache_path(path, sizeof(path), vertexSource, fragmentSource, defines);
 
-    for(int v = 0; v < modelVoxels; v++)
+    FILE* file = fopen(path, "wb");
+    if(file != NULL)
     {
-        if(vx->sx < min_x)
-            min_x = vx->sx;
-        if(vx->ex > max_x)
-            max_x = vx->ex;
-        if(vx->y < min_y)
-            min_y = vx->y;
-        if(vx->y > max_y)
-            max_y = vx->y;
-        rvx_emit_voxel(vx, palette + vx->colorIndex, &vertexPtr);
-        vx++;
+        uint32_t header[3] = {RVX_PROGRAM_CACHE_MAGIC, format, (uint32_t)length};
+        fwrite(header, sizeof(header), 1, file);
+        fwrite(binary, length, 1, file);
+        fclose(file);
     }
+    free(binary);
 }
 
-RVX_MODEL* rvx_model_new()
+static void rvx_shader_source(GLuint shader, const char* source, const char* defines)
 {
-    RVX_MODEL* model = (RVX_MODEL*)malloc(sizeof(RVX_MODEL));
-    if(model == NULL)
-        abort();
+    // defines go right after the #version line
+    const char* body = strchr(source, '\n');
+    body             = body != NULL ? body + 1 : source;
 
-    model->loaded         = 1;
-    model->bound          = 0;
-    model->numVoxels      = 0;
-    model->buffer         = NULL;
-    model->bufferSize     = 0;
-    model->areas          = NULL;
-    model->numAreas       = 0;
-    model->modelLength    = 0;
-    model->numEdges       = 0;
-    model->edges          = NULL;
-    model->edgesLength    = 0;
-    model->edgeBufferSize = 0;
-    model->edgeBuffer     = NULL;
-    return model;
+    const char* strings[3] = {source, defines, body};
+    GLint       lengths[3] = {(GLint)(body - source), -1, -1};
+    glShaderSource(shader, 3, strings, lengths);
 }
 
-void rvx_model_free(RVX_MODEL* model)
+// loads a cached binary or issues compile and link without waiting for the result, see rvx_program_finish
+static GLuint rvx_program_start(const char* vertexSource, const char* fragmentSource, const char* defines)
 {
-    if(model->buffer != NULL)
-        free(model->buffer);
-    if(model->areas != NULL)
-        free(model->areas);
-    if(model->edges != NULL)
-        free(model->edges);
+    GLuint program = glCreateProgram();
+    if(s_programCacheReady)
+    {
+        if(rvx_program_cache_load(program, vertexSource, fragmentSource, defines))
+            return program;
 
-    free(model);
-}
+        glDeleteProgram(program);
+        program = glCreateProgram();
+    }
 
-void rvx_model_bind(RVX_RENDERER* renderer, RVX_MODEL* model)
-{
-    if(model->bound)
-        return;
+    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+    rvx_shader_source(vertexShader, vertexSource, defines);
+    glCompileShader(vertexShader);
 
-    glGenVertexArrays(1, &model->VAO);
-    glGenBuffers(1, &model->VBO);
+    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+    rvx_shader_source(fragmentShader, fragmentSource, defines);
+    glCompileShader(fragmentShader);
 
-    glBindVertexArray(model->VAO);
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, fragmentShader);
+    if(s_programCacheReady && s_glProgramParameteri != NULL)
+        s_glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program);
 
-    glBindBuffer(GL_ARRAY_BUFFER, model->VBO);
-    glBufferData(GL_ARRAY_BUFFER, model->bufferSize, model->buffer, GL_STATIC_DRAW);
+    return program;
+}
 
-    // position attribute
-    glVertexAttribPointer(0, 4, GL_SHORT, GL_FALSE, 6 * sizeof(short), (void*)0);
-    glEnableVertexAttribArray(0);
-    // color attribute
-    glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 6 * sizeof(short), (void*)(4 * sizeof(short)));
-    glEnableVertexAttribArray(1);
+static GLuint rvx_program_finish(GLuint program, const char* vertexSource, const char* fragmentSource, const char* defines)
+{
+    // no attached shaders means the program came from the cache
+    GLuint  shaders[2];
+    GLsizei numShaders = 0;
+    glGetAttachedShaders(program, 2, &numShaders, shaders);
 
-    // edges
-    if(model->numEdges > 0)
+    int  success;
+    char infoLog[512];
+    for(int s = 0; s < numShaders; s++)
+    {
+        // check for shader compile errors
+        glGetShaderiv(shaders[s], GL_COMPILE_STATUS, &success);
+        if(!success)
+        {
+            glGetShaderInfoLog(shaders[s], 512, NULL, infoLog);
+            rvx_error("Shader compilation failed!\nMessage: %s", infoLog);
+            exit(EXIT_FAILURE);
+        }
+    }
+    // check for linking errors
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if(!success)
+    {
+        glGetProgramInfoLog(program, 512, NULL, infoLog);
+        rvx_error("Shader compilation failed!\nMessage: %s", infoLog);
+        exit(EXIT_FAILURE);
+    }
+    for(int s = 0; s < numShaders; s++)
     {
-        // buffers
-        glGenVertexArrays(1, &model->edgeVAO);
-        glGenBuffers(1, &model->edgeVBO);
+        glDetachShader(program, shaders[s]);
+        glDeleteShader(shaders[s]);
+    }
+
+    if(numShaders > 0 && s_programCacheReady)
+        rvx_program_cache_save(program, vertexSource, fragmentSource, defines);
 
-        glBindVertexArray(model->edgeVAO);
+    return program;
+}
 
-        glBindBuffer(GL_ARRAY_BUFFER, model->edgeVBO);
+// edge permutations take the "edgeVertex" source so it can still be replaced on its own
+static const char* rvx_renderer_vertex_source(RVX_RENDERER* renderer, int permutation)
+{
+    return *rvx_get_shader_source(renderer->backend, (permutation & RVX_SHADER_EDGES) ? "edgeVertex" : "rvxVertex");
+}
 
-        glBufferData(GL_ARRAY_BUFFER, model->edgeBufferSize, model->edgeBuffer, GL_DYNAMIC_DRAW);
+static void rvx_renderer_start_program(RVX_RENDERER* renderer, int permutation)
+{
+    char defines[RVX_SHADER_DEFINES_SIZE];
+    rvx_get_shader_defines(permutation, defines, sizeof(defines));
 
-        // position attribute
-        glVertexAttribPointer(0, 4, GL_SHORT, GL_FALSE, 8 * sizeof(short), (void*)0);
-        glEnableVertexAttribArray(0);
-        // color attribute
-        glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 8 * sizeof(short), (void*)(4 * sizeof(short)));
-        glEnableVertexAttribArray(1);
-        // edge attributes
-        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_FALSE, 8 * sizeof(short), (void*)(6 * sizeof(short)));
-        glEnableVertexAttribArray(2);
-    }
-    model->bound = 1;
+    renderer->programs[permutation] = rvx_program_start(
+        rvx_renderer_vertex_source(renderer, permutation), *rvx_get_shader_source(renderer->backend, "rvxFragment"), defines);
 }
 
-void rvx_model_unbind(RVX_MODEL* model)
+static void rvx_renderer_finish_program(RVX_RENDERER* renderer, int permutation)
 {
-    if(model->bound)
+    char defines[RVX_SHADER_DEFINES_SIZE];
+    rvx_get_shader_defines(permutation, defines, sizeof(defines));
+
+    rvx_program_finish(renderer->programs[permutation],
+                       rvx_renderer_vertex_source(renderer, permutation),
+                       *rvx_get_shader_source(renderer->backend, "rvxFragment"),
+                       defines);
+    rvx_bind_blocks(renderer->programs[permutation]);
+}
+
+GLuint rvx_renderer_program(RVX_RENDERER* renderer, int permutation)
+{
+    permutation &= RVX_SHADER_VARIANTS - 1;
+    if(renderer->programs[permutation] == 0 && renderer->soft == NULL)
     {
-        glDeleteVertexArrays(1, &model->VAO);
-        glDeleteBuffers(1, &model->VBO);
-        if(model->numEdges > 0)
-        {
-            glDeleteVertexArrays(1, &model->edgeVAO);
-            glDeleteBuffers(1, &model->edgeVBO);
-        }
-        model->bound = 0;
+        rvx_renderer_start_program(renderer, permutation);
+        rvx_renderer_finish_program(renderer, permutation);
     }
+    return renderer->programs[permutation];
 }
 
-void rvx_model_render(RVX_RENDERER* renderer, RVX_MODEL* model, int area)
+void rvx_renderer_warm(RVX_RENDERER* renderer, int shaderFlags)
 {
-    int buffer_update_required = 0;
-    if(!model->bound)
+    static const int geometry[] = {0, RVX_SHADER_INSTANCED, RVX_SHADER_EDGES, RVX_SHADER_EDGES | RVX_SHADER_INSTANCED};
+    int              started[sizeof(geometry) / sizeof(geometry[0])];
+    if(renderer->soft != NULL)
+        return;
+
+    // all missing programs are in flight before the first finish, like rvx_renderer_init
+    for(int g = 0; g < (int)(sizeof(geometry) / sizeof(geometry[0])); g++)
     {
-        rvx_model_bind(renderer, model);
+        int permutation = (geometry[g] | shaderFlags) & (RVX_SHADER_VARIANTS - 1);
+        started[g]      = renderer->programs[permutation] == 0;
+        if(started[g])
+            rvx_renderer_start_program(renderer, permutation);
     }
+    for(int g = 0; g < (int)(sizeof(geometry) / sizeof(geometry[0])); g++)
+    {
+        if(started[g])
+            rvx_renderer_finish_program(renderer, (geometry[g] | shaderFlags) & (RVX_SHADER_VARIANTS - 1));
+    }
+}
 
-    glBindVertexArray(model->VAO);
+void rvx_renderer_set_palette(RVX_RENDERER* renderer, Color4 palette[256])
+{
+    RVX_CAPTURE(rvx_capture_set_palette(renderer, palette));
 
-    if(area == 0 || model->numAreas == 0)
+    // std140 vec4 array
+    float colors[256 * 4];
+    for(int c = 0; c < 256; c++)
+    {
+        colors[c * 4 + 0]  = palette[c].r / 255.0f;
+        colors[c * 4 + 1]  = palette[c].g / 255.0f;
+        colors[c * 4 + 2]  = palette[c].b / 255.0f;
+        colors[c * 4 + 3]  = palette[c].a / 255.0f;
+        renderer->palette[c] = (palette[c].a << 24) + (palette[c].b << 16) + (palette[c].g << 8) + palette[c].r;
+    }
+    if(renderer->soft != NULL)
+        return;
+
+    if(renderer->paletteBuffer == 0)
     {
-        glDrawArrays(GL_TRIANGLES, 0, model->numVoxels * 6);
+        glGenBuffers(1, &renderer->paletteBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, renderer->paletteBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(colors), colors, GL_STATIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, RVX_PALETTE_BLOCK_BINDING, renderer->paletteBuffer);
     }
     else
     {
-        for(int a = 0; a < model->numAreas; a++)
-        {
-            if(model->areas[a].no == area)
-            {
-                glDrawArrays(GL_TRIANGLES, model->areas[a].start * 6, model->areas[a].len * 6);
-                break;
-            }
-        }
+        glBindBuffer(GL_UNIFORM_BUFFER, renderer->paletteBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(colors), colors);
     }
+    renderer->uploadedBytes += sizeof(colors);
 }
 
 RVX_RENDERER* rvx_renderer_init(const char* backend, float paletteMix)
@@ -331,11 +1536,35 @@ RVX_RENDERER* rvx_renderer_init(const char* backend, float paletteMix)
         return NULL;
 
     renderer->backend = backend;
-    renderer->rvxShaderProgram =
-        rvx_compile_shader(rvx_get_shader_source(renderer->backend, "rvxVertex"), rvx_get_shader_source(renderer->backend, "rvxFragment"));
+    renderer->soft    = strcmp(backend, rvx_backend_soft) == 0 ? rvx_soft_new() : NULL;
+
+    // all default programs are in flight before the first status check so drivers can compile them in parallel
+    memset(renderer->programs, 0, sizeof(renderer->programs));
+    memset(renderer->palette, 0, sizeof(renderer->palette));
+    renderer->shaderFlags   = 0;
+    renderer->savedBlend[0] = -1;
+    renderer->alpha         = 1.0f;
+    renderer->paletteBuffer = 0;
+    renderer->viewBuffer    = 0;
+    if(renderer->soft == NULL)
+    {
+        rvx_program_cache_init();
+        rvx_renderer_start_program(renderer, 0);
+        rvx_renderer_start_program(renderer, RVX_SHADER_INSTANCED);
+
+        glGenBuffers(1, &renderer->viewBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, renderer->viewBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, RVX_VIEW_BLOCK_SIZE, NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, RVX_VIEW_BLOCK_BINDING, renderer->viewBuffer);
+    }
 
-    renderer->viewLocation  = glGetUniformLocation(renderer->rvxShaderProgram, "view");
-    renderer->alphaLocation = glGetUniformLocation(renderer->rvxShaderProgram, "alpha");
+    renderer->instanceStream          = renderer->soft == NULL ? rvx_stream_new(RVX_STREAM_REGION_SIZE) : NULL;
+    renderer->instanceStreamBase      = 0;
+    renderer->instanceBuffer          = NULL;
+    renderer->instanceBufferSize      = 0;
+    renderer->instanceBufferCapacity  = 0;
+    renderer->sortedInstances         = NULL;
+    renderer->sortedInstancesCapacity = 0;
 
     renderer->aspectW      = 320;
     renderer->aspectH      = 168;
@@ -346,29 +1575,108 @@ RVX_RENDERER* rvx_renderer_init(const char* backend, float paletteMix)
     renderer->renderWidth  = 1280;
     renderer->renderHeight = 672;
 
-    rvx_renderer_init_edges(renderer);
+    rvx_renderer_invalidate_state(renderer);
+    memset(&renderer->counters, 0, sizeof(RVX_COUNTERS));
+
+    renderer->timing      = 0;
+    renderer->frame       = 0;
+    renderer->currentPass = -1;
+    renderer->timerFrame  = 0;
+    memset(renderer->timerFrames, 0, sizeof(renderer->timerFrames));
+    memset(&renderer->stats, 0, sizeof(RVX_STATS));
+    renderer->stats.gpuFrame = -1;
+    renderer->uploadedBytes  = 0;
+#ifndef EMSCRIPTEN
+    for(int f = 0; f < RVX_TIMER_FRAMES && renderer->soft == NULL; f++)
+        glGenQueries(RVX_TIMER_QUERIES, renderer->timerFrames[f].queries);
+#endif
+
+    mat4 identity;
+    glm_mat4_identity(identity);
+    memcpy(renderer->viewMatrix, identity, 16 * sizeof(float));
+    memcpy(renderer->transformMatrix, identity, 16 * sizeof(float));
+    renderer->deferred                = 0;
+    renderer->queue                   = NULL;
+    renderer->queueLength             = 0;
+    renderer->queueCapacity           = 0;
+    renderer->queueTransforms         = NULL;
+    renderer->numQueueTransforms      = 0;
+    renderer->queueTransformsCapacity = 0;
+    renderer->queueTransform          = -1;
+
+    if(renderer->soft == NULL)
+    {
+        rvx_renderer_init_edges(renderer);
+
+        rvx_renderer_finish_program(renderer, 0);
+        rvx_renderer_finish_program(renderer, RVX_SHADER_INSTANCED);
+    }
 
     return renderer;
 }
 
 void rvx_renderer_init_edges(RVX_RENDERER* renderer)
 {
-    renderer->edgeShaderProgram =
-        rvx_compile_shader(rvx_get_shader_source(renderer->backend, "edgeVertex"), rvx_get_shader_source(renderer->backend, "rvxFragment"));
+    if(renderer->soft != NULL)
+        return;
+
+    rvx_renderer_start_program(renderer, RVX_SHADER_EDGES);
+    rvx_renderer_start_program(renderer, RVX_SHADER_EDGES | RVX_SHADER_INSTANCED);
+
+    rvx_renderer_finish_program(renderer, RVX_SHADER_EDGES);
+    rvx_renderer_finish_program(renderer, RVX_SHADER_EDGES | RVX_SHADER_INSTANCED);
+}
+
+void rvx_renderer_stats(RVX_RENDERER* renderer, RVX_STATS* stats)
+{
+    *stats          = renderer->stats;
+    stats->counters = renderer->counters;
+    stats->frame    = renderer->frame;
+}
 
-    renderer->edgeViewLocation  = glGetUniformLocation(renderer->edgeShaderProgram, "view");
-    renderer->edgeAlphaLocation = glGetUniformLocation(renderer->edgeShaderProgram, "alpha");
+void rvx_renderer_invalidate_state(RVX_RENDERER* renderer)
+{
+    // next program and VAO are always bound, call after touching GL state outside rvx
+    renderer->currentProgram = RVX_STATE_UNKNOWN;
+    renderer->currentVAO     = RVX_STATE_UNKNOWN;
 }
 
 void rvx_renderer_free(RVX_RENDERER* renderer)
 {
-    glDeleteProgram(renderer->rvxShaderProgram);
-    glDeleteProgram(renderer->edgeShaderProgram);
+    if(renderer->soft != NULL)
+    {
+        rvx_soft_free(renderer->soft);
+    }
+    else
+    {
+        for(int p = 0; p < RVX_SHADER_VARIANTS; p++)
+        {
+            if(renderer->programs[p] != 0)
+                glDeleteProgram(renderer->programs[p]);
+        }
+        glDeleteBuffers(1, &renderer->viewBuffer);
+        if(renderer->paletteBuffer != 0)
+            glDeleteBuffers(1, &renderer->paletteBuffer);
+        rvx_stream_free(renderer->instanceStream);
+#ifndef EMSCRIPTEN
+        for(int f = 0; f < RVX_TIMER_FRAMES; f++)
+            glDeleteQueries(RVX_TIMER_QUERIES, renderer->timerFrames[f].queries);
+#endif
+    }
+    if(renderer->instanceBuffer != NULL)
+        free(renderer->instanceBuffer);
+    if(renderer->sortedInstances != NULL)
+        free(renderer->sortedInstances);
+    if(renderer->queue != NULL)
+        free(renderer->queue);
+    if(renderer->queueTransforms != NULL)
+        free(renderer->queueTransforms);
     free(renderer);
 }
 
 void rvx_renderer_translate(RVX_RENDERER* renderer, float deltaX, float deltaY, float deltaZ)
 {
+    RVX_CAPTURE(rvx_capture_transform(RVX_CAPTURE_TRANSLATE, renderer, deltaX, deltaY, deltaZ, 1, 1, 1, 0));
     mat4 model;
     vec3 model_pos;
     model_pos[0] = deltaX;
@@ -380,15 +1688,13 @@ void rvx_renderer_translate(RVX_RENDERER* renderer, float deltaX, float deltaY,
     memcpy(view, renderer->viewMatrix, 16 * sizeof(float));
     glm_mat4_mul(view, model, view);
 
-    glUseProgram(renderer->edgeShaderProgram);
-    glUniformMatrix4fv(renderer->edgeViewLocation, 1, 0, (GLfloat*)&view);
-    glUseProgram(renderer->rvxShaderProgram);
-    glUniformMatrix4fv(renderer->viewLocation, 1, 0, (GLfloat*)&view);
+    rvx_set_transform(renderer, (float*)view, NULL);
 }
 
 void rvx_renderer_affine(
     RVX_RENDERER* renderer, float deltaX, float deltaY, float deltaZ, float scaleX, float scaleY, float scaleZ, int shadow)
 {
+    RVX_CAPTURE(rvx_capture_transform(RVX_CAPTURE_AFFINE, renderer, deltaX, deltaY, deltaZ, scaleX, scaleY, scaleZ, shadow));
     mat4 modelMat;
     vec3 translateVec = {deltaX, deltaY, deltaZ * 16.0f};
     glm_translate_make(modelMat, translateVec);
@@ -399,12 +1705,128 @@ void rvx_renderer_affine(
     memcpy(view, renderer->viewMatrix, 16 * sizeof(float));
     glm_mat4_mul(view, modelMat, view);
 
-    glUseProgram(renderer->rvxShaderProgram);
-    glUniformMatrix4fv(renderer->viewLocation, 1, GL_FALSE, (GLfloat*)&view);
+    rvx_set_transform(renderer, (float*)view, NULL);
+}
+
+static int rvx_compare_instances(const void* a, const void* b)
+{
+    const RVX_INSTANCE* ia = (const RVX_INSTANCE*)a;
+    const RVX_INSTANCE* ib = (const RVX_INSTANCE*)b;
+    if(ia->model != ib->model)
+        return (uintptr_t)ia->model < (uintptr_t)ib->model ? -1 : 1;
+    return ia->area - ib->area;
+}
+
+void rvx_renderer_draw_instances(RVX_RENDERER* renderer, const RVX_INSTANCE* instances, int numInstances)
+{
+    RVX_CAPTURE(rvx_capture_instances(renderer, instances, numInstances));
+    if(numInstances == 0)
+        return;
+
+    // group copies of the same model and area so each group is a single draw
+    if(numInstances > renderer->sortedInstancesCapacity)
+    {
+        renderer->sortedInstancesCapacity = rvx_grow_capacity(renderer->sortedInstancesCapacity, numInstances);
+        renderer->sortedInstances = (RVX_INSTANCE*)realloc(renderer->sortedInstances, renderer->sortedInstancesCapacity * sizeof(RVX_INSTANCE));
+        if(renderer->sortedInstances == NULL)
+            abort();
+    }
+    RVX_INSTANCE* sorted = renderer->sortedInstances;
+    memcpy(sorted, instances, numInstances * sizeof(RVX_INSTANCE));
+    qsort(sorted, numInstances, sizeof(RVX_INSTANCE), rvx_compare_instances);
+
+    // queued batches share one buffer streamed at flush, immediate ones reuse it from the start
+    int instanceBase       = renderer->deferred ? renderer->instanceBufferSize : 0;
+    int instanceBufferSize = instanceBase + numInstances * RVX_INSTANCE_SIZE;
+    if(instanceBufferSize > renderer->instanceBufferCapacity)
+    {
+        renderer->instanceBufferCapacity = rvx_grow_capacity(renderer->instanceBufferCapacity, instanceBufferSize);
+        renderer->instanceBuffer         = (float*)realloc(renderer->instanceBuffer, renderer->instanceBufferCapacity);
+        if(renderer->instanceBuffer == NULL)
+            abort();
+    }
+    renderer->instanceBufferSize = instanceBufferSize;
+
+    float* instancePtr = renderer->instanceBuffer + instanceBase / sizeof(float);
+    for(int i = 0; i < numInstances; i++)
+    {
+        *instancePtr++ = sorted[i].x;
+        *instancePtr++ = sorted[i].y;
+        *instancePtr++ = sorted[i].z * 16.0f;
+        *instancePtr++ = sorted[i].shadow ? 1.0f : 0.0f;
+        *instancePtr++ = sorted[i].scaleX;
+        *instancePtr++ = sorted[i].scaleY;
+        *instancePtr++ = sorted[i].scaleZ;
+        *instancePtr++ = 0.0f;
+    }
+    if(!renderer->deferred && renderer->soft == NULL)
+    {
+        renderer->instanceStreamBase = rvx_stream_write(renderer->instanceStream, renderer->instanceBuffer, instanceBufferSize);
+        renderer->uploadedBytes += instanceBufferSize;
+    }
+
+    int groupStart = 0;
+    while(groupStart < numInstances)
+    {
+        RVX_MODEL* model    = sorted[groupStart].model;
+        int        area     = sorted[groupStart].area;
+        int        groupEnd = groupStart + 1;
+        while(groupEnd < numInstances && sorted[groupEnd].model == model && sorted[groupEnd].area == area)
+            groupEnd++;
+
+        if(!model->bound)
+        {
+            RVX_NESTED(rvx_model_bind(renderer, model));
+        }
+        rvx_charge_uploads(renderer, model);
+
+        if(model->instanceVAO == 0 && renderer->soft == NULL)
+        {
+            glGenVertexArrays(1, &model->instanceVAO);
+            rvx_bind_vertex_array(renderer, model->instanceVAO);
+            glBindBuffer(GL_ARRAY_BUFFER, model->VBO);
+
+            // same layout as the model VAO
+            glVertexAttribPointer(0, 4, GL_SHORT, GL_FALSE, 6 * sizeof(short), (void*)0);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, 6 * sizeof(short), (void*)(4 * sizeof(short)));
+            glEnableVertexAttribArray(1);
+
+            // offset and scale, pointed at the group before each draw
+            glVertexAttribDivisor(2, 1);
+            glEnableVertexAttribArray(2);
+            glVertexAttribDivisor(3, 1);
+            glEnableVertexAttribArray(3);
+        }
+
+        int first, count;
+        int copies = groupEnd - groupStart;
+        if(rvx_model_area_range(model, area, &first, &count) && count > 0)
+        {
+            int instanceOffset = instanceBase + groupStart * RVX_INSTANCE_SIZE;
+            if(renderer->soft != NULL)
+            {
+                const float* offsets = renderer->instanceBuffer + instanceOffset / sizeof(float);
+                rvx_submit_soft(renderer, RVX_SHADER_INSTANCED, model, first, count, offsets, copies);
+            }
+            else
+            {
+                rvx_submit(renderer, RVX_SHADER_INSTANCED, model->instanceVAO, first, count, copies, instanceOffset);
+            }
+            renderer->counters.areasDrawn += (area == 0 && model->numAreas > 0 ? model->numAreas : 1) * copies;
+        }
+        else
+        {
+            renderer->counters.areasCulled += copies;
+        }
+
+        groupStart = groupEnd;
+    }
 }
 
 void rvx_renderer_view(RVX_RENDERER* renderer, SceneParams* params)
 {
+    RVX_CAPTURE(rvx_capture_view(renderer, params));
     mat4 matrix;
     glm_mat4_identity(matrix);
 
@@ -486,23 +1908,58 @@ void rvx_renderer_view(RVX_RENDERER* renderer, SceneParams* params)
     vec3 accuracy_scale = {1, 1, 0.0625f};
     glm_scale(matrix, accuracy_scale);
 
-    glUseProgram(renderer->edgeShaderProgram);
-    glUniformMatrix4fv(renderer->edgeViewLocation, 1, GL_FALSE, (GLfloat*)&matrix);
-    glUniform1f(renderer->edgeAlphaLocation, 1.0f);
-
-    glUseProgram(renderer->rvxShaderProgram);
-    glUniformMatrix4fv(renderer->viewLocation, 1, GL_FALSE, (GLfloat*)&matrix);
-    glUniform1f(renderer->alphaLocation, 1.0f);
+    rvx_set_transform(renderer, (float*)matrix, &renderer->alpha);
 
     memcpy(renderer->viewMatrix, matrix, 16 * sizeof(float));
 }
 
 void rvx_renderer_begin(RVX_RENDERER* renderer)
 {
-    glUseProgram(renderer->rvxShaderProgram);
+    RVX_CAPTURE(rvx_capture_renderer(RVX_CAPTURE_BEGIN, renderer));
+
+    // GL state may have been changed by the caller since the last frame
+    rvx_renderer_invalidate_state(renderer);
+    memset(&renderer->counters, 0, sizeof(RVX_COUNTERS));
+
+    // a frame runs until the next begin so passes the caller adds after rvx_renderer_end are included
+    RVX_NESTED(rvx_renderer_end_pass(renderer));
+    renderer->frame++;
+
+    renderer->queueLength        = 0;
+    renderer->numQueueTransforms = 0;
+    renderer->queueTransform     = -1;
+    renderer->instanceBufferSize = 0;
+
+    if(renderer->soft != NULL)
+    {
+        rvx_soft_begin(renderer);
+        return;
+    }
+
+    rvx_renderer_next_timer_frame(renderer);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, RVX_VIEW_BLOCK_BINDING, renderer->viewBuffer);
+    if(renderer->paletteBuffer != 0)
+        glBindBufferBase(GL_UNIFORM_BUFFER, RVX_PALETTE_BLOCK_BINDING, renderer->paletteBuffer);
+    rvx_use_program(renderer, rvx_renderer_program(renderer, renderer->shaderFlags));
     glClearStencil(0);
     glStencilMask(0xFF);
-    glEnable(GL_DEPTH_TEST);
+    if(renderer->shaderFlags & RVX_SHADER_OVERDRAW)
+    {
+        // every rasterized fragment is counted, hidden ones included, the caller's blending comes back at rvx_renderer_end
+        renderer->savedBlend[0] = glIsEnabled(GL_BLEND);
+        glGetIntegerv(GL_BLEND_SRC_RGB, &renderer->savedBlend[1]);
+        glGetIntegerv(GL_BLEND_DST_RGB, &renderer->savedBlend[2]);
+        glGetIntegerv(GL_BLEND_SRC_ALPHA, &renderer->savedBlend[3]);
+        glGetIntegerv(GL_BLEND_DST_ALPHA, &renderer->savedBlend[4]);
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+    }
+    else
+    {
+        glEnable(GL_DEPTH_TEST);
+    }
     glEnable(GL_CULL_FACE);
     glCullFace(GL_BACK);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
@@ -510,7 +1967,35 @@ void rvx_renderer_begin(RVX_RENDERER* renderer)
 
 void rvx_renderer_end(RVX_RENDERER* renderer)
 {
-    glUseProgram(0);
+    RVX_CAPTURE(rvx_capture_renderer(RVX_CAPTURE_END, renderer));
+    RVX_TRACE_BEGIN("rvx_renderer_end");
+    RVX_NESTED(rvx_renderer_flush(renderer));
+    RVX_NESTED(rvx_renderer_end_pass(renderer));
+
+    renderer->counters.bytesUploaded = renderer->uploadedBytes;
+    renderer->uploadedBytes          = 0;
+    if(renderer->soft != NULL)
+    {
+        rvx_soft_end(renderer);
+        RVX_TRACE_END("rvx_renderer_end");
+        return;
+    }
+
+    rvx_bind_vertex_array(renderer, 0);
+    rvx_use_program(renderer, 0);
+    if(renderer->savedBlend[0] >= 0)
+    {
+        if(renderer->savedBlend[0])
+            glEnable(GL_BLEND);
+        else
+            glDisable(GL_BLEND);
+        glBlendFuncSeparate(renderer->savedBlend[1], renderer->savedBlend[2], renderer->savedBlend[3], renderer->savedBlend[4]);
+        renderer->savedBlend[0] = -1;
+    }
+
+    if(rvx_stream_next_frame(renderer->instanceStream))
+        renderer->counters.streamWaits++;
+    RVX_TRACE_END("rvx_renderer_end");
 }
 
 void rvx_emit_voxel(Voxel* voxel, Color4* color, float** bufferPtr)
@@ -533,6 +2018,26 @@ void rvx_emit_voxel(Voxel* voxel, Color4* color, float** bufferPtr)
     qlVertex3f(startX, adjustedY, startZ, voxel->colorIndex, color, bufferPtr);
 }
 
+void rvx_emit_quads(const RVX_QUADS* quads, Color4 palette[256], float** bufferPtr)
+{
+    Voxel voxel;
+    voxel.ext = 0;
+    for(int r = 0; r < quads->numRows; r++)
+    {
+        const int end = r + 1 < quads->numRows ? (int)quads->rowStart[r + 1] : quads->numQuads;
+        voxel.y       = quads->rowY[r];
+        for(int q = quads->rowStart[r]; q < end; q++)
+        {
+            voxel.colorIndex = quads->colorIndex[q];
+            voxel.sx         = quads->sx[q];
+            voxel.ex         = quads->sx[q] + quads->width[q];
+            voxel.sz         = quads->sz[q];
+            voxel.ez         = quads->sz[q] + quads->height[q];
+            rvx_emit_voxel(&voxel, palette + voxel.colorIndex, bufferPtr);
+        }
+    }
+}
+
 void rvx_emit_voxelf(Voxelf* voxelf,
                      Color4* color,
                      uint8_t edgeWidth,
@@ -610,6 +2115,42 @@ void rvx_emit_voxelf(Voxelf* voxelf,
                bufferPtr);
 }
 
+int rvx_get_edge_rows(RVX_EDGE* edge)
+{
+    if(edge->ey < edge->sy || edge->spacing < 1)
+        return 0;
+    return (edge->ey - edge->sy) / edge->spacing + 1;
+}
+
+void rvx_update_edge_instance(RVX_EDGE* edge, float** bufferPtr, Color4 palette[256])
+{
+    short** sptr = (short**)bufferPtr;
+    // bounds
+    *(*sptr)++ = (short)edge->sx;
+    *(*sptr)++ = (short)edge->ex;
+    *(*sptr)++ = (short)edge->sy;
+    *(*sptr)++ = (short)edge->ey;
+    // params
+    *(*sptr)++ = (short)edge->sz;
+    *(*sptr)++ = (short)edge->ez;
+    *(*sptr)++ = (short)edge->spacing;
+    *(*sptr)++ = (short)edge->edge_dir;
+    // shape
+    *(*sptr)++ = (short)edge->edge_width;
+    *(*sptr)++ = (short)edge->edge_height;
+    // color indices for RVX_SHADER_PALETTE
+    *(*sptr)++ = (short)(edge->top_left_col | (edge->top_right_col << 8));
+    *(*sptr)++ = (short)(edge->bottom_left_col | (edge->bottom_right_col << 8));
+
+    // corner colors, alpha 0 hides the quad like in rvx_update_edge_buffer
+    Color4** cptr = (Color4**)sptr;
+    *(*cptr)++    = palette[edge->top_left_col];
+    *(*cptr)++    = palette[edge->top_right_col];
+    *(*cptr)++    = palette[edge->bottom_left_col];
+    *(*cptr)++    = palette[edge->bottom_right_col];
+    *bufferPtr    = (float*)*cptr;
+}
+
 int rvx_get_edge_length(RVX_EDGE* edge)
 {
     // how many voxels? two per Y (edge and inner)
@@ -717,67 +2258,54 @@ void rvx_update_edge_buffer(RVX_EDGE* edge, float** bufferPtr, Color4 palette[25
 
 void rvx_model_render_edges(RVX_RENDERER* renderer, RVX_MODEL* model)
 {
+    RVX_CAPTURE(rvx_capture_draw(RVX_CAPTURE_RENDER_EDGES, renderer, model, 0));
     if(!model->bound)
     {
-        rvx_model_bind(renderer, model);
+        RVX_NESTED(rvx_model_bind(renderer, model));
     }
+    rvx_charge_uploads(renderer, model);
 
     // recalculate and render
     if(model->numEdges == 0)
         return;
 
     // draw edges
-    glUseProgram(renderer->edgeShaderProgram);
-    glBindVertexArray(model->edgeVAO);
-    glDrawArrays(GL_TRIANGLES, 0, model->edgesLength);
-    glUseProgram(renderer->rvxShaderProgram);
-}
-
-int rvx_compile_shader(const char** vertexShaderSource, const char** fragmentShaderSource)
-{
-    // vertex shader
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-    // check for shader compile errors
-    int  success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if(!success)
-    {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        rvx_error("Shader compilation failed!\nMessage: %s", infoLog);
-        exit(EXIT_FAILURE);
-    }
-    // fragment shader
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    // check for shader compile errors
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if(!success)
+    if(!model->edgeInstancing)
     {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        rvx_error("Shader compilation failed!\nMessage: %s", infoLog);
-        exit(EXIT_FAILURE);
+        if(renderer->soft != NULL)
+            rvx_submit_soft(renderer, RVX_SHADER_EDGES, model, 0, model->edgesLength, NULL, 0);
+        else
+            rvx_submit(renderer, RVX_SHADER_EDGES, model->edgeVAO, 0, model->edgesLength, 0, -1);
+        return;
     }
-    // link shaders
-    int shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    // check for linking errors
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if(!success)
+
+    // one draw per bucket, each only as many rows as its longest edge
+    for(int b = 0; b < RVX_EDGE_BUCKETS; b++)
     {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        rvx_error("Shader compilation failed!\nMessage: %s", infoLog);
-        exit(EXIT_FAILURE);
+        int first     = model->edgeBucketStart[b];
+        int instances = model->edgeBucketStart[b + 1] - first;
+        int count     = model->edgeBucketRows[b] * RVX_EDGE_ROW_LENGTH;
+        if(instances == 0 || count == 0)
+            continue;
+
+        // the soft path takes the first record directly, GL through the bucket's VAO
+        if(renderer->soft != NULL)
+            rvx_submit_soft(renderer, RVX_SHADER_EDGES | RVX_SHADER_INSTANCED, model, first, count, NULL, instances);
+        else
+            rvx_submit(renderer,
+                       RVX_SHADER_EDGES | RVX_SHADER_INSTANCED,
+                       b == 0 ? model->edgeVAO : model->edgeBucketVAOs[b],
+                       0,
+                       count,
+                       instances,
+                       -1);
     }
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+}
 
-    return shaderProgram;
+int rvx_compile_shader(const char** vertexShaderSource, const char** fragmentShaderSource)
+{
+    return rvx_program_finish(
+        rvx_program_start(*vertexShaderSource, *fragmentShaderSource, ""), *vertexShaderSource, *fragmentShaderSource, "");
 }
 
 void rvx_error(const char* format_string, ...)
@@ -63,6 +63,22 @@ struct voxelf_struct
 
 typedef struct voxelf_struct Voxelf;
 
+// structure-of-arrays view of quads, consecutive quads sharing the same y are stored as rows
+struct rvx_quads_struct
+{
+    int             numQuads;
+    const uint8_t*  colorIndex;
+    const int16_t*  sx;
+    const uint16_t* width; // ex - sx
+    const int16_t*  sz;
+    const uint16_t* height; // ez - sz
+    int             numRows;
+    const int16_t*  rowY;
+    const uint32_t* rowStart; // index of the first quad in each row
+};
+
+typedef struct rvx_quads_struct RVX_QUADS;
+
 struct rvx_area_struct
 {
     int no;
@@ -75,6 +91,17 @@ struct rvx_area_struct
 
 typedef struct rvx_area_struct RVX_AREA;
 
+// quads of one area for rvx_model_populate_spans, either a voxel array or a structure-of-arrays view
+struct rvx_span_struct
+{
+    int              area_no;
+    const Voxel*     voxels;
+    int              count;
+    const RVX_QUADS* quads; // used instead of voxels/count when set
+};
+
+typedef struct rvx_span_struct RVX_SPAN;
+
 struct color_struct
 {
     unsigned char r;
@@ -108,6 +135,9 @@ struct rvx_edge_struct
 
 typedef struct rvx_edge_struct RVX_EDGE;
 
+// instanced edges are grouped by power-of-two row count, the last bucket takes everything longer
+#define RVX_EDGE_BUCKETS 8
+
 struct rvx_model_struct
 {
     int         loaded;
@@ -116,28 +146,163 @@ struct rvx_model_struct
     int         numVoxels;
     float*      buffer;
     int         bufferSize;
+    int         bufferCapacity;
     GLuint      VAO;
     GLuint      VBO;
+    int         gpuBufferCapacity;
     int         numAreas;
     RVX_AREA*   areas;
     int         numEdges;
     RVX_EDGE*   edges;
     float*      edgeBuffer;
     int         edgeBufferSize;
+    int         edgeBufferCapacity;
     GLuint      edgeVAO;
     GLuint      edgeVBO;
+    int         gpuEdgeBufferCapacity;
     int         modelLength;
-    int         edgesLength;
+    int         edgesLength; // vertices, per edge when instancing
+    int         edgeInstancing; // generate edge rows in the vertex shader, set before first upload
+    int         edgeRows; // max rows of any edge
+    int         edgeBucketStart[RVX_EDGE_BUCKETS + 1]; // first instance record of each bucket, then numEdges
+    int         edgeBucketRows[RVX_EDGE_BUCKETS]; // max rows of any edge in the bucket
+    GLuint      edgeBucketVAOs[RVX_EDGE_BUCKETS]; // instance attributes from the bucket's first record, bucket 0 uses edgeVAO
+    GLuint      instanceVAO; // model vertices plus the renderer's instance buffer
+    int64_t     uploadedBytes; // by rvx_model_upload since a renderer last drew the model
 };
 
 typedef struct rvx_model_struct RVX_MODEL;
 
+// memory held by a model, see rvx_model_memory
+struct rvx_model_memory_struct
+{
+    size_t vertexBytes; // CPU vertex data in use
+    size_t vertexCapacity;
+    size_t edgeBytes; // CPU edge vertices or instance records in use
+    size_t edgeCapacity;
+    size_t metadataBytes; // areas and edge descriptions
+    size_t gpuVertexBytes; // GPU buffer storage
+    size_t gpuEdgeBytes;
+};
+
+typedef struct rvx_model_memory_struct RVX_MODEL_MEMORY;
+
+// shader permutations, each combination is compiled into its own program
+#define RVX_SHADER_EDGES 1
+#define RVX_SHADER_INSTANCED 2
+#define RVX_SHADER_PALETTE 4 // colors from rvx_renderer_set_palette instead of the vertex data
+#define RVX_SHADER_ALPHA 8 // renderer->alpha instead of opaque
+#define RVX_SHADER_OVERDRAW 16 // every fragment adds 1 to red, rvx_renderer_begin sets up additive blending without depth test
+#define RVX_SHADER_VARIANTS 32
+
+// one copy of a model (or one of its areas) in an instanced batch
+struct rvx_instance_struct
+{
+    RVX_MODEL* model;
+    int        area; // 0 for the whole model
+    float      x;
+    float      y;
+    float      z; // voxels, as in rvx_renderer_translate
+    float      scaleX;
+    float      scaleY;
+    float      scaleZ;
+    int        shadow; // lay flat behind the model on its base plane and draw black
+};
+
+typedef struct rvx_instance_struct RVX_INSTANCE;
+
+// one queued draw, see RVX_RENDERER::deferred
+struct rvx_draw_item_struct
+{
+    uint64_t key; // blended, slot, depth bucket, VAO, submission order, see rvx_submit
+    GLuint   program;
+    GLuint   vao;
+    int      transform; // index into the queued transforms
+    int      first;
+    int      count;
+    int      instances; // 0 for a plain draw
+    int      instanceOffset; // bytes into the instance buffer for model batches, -1 otherwise
+    int      pass; // RVX_PASS_*
+};
+
+typedef struct rvx_draw_item_struct RVX_DRAW_ITEM;
+
+// work submitted and GL state changes issued and avoided by the renderer, reset by rvx_renderer_begin
+struct rvx_counters_struct
+{
+    int     drawCalls;
+    int     vertices; // instanced draws count every instance
+    int     triangles;
+    int     programSwitches;
+    int     programSwitchesSkipped;
+    int     vaoBinds;
+    int     vaoBindsSkipped;
+    int     viewUploads;
+    int     streamWaits; // frames that had to wait for the GPU to release a stream region
+    int64_t bytesUploaded; // by this renderer since its previous rvx_renderer_end, with model uploads it drew first, complete after rvx_renderer_end
+    int     areasDrawn; // per instance for batches
+    int     areasCulled; // requested but missing or empty, not submitted
+};
+
+typedef struct rvx_counters_struct RVX_COUNTERS;
+
+// GPU time is measured per pass, a pass is a run of draws of one kind
+#define RVX_PASS_MODELS 0
+#define RVX_PASS_INSTANCES 1
+#define RVX_PASS_EDGES 2
+#define RVX_PASS_USER 3 // caller's own work, see rvx_renderer_begin_pass
+#define RVX_PASSES 4
+
+#define RVX_TIMER_FRAMES 4 // frames in flight before timer queries are read back
+#define RVX_TIMER_QUERIES 64 // timestamps per frame
+
+// timestamps of one frame, read back RVX_TIMER_FRAMES frames later
+struct rvx_timer_frame_struct
+{
+    GLuint queries[RVX_TIMER_QUERIES];
+    int    passes[RVX_TIMER_QUERIES / 2]; // pass of each begin/end pair
+    int    numQueries;
+    int    frame;
+};
+
+typedef struct rvx_timer_frame_struct RVX_TIMER_FRAME;
+
+struct rvx_stats_struct
+{
+    RVX_COUNTERS counters; // current frame, complete after rvx_renderer_end
+    int          frame;
+    int          gpuFrame; // frame the GPU times belong to, -1 until the first one is read back
+    double       gpuTime[RVX_PASSES]; // milliseconds
+    double       gpuFrameTime; // first to last timestamp of the frame
+};
+
+typedef struct rvx_stats_struct RVX_STATS;
+
+#define RVX_STREAM_FRAMES 3
+
+// ring of per-frame regions in one buffer, a region is written again only after the GPU has passed its fence
+struct rvx_stream_struct
+{
+    GLuint buffer;
+    int    regionSize; // bytes per frame
+    int    region; // region written this frame
+    int    offset; // bytes used in the current region
+    GLsync fences[RVX_STREAM_FRAMES];
+};
+
+typedef struct rvx_stream_struct RVX_STREAM;
+
+typedef struct rvx_soft_struct RVX_SOFT; // see rvx_soft.h
+
 struct rvx_renderer_struct
 {
     // bindings
-    GLuint rvxShaderProgram;
-    GLuint viewLocation;
-    GLuint alphaLocation;
+    GLuint programs[RVX_SHADER_VARIANTS]; // by RVX_SHADER_* mask, built on first use (a hitch mid-frame) unless warmed
+    int    shaderFlags; // RVX_SHADER_PALETTE, RVX_SHADER_ALPHA or RVX_SHADER_OVERDRAW for every draw
+    GLint  savedBlend[5]; // GL_BLEND and its factors from before an overdraw frame, restored at its end, [0] -1 otherwise
+    float  alpha;
+    GLuint viewBuffer; // RvxView uniform block shared by all programs
+    GLuint paletteBuffer;
 
     // setup
     int   aspectW;
@@ -149,10 +314,14 @@ struct rvx_renderer_struct
     float camX;
     float camY;
 
-    // edges
-    GLuint edgeShaderProgram;
-    GLuint edgeViewLocation;
-    GLuint edgeAlphaLocation;
+    // instanced batches
+    RVX_STREAM*   instanceStream;
+    int           instanceStreamBase; // stream offset of instanceBuffer for the current draws
+    float*        instanceBuffer;
+    int           instanceBufferSize;
+    int           instanceBufferCapacity;
+    RVX_INSTANCE* sortedInstances;
+    int           sortedInstancesCapacity;
 
     int renderWidth;
     int renderHeight;
@@ -160,15 +329,45 @@ struct rvx_renderer_struct
     uint32_t palette[256];
 
     float       viewMatrix[16];
+    float       transformMatrix[16]; // view with the last translate/affine applied
     const char* backend;
+
+    // deferred render queue, draws are sorted by key and flushed at rvx_renderer_end
+    int            deferred;
+    RVX_DRAW_ITEM* queue;
+    int            queueLength;
+    int            queueCapacity;
+    float*         queueTransforms;
+    int            numQueueTransforms;
+    int            queueTransformsCapacity;
+    int            queueTransform; // transform of the next item, -1 until one is queued
+
+    // state cache, only valid between rvx_renderer_begin and rvx_renderer_end
+    GLuint       currentProgram;
+    GLuint       currentVAO;
+    RVX_COUNTERS counters;
+
+    // GPU timing, timestamps are taken around each pass when set
+    int             timing;
+    int             frame;
+    int             currentPass; // -1 outside a pass
+    int             timerFrame;
+    RVX_TIMER_FRAME timerFrames[RVX_TIMER_FRAMES];
+    RVX_STATS       stats;
+    int64_t         uploadedBytes; // since the previous rvx_renderer_end, see RVX_COUNTERS::bytesUploaded
+
+    RVX_SOFT* soft; // software rasterizer state for rvx_backend_soft, NULL for GL
 };
 
 typedef struct rvx_renderer_struct RVX_RENDERER;
 
 extern const char* rvx_backend_gles3;
 extern const char* rvx_backend_gl;
+extern const char* rvx_backend_soft; // CPU rasterizer, no GL context needed
 
 typedef int (*control_func)(int x, int y);
+typedef void* (*rvx_proc_loader)(const char* name);
+typedef void (*rvx_trace_func)(const char* name, int begin); // begin 1 opens a section, 0 closes the last one
 
 #ifdef __cplusplus
 extern "C"
@@ -179,17 +378,38 @@ extern "C"
     extern void          rvx_renderer_free(RVX_RENDERER* renderer);
     extern void          rvx_renderer_begin(RVX_RENDERER* renderer);
     extern void          rvx_renderer_end(RVX_RENDERER* renderer);
+    extern void          rvx_renderer_flush(RVX_RENDERER* renderer);
+
+    extern void rvx_renderer_begin_pass(RVX_RENDERER* renderer, int pass, const char* name);
+    extern void rvx_renderer_end_pass(RVX_RENDERER* renderer);
+    extern void rvx_renderer_stats(RVX_RENDERER* renderer, RVX_STATS* stats);
+    extern int  rvx_renderer_drain_timers(RVX_RENDERER* renderer, RVX_STATS* stats); // after the last frame and a glFinish, stats of the next frame still timed, 0 when none are left
 
     extern void rvx_renderer_init_edges(RVX_RENDERER* renderer);
+    extern void rvx_renderer_invalidate_state(RVX_RENDERER* renderer);
+    extern GLuint rvx_renderer_program(RVX_RENDERER* renderer, int permutation);
+    extern void   rvx_renderer_warm(RVX_RENDERER* renderer, int shaderFlags); // builds every geometry permutation with shaderFlags
+    extern void   rvx_renderer_set_palette(RVX_RENDERER* renderer, Color4 palette[256]);
 
     extern void rvx_renderer_view(RVX_RENDERER* renderer, SceneParams* params);
     extern void rvx_renderer_translate(RVX_RENDERER* renderer, float deltaX, float deltaY, float deltaZ);
     extern void rvx_renderer_affine(RVX_RENDERER* renderer, float deltaX, float deltaY, float deltaZ, float scaleX, float scaleY, float scaleZ, int shadow);
+    extern void rvx_renderer_draw_instances(RVX_RENDERER* renderer, const RVX_INSTANCE* instances, int numInstances);
+
+    extern RVX_STREAM* rvx_stream_new(int regionSize);
+    extern void        rvx_stream_free(RVX_STREAM* stream);
+    extern int         rvx_stream_write(RVX_STREAM* stream, const void* data, int size);
+    extern int         rvx_stream_next_frame(RVX_STREAM* stream);
 
     extern RVX_MODEL* rvx_model_new();
     extern void       rvx_model_free(RVX_MODEL* model);
+    extern void       rvx_model_swap_buffers(RVX_MODEL* model, RVX_MODEL* other);
+    extern void       rvx_model_memory(const RVX_MODEL* model, RVX_MODEL_MEMORY* memory);
     extern void       rvx_model_populate_buffer(RVX_MODEL* model, Voxel* voxels, int modelVoxels, Color4 palette[256]);
+    extern void       rvx_model_populate_spans(RVX_MODEL* model, const RVX_SPAN* spans, int numSpans, Color4 palette[256]);
+    extern void       rvx_model_color_quads(RVX_MODEL* model);
     extern void       rvx_model_bind(RVX_RENDERER* renderer, RVX_MODEL* model);
+    extern void       rvx_model_upload(RVX_MODEL* model);
     extern void       rvx_model_render(RVX_RENDERER* renderer, RVX_MODEL* model, int area);
     extern void       rvx_model_render_edges(RVX_RENDERER* renderer, RVX_MODEL* model);
     extern void       rvx_model_unbind(RVX_MODEL* model);
@@ -208,6 +428,7 @@ extern "C"
                                   uint8_t voxelSide,
                                   float** vertexPtr);
     extern void        rvx_emit_voxel(Voxel* voxel, Color4* color, float** bufferPtr);
+    extern void        rvx_emit_quads(const RVX_QUADS* quads, Color4 palette[256], float** bufferPtr);
     extern void        rvx_emit_voxelf(Voxelf* voxelf,
                                        Color4* color,
                                        uint8_t edgeWidth,
@@ -219,8 +440,24 @@ extern "C"
 
     extern int  rvx_get_edge_length(RVX_EDGE* edge);
     extern void rvx_update_edge_buffer(RVX_EDGE* edge, float** bufferPtr, Color4 palette[256]);
-
-    extern int rvx_compile_shader(const char** vertexShaderSource, const char** fragmentShaderSource);
+    extern int  rvx_get_edge_rows(RVX_EDGE* edge);
+    extern void rvx_update_edge_instance(RVX_EDGE* edge, float** bufferPtr, Color4 palette[256]);
+
+    extern int  rvx_compile_shader(const char** vertexShaderSource, const char** fragmentShaderSource);
+    extern void rvx_set_program_cache(const char* directory, rvx_proc_loader loader);
+    extern void rvx_set_debug_groups(rvx_proc_loader loader);
+    extern void rvx_set_trace(rvx_trace_func trace); // before other threads call rvx, it is read unsynchronized
+
+    // records rvx calls and the data they are given for a number of frames, starting at the next rvx_renderer_begin,
+    // for offline replay with rvx-headless/rvx-replay, returns 0 if the file cannot be created
+    extern int  rvx_capture_begin(const char* path, int frames);
+    extern void rvx_capture_end(void); // stops early, the file is complete up to the last call
+    extern int  rvx_capture_active(void); // armed or recording
+
+    // rvx_backend_soft renderers only, pixels are RGBA rows top first at the size of the last rvx_renderer_begin
+    extern void rvx_soft_read_pixels(RVX_RENDERER* renderer, uint8_t* rgba);
+    extern void rvx_soft_set_threads(RVX_RENDERER* renderer, int threads); // 0 for one per core
+    extern void rvx_soft_set_clear_color(RVX_RENDERER* renderer, Color4 color);
 
     extern void rvx_check_glerror(const char* function);
     extern void rvx_error(const char* format_string, ...);
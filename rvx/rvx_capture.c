@@ -0,0 +1,474 @@
+/*
+    RVX Graphics Library
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvx_capture.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+static SRWLOCK s_captureLock = SRWLOCK_INIT;
+#define RVX_CAPTURE_LOCK() AcquireSRWLockExclusive(&s_captureLock)
+#define RVX_CAPTURE_UNLOCK() ReleaseSRWLockExclusive(&s_captureLock)
+#else
+#include <pthread.h>
+static pthread_mutex_t s_captureLock = PTHREAD_MUTEX_INITIALIZER;
+#define RVX_CAPTURE_LOCK() pthread_mutex_lock(&s_captureLock)
+#define RVX_CAPTURE_UNLOCK() pthread_mutex_unlock(&s_captureLock)
+#endif
+
+#define RVX_CAPTURE_IDLE 0
+#define RVX_CAPTURE_ARMED 1 // waiting for the next rvx_renderer_begin
+#define RVX_CAPTURE_RECORDING 2
+
+volatile int         rvx_capturing     = 0;
+RVX_THREAD_LOCAL int rvx_capture_depth = 0;
+
+// everything below is guarded by s_captureLock, populates may come from other threads than the draws
+static FILE*               s_captureFile  = NULL;
+static int                 s_captureState = RVX_CAPTURE_IDLE;
+static int                 s_captureFrames; // left to record
+static const RVX_RENDERER* s_captureRenderer; // the one whose frames are counted
+static const void**        s_captureModels       = NULL; // by id - 1, NULL once freed
+static int                 s_numCaptureModels    = 0;
+static const void**        s_captureRenderers    = NULL;
+static int                 s_numCaptureRenderers = 0;
+
+// the record being written, sent to the file in one piece
+static char* s_record         = NULL;
+static int   s_recordSize     = 0;
+static int   s_recordCapacity = 0;
+
+static void rvx_capture_put(const void* data, int size)
+{
+    if(size <= 0)
+        return;
+
+    if(s_recordSize + size > s_recordCapacity)
+    {
+        int capacity     = s_recordCapacity + s_recordCapacity / 2;
+        s_recordCapacity = capacity > s_recordSize + size ? capacity : s_recordSize + size;
+        s_record         = (char*)realloc(s_record, s_recordCapacity);
+        if(s_record == NULL)
+            abort();
+    }
+    memcpy(s_record + s_recordSize, data, size);
+    s_recordSize += size;
+}
+
+static void rvx_capture_write(int type)
+{
+    RVX_CAPTURE_RECORD record;
+    record.type = type;
+    record.size = s_recordSize;
+    fwrite(&record, sizeof(record), 1, s_captureFile);
+    fwrite(s_record, 1, s_recordSize, s_captureFile);
+    s_recordSize = 0;
+}
+
+static void rvx_capture_close(void)
+{
+    if(s_captureFile != NULL)
+        fclose(s_captureFile);
+
+    free(s_captureModels);
+    free(s_captureRenderers);
+    free(s_record);
+    s_captureFile         = NULL;
+    s_captureModels       = NULL;
+    s_numCaptureModels    = 0;
+    s_captureRenderers    = NULL;
+    s_numCaptureRenderers = 0;
+    s_record              = NULL;
+    s_recordSize          = 0;
+    s_recordCapacity      = 0;
+    s_captureState        = RVX_CAPTURE_IDLE;
+    rvx_capturing         = 0;
+}
+
+static int rvx_capture_find(const void** objects, int numObjects, const void* object)
+{
+    for(int o = 0; o < numObjects; o++)
+    {
+        if(objects[o] == object)
+            return o + 1;
+    }
+    return 0;
+}
+
+static int rvx_capture_add(const void*** objects, int* numObjects, const void* object)
+{
+    *objects = (const void**)realloc((void*)*objects, (*numObjects + 1) * sizeof(void*));
+    if(*objects == NULL)
+        abort();
+    (*objects)[(*numObjects)++] = object;
+    return *numObjects;
+}
+
+// id of a model, the first time it is seen its whole CPU state is written so the replay can draw it without its history,
+// ids are looked up before a record is started as this writes one of its own
+static int rvx_capture_model_id(const RVX_MODEL* model)
+{
+    int id = rvx_capture_find(s_captureModels, s_numCaptureModels, model);
+    if(id != 0)
+        return id;
+
+    id = rvx_capture_add(&s_captureModels, &s_numCaptureModels, model);
+
+    RVX_CAPTURE_MODEL_STATE state;
+    memset(&state, 0, sizeof(state));
+    state.id             = id;
+    state.params         = model->params;
+    state.numVoxels      = model->numVoxels;
+    state.bufferSize     = model->buffer != NULL ? model->bufferSize : 0;
+    state.numAreas       = model->areas != NULL ? model->numAreas : 0;
+    state.numEdges       = model->edges != NULL ? model->numEdges : 0;
+    state.edgeBufferSize = model->edgeBuffer != NULL ? model->edgeBufferSize : 0;
+    state.modelLength    = model->modelLength;
+    state.edgesLength    = model->edgesLength;
+    state.edgeInstancing = model->edgeInstancing;
+    state.edgeRows       = model->edgeRows;
+    memcpy(state.edgeBucketStart, model->edgeBucketStart, sizeof(state.edgeBucketStart));
+    memcpy(state.edgeBucketRows, model->edgeBucketRows, sizeof(state.edgeBucketRows));
+
+    rvx_capture_put(&state, sizeof(state));
+    rvx_capture_put(model->buffer, state.bufferSize);
+    rvx_capture_put(model->areas, state.numAreas * sizeof(RVX_AREA));
+    rvx_capture_put(model->edges, state.numEdges * sizeof(RVX_EDGE));
+    rvx_capture_put(model->edgeBuffer, state.edgeBufferSize);
+    rvx_capture_write(RVX_CAPTURE_MODEL);
+    return id;
+}
+
+static int rvx_capture_renderer_id(const RVX_RENDERER* renderer)
+{
+    int id = rvx_capture_find(s_captureRenderers, s_numCaptureRenderers, renderer);
+    if(id != 0)
+        return id;
+
+    id = rvx_capture_add(&s_captureRenderers, &s_numCaptureRenderers, renderer);
+
+    RVX_CAPTURE_RENDERER_STATE state;
+    state.id         = id;
+    state.hasPalette = renderer->paletteBuffer != 0;
+    memcpy(state.palette, renderer->palette, sizeof(state.palette));
+    rvx_capture_put(&state, sizeof(state));
+    rvx_capture_write(RVX_CAPTURE_RENDERER);
+    return id;
+}
+
+static void rvx_capture_put_object(int id, int value)
+{
+    RVX_CAPTURE_OBJECT object;
+    object.id    = id;
+    object.value = value;
+    rvx_capture_put(&object, sizeof(object));
+}
+
+static void rvx_capture_put_state(const RVX_RENDERER* renderer, int id)
+{
+    RVX_CAPTURE_STATE state;
+    state.renderer     = id;
+    state.camX         = renderer->camX;
+    state.camY         = renderer->camY;
+    state.alpha        = renderer->alpha;
+    state.cullFar      = renderer->cullFar;
+    state.cullNear     = renderer->cullNear;
+    state.aspectW      = renderer->aspectW;
+    state.aspectH      = renderer->aspectH;
+    state.shaderFlags  = renderer->shaderFlags;
+    state.deferred     = renderer->deferred;
+    state.renderWidth  = renderer->renderWidth;
+    state.renderHeight = renderer->renderHeight;
+    if(renderer->soft != NULL)
+    {
+        // software renderers draw the whole render size
+        state.viewport[0] = 0;
+        state.viewport[1] = 0;
+        state.viewport[2] = renderer->renderWidth;
+        state.viewport[3] = renderer->renderHeight;
+    }
+    else
+    {
+        glGetIntegerv(GL_VIEWPORT, state.viewport);
+    }
+    rvx_capture_put(&state, sizeof(state));
+}
+
+static void rvx_capture_put_populate(RVX_MODEL* model, int count, const Color4 palette[256])
+{
+    // fields the caller filled in before the call
+    RVX_CAPTURE_POPULATE populate;
+    populate.model          = rvx_capture_model_id(model);
+    populate.params         = model->params;
+    populate.edgeInstancing = model->edgeInstancing;
+    populate.numEdges       = model->edges != NULL ? model->numEdges : 0;
+    populate.count          = count;
+    rvx_capture_put(&populate, sizeof(populate));
+    rvx_capture_put(model->edges, populate.numEdges * sizeof(RVX_EDGE));
+    rvx_capture_put(palette, 256 * sizeof(Color4));
+}
+
+int rvx_capture_begin(const char* path, int frames)
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState != RVX_CAPTURE_IDLE)
+        rvx_capture_close();
+
+    s_captureFile = fopen(path, "wb");
+    int opened    = s_captureFile != NULL;
+    if(opened)
+    {
+        RVX_CAPTURE_HEADER header;
+        header.magic           = RVX_CAPTURE_MAGIC;
+        header.version         = RVX_CAPTURE_VERSION;
+        header.frames          = frames;
+        header.sceneParamsSize = sizeof(SceneParams);
+        header.voxelSize       = sizeof(Voxel);
+        header.areaSize        = sizeof(RVX_AREA);
+        header.edgeSize        = sizeof(RVX_EDGE);
+        fwrite(&header, sizeof(header), 1, s_captureFile);
+
+        s_captureFrames = frames;
+        s_captureState  = RVX_CAPTURE_ARMED;
+        rvx_capturing   = 1;
+    }
+    RVX_CAPTURE_UNLOCK();
+    return opened;
+}
+
+void rvx_capture_end(void)
+{
+    RVX_CAPTURE_LOCK();
+    rvx_capture_close();
+    RVX_CAPTURE_UNLOCK();
+}
+
+int rvx_capture_active(void)
+{
+    return rvx_capturing;
+}
+
+void rvx_capture_populate_buffer(RVX_MODEL* model, const Voxel* voxels, int modelVoxels, const Color4 palette[256])
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        rvx_capture_put_populate(model, modelVoxels, palette);
+        rvx_capture_put(voxels, modelVoxels * sizeof(Voxel));
+        rvx_capture_write(RVX_CAPTURE_POPULATE_BUFFER);
+    }
+    RVX_CAPTURE_UNLOCK();
+}
+
+void rvx_capture_populate_spans(RVX_MODEL* model, const RVX_SPAN* spans, int numSpans, const Color4 palette[256])
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        rvx_capture_put_populate(model, numSpans, palette);
+        for(int s = 0; s < numSpans; s++)
+        {
+            const RVX_QUADS* quads = spans[s].quads;
+            RVX_CAPTURE_SPAN span;
+            span.area_no  = spans[s].area_no;
+            span.count    = quads != NULL ? -1 : spans[s].count;
+            span.numQuads = quads != NULL ? quads->numQuads : 0;
+            span.numRows  = quads != NULL ? quads->numRows : 0;
+            rvx_capture_put(&span, sizeof(span));
+            if(quads == NULL)
+            {
+                rvx_capture_put(spans[s].voxels, span.count * sizeof(Voxel));
+                continue;
+            }
+
+            rvx_capture_put(quads->colorIndex, span.numQuads * sizeof(uint8_t));
+            rvx_capture_put(quads->sx, span.numQuads * sizeof(int16_t));
+            rvx_capture_put(quads->width, span.numQuads * sizeof(uint16_t));
+            rvx_capture_put(quads->sz, span.numQuads * sizeof(int16_t));
+            rvx_capture_put(quads->height, span.numQuads * sizeof(uint16_t));
+            rvx_capture_put(quads->rowY, span.numRows * sizeof(int16_t));
+            rvx_capture_put(quads->rowStart, span.numRows * sizeof(uint32_t));
+        }
+        rvx_capture_write(RVX_CAPTURE_POPULATE_SPANS);
+    }
+    RVX_CAPTURE_UNLOCK();
+}
+
+void rvx_capture_model(int type, RVX_MODEL* model)
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        int id = rvx_capture_find(s_captureModels, s_numCaptureModels, model);
+        if(type == RVX_CAPTURE_MODEL_FREE)
+        {
+            // the address may come back for a new model
+            if(id != 0)
+            {
+                s_captureModels[id - 1] = NULL;
+                rvx_capture_put_object(id, 0);
+                rvx_capture_write(type);
+            }
+        }
+        else
+        {
+            rvx_capture_put_object(id != 0 ? id : rvx_capture_model_id(model), 0);
+            rvx_capture_write(type);
+        }
+    }
+    RVX_CAPTURE_UNLOCK();
+}
+
+void rvx_capture_swap_buffers(RVX_MODEL* model, RVX_MODEL* other)
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        RVX_CAPTURE_SWAP swap;
+        swap.model = rvx_capture_model_id(model);
+        swap.other = rvx_capture_model_id(other);
+        rvx_capture_put(&swap, sizeof(swap));
+        rvx_capture_write(RVX_CAPTURE_SWAP_BUFFERS);
+    }
+    RVX_CAPTURE_UNLOCK();
+}
+
+void rvx_capture_draw(int type, RVX_RENDERER* renderer, RVX_MODEL* model, int area)
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        RVX_CAPTURE_DRAW draw;
+        draw.renderer = rvx_capture_renderer_id(renderer);
+        draw.model    = rvx_capture_model_id(model);
+        draw.area     = area;
+        rvx_capture_put(&draw, sizeof(draw));
+        rvx_capture_write(type);
+    }
+    RVX_CAPTURE_UNLOCK();
+}
+
+void rvx_capture_renderer(int type, RVX_RENDERER* renderer)
+{
+    RVX_CAPTURE_LOCK();
+    if(type == RVX_CAPTURE_BEGIN && s_captureState == RVX_CAPTURE_ARMED)
+    {
+        s_captureState    = RVX_CAPTURE_RECORDING;
+        s_captureRenderer = renderer;
+    }
+
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        int id = rvx_capture_renderer_id(renderer);
+        if(type == RVX_CAPTURE_BEGIN)
+            rvx_capture_put_state(renderer, id);
+        else
+            rvx_capture_put_object(id, 0);
+        rvx_capture_write(type);
+
+        if(type == RVX_CAPTURE_END && renderer == s_captureRenderer && --s_captureFrames <= 0)
+            rvx_capture_close();
+    }
+    RVX_CAPTURE_UNLOCK();
+}
+
+void rvx_capture_set_palette(RVX_RENDERER* renderer, const Color4 palette[256])
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        RVX_CAPTURE_PALETTE record;
+        record.renderer = rvx_capture_renderer_id(renderer);
+        memcpy(record.palette, palette, sizeof(record.palette));
+        rvx_capture_put(&record, sizeof(record));
+        rvx_capture_write(RVX_CAPTURE_SET_PALETTE);
+    }
+    RVX_CAPTURE_UNLOCK();
+}
+
+void rvx_capture_view(RVX_RENDERER* renderer, const SceneParams* params)
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        rvx_capture_put_state(renderer, rvx_capture_renderer_id(renderer));
+        rvx_capture_put(params, sizeof(SceneParams));
+        rvx_capture_write(RVX_CAPTURE_VIEW);
+    }
+    RVX_CAPTURE_UNLOCK();
+}
+
+void rvx_capture_begin_pass(RVX_RENDERER* renderer, int pass, const char* name)
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        RVX_CAPTURE_PASS record;
+        memset(&record, 0, sizeof(record));
+        record.renderer = rvx_capture_renderer_id(renderer);
+        record.pass     = pass;
+        if(name != NULL)
+            strncpy(record.name, name, RVX_CAPTURE_NAME_SIZE - 1);
+        rvx_capture_put(&record, sizeof(record));
+        rvx_capture_write(RVX_CAPTURE_BEGIN_PASS);
+    }
+    RVX_CAPTURE_UNLOCK();
+}
+
+void rvx_capture_transform(
+    int type, RVX_RENDERER* renderer, float deltaX, float deltaY, float deltaZ, float scaleX, float scaleY, float scaleZ, int shadow)
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        RVX_CAPTURE_TRANSFORM transform;
+        transform.renderer = rvx_capture_renderer_id(renderer);
+        transform.delta[0] = deltaX;
+        transform.delta[1] = deltaY;
+        transform.delta[2] = deltaZ;
+        transform.scale[0] = scaleX;
+        transform.scale[1] = scaleY;
+        transform.scale[2] = scaleZ;
+        transform.shadow   = shadow;
+        rvx_capture_put(&transform, sizeof(transform));
+        rvx_capture_write(type);
+    }
+    RVX_CAPTURE_UNLOCK();
+}
+
+void rvx_capture_instances(RVX_RENDERER* renderer, const RVX_INSTANCE* instances, int numInstances)
+{
+    RVX_CAPTURE_LOCK();
+    if(s_captureState == RVX_CAPTURE_RECORDING)
+    {
+        // ids first, a model seen for the first time writes its own record
+        int id = rvx_capture_renderer_id(renderer);
+        for(int i = 0; i < numInstances; i++)
+            rvx_capture_model_id(instances[i].model);
+
+        rvx_capture_put_object(id, numInstances);
+        for(int i = 0; i < numInstances; i++)
+        {
+            RVX_CAPTURE_INSTANCE instance;
+            instance.model       = rvx_capture_model_id(instances[i].model);
+            instance.area        = instances[i].area;
+            instance.position[0] = instances[i].x;
+            instance.position[1] = instances[i].y;
+            instance.position[2] = instances[i].z;
+            instance.scale[0]    = instances[i].scaleX;
+            instance.scale[1]    = instances[i].scaleY;
+            instance.scale[2]    = instances[i].scaleZ;
+            instance.shadow      = instances[i].shadow;
+            rvx_capture_put(&instance, sizeof(instance));
+        }
+        rvx_capture_write(RVX_CAPTURE_DRAW_INSTANCES);
+    }
+    RVX_CAPTURE_UNLOCK();
+}
@@ -0,0 +1,234 @@
+/*
+    RVX Graphics Library
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#ifndef RVX_CAPTURE_H
+#define RVX_CAPTURE_H
+
+#include "rvx.h"
+
+// capture files are a header followed by records, each a type and size then its payload, written in native byte
+// order and struct layout so they replay on the platform and build they were recorded with, see rvx_capture_begin
+
+#define RVX_CAPTURE_MAGIC 0x43585652 /* RVXC */
+#define RVX_CAPTURE_VERSION 3
+#define RVX_CAPTURE_NAME_SIZE 64
+
+// record types, payloads are the structs below followed by the arrays listed
+#define RVX_CAPTURE_RENDERER 1 // rvx_capture_renderer, first time a renderer is seen
+#define RVX_CAPTURE_MODEL 2 // rvx_capture_model, buffer, areas, edges and edge buffer, first time a model is seen
+#define RVX_CAPTURE_MODEL_FREE 3 // rvx_capture_object
+#define RVX_CAPTURE_POPULATE_BUFFER 4 // rvx_capture_populate, edges, palette, voxels
+#define RVX_CAPTURE_POPULATE_SPANS 5 // rvx_capture_populate, edges, palette, then rvx_capture_span and its data per span
+#define RVX_CAPTURE_COLOR_QUADS 6 // rvx_capture_object
+#define RVX_CAPTURE_SWAP_BUFFERS 7 // rvx_capture_swap
+#define RVX_CAPTURE_UPLOAD 8 // rvx_capture_object
+#define RVX_CAPTURE_UNBIND 9 // rvx_capture_object
+#define RVX_CAPTURE_BIND 10 // rvx_capture_draw
+#define RVX_CAPTURE_SET_PALETTE 11 // rvx_capture_palette
+#define RVX_CAPTURE_BEGIN 12 // rvx_capture_state
+#define RVX_CAPTURE_END 13 // rvx_capture_object
+#define RVX_CAPTURE_FLUSH 14 // rvx_capture_object
+#define RVX_CAPTURE_BEGIN_PASS 15 // rvx_capture_pass
+#define RVX_CAPTURE_END_PASS 16 // rvx_capture_object
+#define RVX_CAPTURE_VIEW 17 // rvx_capture_state, SceneParams
+#define RVX_CAPTURE_TRANSLATE 18 // rvx_capture_transform
+#define RVX_CAPTURE_AFFINE 19 // rvx_capture_transform
+#define RVX_CAPTURE_DRAW_INSTANCES 20 // rvx_capture_object with the count, rvx_capture_instance per instance
+#define RVX_CAPTURE_RENDER 21 // rvx_capture_draw
+#define RVX_CAPTURE_RENDER_EDGES 22 // rvx_capture_draw
+
+struct rvx_capture_header_struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t frames; // requested, the file may end sooner
+
+    // sizes of the structs written raw, replays refuse files from builds where they differ
+    uint32_t sceneParamsSize;
+    uint32_t voxelSize;
+    uint32_t areaSize;
+    uint32_t edgeSize;
+};
+
+typedef struct rvx_capture_header_struct RVX_CAPTURE_HEADER;
+
+struct rvx_capture_record_struct
+{
+    uint32_t type;
+    uint32_t size; // payload bytes
+};
+
+typedef struct rvx_capture_record_struct RVX_CAPTURE_RECORD;
+
+// a model or renderer id, ids are given in the order objects are first seen
+struct rvx_capture_object_struct
+{
+    int32_t id;
+    int32_t value; // draw instances count, otherwise 0
+};
+
+typedef struct rvx_capture_object_struct RVX_CAPTURE_OBJECT;
+
+struct rvx_capture_renderer_struct
+{
+    int32_t  id;
+    int32_t  hasPalette;
+    uint32_t palette[256]; // as RVX_RENDERER::palette
+};
+
+typedef struct rvx_capture_renderer_struct RVX_CAPTURE_RENDERER_STATE;
+
+// CPU state of a model, enough to upload and draw it
+struct rvx_capture_model_struct
+{
+    int32_t     id;
+    SceneParams params;
+    int32_t     numVoxels;
+    int32_t     bufferSize;
+    int32_t     numAreas;
+    int32_t     numEdges;
+    int32_t     edgeBufferSize;
+    int32_t     modelLength;
+    int32_t     edgesLength;
+    int32_t     edgeInstancing;
+    int32_t     edgeRows;
+    int32_t     edgeBucketStart[RVX_EDGE_BUCKETS + 1];
+    int32_t     edgeBucketRows[RVX_EDGE_BUCKETS];
+};
+
+typedef struct rvx_capture_model_struct RVX_CAPTURE_MODEL_STATE;
+
+// model fields the caller sets before populating
+struct rvx_capture_populate_struct
+{
+    int32_t     model;
+    SceneParams params;
+    int32_t     edgeInstancing;
+    int32_t     numEdges;
+    int32_t     count; // voxels or spans
+};
+
+typedef struct rvx_capture_populate_struct RVX_CAPTURE_POPULATE;
+
+// followed by count voxels, or by numQuads colors, sx, widths, sz and heights then numRows row y and row starts
+struct rvx_capture_span_struct
+{
+    int32_t area_no;
+    int32_t count; // -1 for quads
+    int32_t numQuads;
+    int32_t numRows;
+};
+
+typedef struct rvx_capture_span_struct RVX_CAPTURE_SPAN;
+
+struct rvx_capture_swap_struct
+{
+    int32_t model;
+    int32_t other;
+};
+
+typedef struct rvx_capture_swap_struct RVX_CAPTURE_SWAP;
+
+struct rvx_capture_draw_struct
+{
+    int32_t renderer;
+    int32_t model;
+    int32_t area;
+};
+
+typedef struct rvx_capture_draw_struct RVX_CAPTURE_DRAW;
+
+struct rvx_capture_palette_struct
+{
+    int32_t renderer;
+    Color4  palette[256];
+};
+
+typedef struct rvx_capture_palette_struct RVX_CAPTURE_PALETTE;
+
+// renderer fields the caller may set between calls, and the viewport rvx draws into
+struct rvx_capture_state_struct
+{
+    int32_t renderer;
+    float   camX;
+    float   camY;
+    float   alpha;
+    float   cullFar;
+    float   cullNear;
+    int32_t aspectW;
+    int32_t aspectH;
+    int32_t shaderFlags;
+    int32_t deferred;
+    int32_t renderWidth;
+    int32_t renderHeight;
+    int32_t viewport[4];
+};
+
+typedef struct rvx_capture_state_struct RVX_CAPTURE_STATE;
+
+struct rvx_capture_pass_struct
+{
+    int32_t renderer;
+    int32_t pass;
+    char    name[RVX_CAPTURE_NAME_SIZE]; // empty for the default name
+};
+
+typedef struct rvx_capture_pass_struct RVX_CAPTURE_PASS;
+
+struct rvx_capture_transform_struct
+{
+    int32_t renderer;
+    float   delta[3];
+    float   scale[3];
+    int32_t shadow;
+};
+
+typedef struct rvx_capture_transform_struct RVX_CAPTURE_TRANSFORM;
+
+struct rvx_capture_instance_struct
+{
+    int32_t model;
+    int32_t area;
+    float   position[3];
+    float   scale[3];
+    int32_t shadow;
+};
+
+typedef struct rvx_capture_instance_struct RVX_CAPTURE_INSTANCE;
+
+#if defined(_MSC_VER)
+#define RVX_THREAD_LOCAL __declspec(thread)
+#else
+#define RVX_THREAD_LOCAL __thread
+#endif
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // hooks called by rvx.c, only while rvx_capturing is set and outside other rvx calls
+    extern volatile int         rvx_capturing;
+    extern RVX_THREAD_LOCAL int rvx_capture_depth;
+
+    extern void rvx_capture_populate_buffer(RVX_MODEL* model, const Voxel* voxels, int modelVoxels, const Color4 palette[256]);
+    extern void rvx_capture_populate_spans(RVX_MODEL* model, const RVX_SPAN* spans, int numSpans, const Color4 palette[256]);
+    extern void rvx_capture_model(int type, RVX_MODEL* model);
+    extern void rvx_capture_swap_buffers(RVX_MODEL* model, RVX_MODEL* other);
+    extern void rvx_capture_draw(int type, RVX_RENDERER* renderer, RVX_MODEL* model, int area);
+    extern void rvx_capture_renderer(int type, RVX_RENDERER* renderer);
+    extern void rvx_capture_set_palette(RVX_RENDERER* renderer, const Color4 palette[256]);
+    extern void rvx_capture_view(RVX_RENDERER* renderer, const SceneParams* params);
+    extern void rvx_capture_begin_pass(RVX_RENDERER* renderer, int pass, const char* name);
+    extern void rvx_capture_transform(
+        int type, RVX_RENDERER* renderer, float deltaX, float deltaY, float deltaZ, float scaleX, float scaleY, float scaleZ, int shadow);
+    extern void rvx_capture_instances(RVX_RENDERER* renderer, const RVX_INSTANCE* instances, int numInstances);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
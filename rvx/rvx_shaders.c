@@ -6,37 +6,20 @@
 
 #include "rvx_shaders.h"
 
+#include <stdio.h>
 #include <string.h>
 
 #ifndef SHADER_IMPORT
 
-#define RVX_VERTEX_SHADER_BODY                                                                                                             \
-    "layout(location = 0) in vec4 vertexPosition;\n"                                                                                       \
-    "layout(location = 1) in vec4 vertexColor;\n"                                                                                          \
-    "flat out vec4 fragColor;\n"                                                                                                           \
-    "uniform mat4 view;\n"                                                                                                                 \
-    "uniform float alpha;\n"                                                                                                               \
-    "void main()\n"                                                                                                                        \
+// combined view and object transform, shared by all programs through one uniform buffer
+#define RVX_VIEW_BLOCK                                                                                                                     \
+    "layout(std140) uniform RvxView\n"                                                                                                     \
     "{\n"                                                                                                                                  \
-    "	fragColor = vec4(vertexColor.xyz, alpha);\n"                                                                                         \
-    "	gl_Position = view /** model*/ * vertexPosition;\n"                                                                                  \
-    "}\n";
+    "	mat4 view;\n"                                                                                                                        \
+    "	float alpha;\n"                                                                                                                      \
+    "};\n"
 
-    const char* rvxVertexShaderSourceGLES = "#version 300 es\n" RVX_VERTEX_SHADER_BODY
-
-    const char* rvxVertexShaderSourceGL = "#version 330 core\n" RVX_VERTEX_SHADER_BODY
-
-#define EDGE_VERTEX_SHADER_BODY                                                                                                            \
-    "layout(location = 0) in vec4 vertexPosition;\n"                                                                                       \
-    "layout(location = 1) in vec3 vertexColor;\n"                                                                                          \
-    "layout(location = 2) in vec4 edge;\n"                                                                                                 \
-    "flat out vec4 fragColor;\n"                                                                                                           \
-    "uniform mat4 view;\n"                                                                                                                 \
-    "uniform float alpha;\n"                                                                                                               \
-    "void main()\n"                                                                                                                        \
-    "{\n"                                                                                                                                  \
-    "	fragColor = vec4(vertexColor.xyz, alpha);\n"                                                                                         \
-    "	gl_Position = view * /*model **/ vertexPosition;\n"                                                                                  \
+#define EDGE_VERTEX_SHADER_ALIGN                                                                                                           \
     "float dvx;\n"                                                                                                                         \
     "float dvy;\n"                                                                                                                         \
     "int minmax;\n"                                                                                                                        \
@@ -83,20 +66,119 @@
     "       float frontY = frontVertex.y / frontVertex.w; \n"                                                                              \
     "       float newY = frontY * gl_Position.w;\n"                                                                                        \
     "       gl_Position.y = newY;\n"                                                                                                       \
+    "}\n"
+
+// one source for every program, specialized by the RVX_EDGES, RVX_INSTANCED, RVX_PALETTE and RVX_ALPHA defines,
+// instanced models are laid flat and drawn black for shadows, instanced edges build their quads from gl_VertexID
+#define RVX_VERTEX_SHADER_BODY                                                                                                             \
+    "#if defined(RVX_EDGES) && defined(RVX_INSTANCED)\n"                                                                                   \
+    "layout(location = 0) in ivec4 edgeBounds;\n"                                                                                          \
+    "layout(location = 1) in ivec4 edgeParams;\n"                                                                                          \
+    "layout(location = 2) in ivec4 edgeShape;\n"                                                                                           \
+    "layout(location = 3) in vec4 topLeftColor;\n"                                                                                         \
+    "layout(location = 4) in vec4 topRightColor;\n"                                                                                        \
+    "layout(location = 5) in vec4 bottomLeftColor;\n"                                                                                      \
+    "layout(location = 6) in vec4 bottomRightColor;\n"                                                                                     \
+    "#else\n"                                                                                                                              \
+    "layout(location = 0) in vec4 vertexPosition;\n"                                                                                       \
+    "layout(location = 1) in vec4 vertexColor;\n"                                                                                          \
+    "#if defined(RVX_EDGES)\n"                                                                                                             \
+    "layout(location = 2) in vec4 edge;\n"                                                                                                 \
+    "#elif defined(RVX_INSTANCED)\n"                                                                                                       \
+    "layout(location = 2) in vec4 instanceOffset;\n"                                                                                       \
+    "layout(location = 3) in vec4 instanceScale;\n"                                                                                        \
+    "#endif\n"                                                                                                                             \
+    "#endif\n"                                                                                                                             \
+    "flat out vec4 fragColor;\n"                                                                                                           \
+    RVX_VIEW_BLOCK                                                                                                                         \
+    "#ifdef RVX_PALETTE\n"                                                                                                                 \
+    "layout(std140) uniform RvxPalette\n"                                                                                                  \
+    "{\n"                                                                                                                                  \
+    "	vec4 palette[256];\n"                                                                                                                \
+    "};\n"                                                                                                                                 \
+    "#endif\n"                                                                                                                             \
+    "vec4 shade(vec4 color, int index)\n"                                                                                                  \
+    "{\n"                                                                                                                                  \
+    "#ifdef RVX_PALETTE\n"                                                                                                                 \
+    "	color = palette[index];\n"                                                                                                           \
+    "#endif\n"                                                                                                                             \
+    "#ifdef RVX_ALPHA\n"                                                                                                                   \
+    "	return vec4(color.xyz, alpha);\n"                                                                                                    \
+    "#else\n"                                                                                                                              \
+    "	return vec4(color.xyz, 1.0);\n"                                                                                                      \
+    "#endif\n"                                                                                                                             \
     "}\n"                                                                                                                                  \
+    "void main()\n"                                                                                                                        \
+    "{\n"                                                                                                                                  \
+    "#if defined(RVX_EDGES) && defined(RVX_INSTANCED)\n"                                                                                   \
+    "	int row = gl_VertexID / 24;\n"                                                                                                       \
+    "	int quad = (gl_VertexID / 6) % 4;\n"                                                                                                 \
+    "	int corner = gl_VertexID % 6;\n"                                                                                                     \
+    "	int y = edgeBounds.z + row * edgeParams.z;\n"                                                                                        \
+    "	vec4 color = quad == 0 ? topLeftColor : quad == 1 ? topRightColor : quad == 2 ? bottomLeftColor : bottomRightColor;\n"               \
+    "	if(y > edgeBounds.w || color.a == 0.0)\n"                                                                                            \
+    "	{\n"                                                                                                                                 \
+    "		gl_Position = vec4(0.0, 0.0, 0.0, 1.0);\n"                                                                                          \
+    "		fragColor = vec4(0.0);\n"                                                                                                           \
+    "		return;\n"                                                                                                                          \
+    "	}\n"                                                                                                                                 \
+    "	int split = edgeBounds.x + (edgeParams.w == -1 ? edgeShape.x : edgeBounds.y - edgeBounds.x + 1 - edgeShape.x);\n"                    \
+    "	int midZ = edgeParams.y + 1 - edgeShape.y;\n"                                                                                        \
+    "	bool right = (quad & 1) != 0;\n"                                                                                                     \
+    "	bool bottom = quad >= 2;\n"                                                                                                          \
+    "	bool endX = corner == 1 || corner == 3 || corner == 4;\n"                                                                            \
+    "	bool endZ = corner == 1 || corner == 2 || corner == 4;\n"                                                                            \
+    "	int side = (bottom ? 8 : 4) | (right ? 1 : 2);\n"                                                                                    \
+    "	int dirFlag = edgeParams.w == -1 ? 2 : 1;\n"                                                                                         \
+    "	int alignFlags = (endZ ? (side & 8) : (side & 4)) | (((endX ? side & 2 : side & 1) != 0) ? dirFlag : 0);\n"                          \
+    "	float x = float(endX ? (right ? edgeBounds.y + 1 : split) : (right ? split : edgeBounds.x));\n"                                      \
+    "	float z = float(endZ ? (bottom ? midZ : edgeParams.y + 1) : (bottom ? edgeParams.x : midZ));\n"                                      \
+    "	vec4 vertexPosition = vec4(x, float(y), z * 16.0, 1.0);\n"                                                                           \
+    "	vec4 edge = vec4(float(edgeShape.x), float(edgeParams.z), float(edgeShape.y), float(alignFlags));\n"                                 \
+    "	int colorIndex = ((bottom ? edgeShape.w : edgeShape.z) >> (right ? 8 : 0)) & 255;\n"                                                 \
+    "	fragColor = shade(color, colorIndex);\n"                                                                                             \
+    "	gl_Position = view * vertexPosition;\n"                                                                                              \
+    "#else\n"                                                                                                                              \
+    "	fragColor = shade(vertexColor, int(vertexColor.a * 255.0 + 0.5));\n"                                                                 \
+    "#ifdef RVX_INSTANCED\n"                                                                                                               \
+    "	vec3 position = vertexPosition.xyz * instanceScale.xyz + instanceOffset.xyz;\n"                                                      \
+    "	if(instanceOffset.w != 0.0)\n"                                                                                                       \
+    "	{\n"                                                                                                                                 \
+    "		position.y += (position.z - instanceOffset.z) / 16.0;\n"                                                                            \
+    "		position.z = instanceOffset.z;\n"                                                                                                   \
+    "		fragColor.xyz = vec3(0.0);\n"                                                                                                       \
+    "	}\n"                                                                                                                                 \
+    "	gl_Position = view * vec4(position, 1.0);\n"                                                                                         \
+    "#else\n"                                                                                                                              \
+    "	gl_Position = view * vertexPosition;\n"                                                                                              \
+    "#endif\n"                                                                                                                             \
+    "#endif\n"                                                                                                                             \
+    "#ifdef RVX_EDGES\n"                                                                                                                   \
+    EDGE_VERTEX_SHADER_ALIGN                                                                                                               \
+    "#endif\n"                                                                                                                             \
     "}\n";
 
+    const char* rvxVertexShaderSourceGLES = "#version 300 es\n"
+                                            "precision highp float;\n" RVX_VERTEX_SHADER_BODY
+
+    const char* rvxVertexShaderSourceGL = "#version 330 core\n" RVX_VERTEX_SHADER_BODY
+
+    // the edge permutations start from the same source, replacing it only affects programs with RVX_EDGES
     const char* edgeVertexShaderSourceGLES = "#version 300 es\n"
-                                             "precision highp float;\n" EDGE_VERTEX_SHADER_BODY
+                                             "precision highp float;\n" RVX_VERTEX_SHADER_BODY
 
-    const char* edgeVertexShaderSourceGL = "#version 330 core\n" EDGE_VERTEX_SHADER_BODY
+    const char* edgeVertexShaderSourceGL = "#version 330 core\n" RVX_VERTEX_SHADER_BODY
 
 #define RVX_FRAGMENT_SHADER_BODY                                                                                                           \
     "flat in vec4 fragColor;\n"                                                                                                            \
     "out vec4 finalColor;\n"                                                                                                               \
     "void main()\n"                                                                                                                        \
     "{\n"                                                                                                                                  \
+    "#ifdef RVX_OVERDRAW\n"                                                                                                               \
+    " finalColor = vec4(1.0 / 255.0, 0.0, 0.0, 0.0);\n"                                                                                  \
+    "#else\n"                                                                                                                              \
     " finalColor = fragColor;\n"                                                                                                           \
+    "#endif\n"                                                                                                           \
     "}\n";
 
     const char* rvxFragmentShaderSourceGLES = "#version 300 es\n"
@@ -105,57 +187,56 @@
     const char* rvxFragmentShaderSourceGL = "#version 330 core\n" RVX_FRAGMENT_SHADER_BODY
 
 #else
-const char* rvxFragmentShaderSourceGLES      = 0;
-const char* rvxVertexShaderSourceGLES        = 0;
-const char* edgeVertexShaderSourceGLES       = 0;
-const char* rvxFragmentShaderSourceGL        = 0;
-const char* rvxVertexShaderSourceGL          = 0;
-const char* edgeVertexShaderSourceGL         = 0;
+const char* rvxFragmentShaderSourceGLES = 0;
+const char* rvxVertexShaderSourceGLES   = 0;
+const char* edgeVertexShaderSourceGLES  = 0;
+const char* rvxFragmentShaderSourceGL   = 0;
+const char* rvxVertexShaderSourceGL     = 0;
+const char* edgeVertexShaderSourceGL    = 0;
 #endif
 
-const char *s_shader_names[] = {"rvxFragment", "rvxVertex", "edgeVertex"};
+const char* s_shader_names[] = {"rvxFragment", "rvxVertex", "edgeVertex"};
 
-const char** rvx_get_shader_source(const char* backend, const char* shader)
+static const char** s_shader_sources[2][3] = {
+    {&rvxFragmentShaderSourceGLES, &rvxVertexShaderSourceGLES, &edgeVertexShaderSourceGLES},
+    {&rvxFragmentShaderSourceGL, &rvxVertexShaderSourceGL, &edgeVertexShaderSourceGL}};
+
+static const char* s_shader_defines[] = {
+    "#define RVX_EDGES\n", "#define RVX_INSTANCED\n", "#define RVX_PALETTE\n", "#define RVX_ALPHA\n", "#define RVX_OVERDRAW\n"};
+
+static const char** rvx_shader_slot(const char* backend, const char* shader)
 {
-    if(strcmp("gles3", backend) == 0)
-    {
-        if(strcmp("rvxFragment", shader) == 0)
-            return &rvxFragmentShaderSourceGLES;
-        if(strcmp("rvxVertex", shader) == 0)
-            return &rvxVertexShaderSourceGLES;
-        if(strcmp("edgeVertex", shader) == 0)
-            return &edgeVertexShaderSourceGLES;
-    }
-    if(strcmp("gl", backend) == 0)
+    int b = strcmp("gles3", backend) == 0 ? 0 : strcmp("gl", backend) == 0 ? 1 : -1;
+    int s = -1;
+    for(int n = 0; n < (int)(sizeof(s_shader_sources[0]) / sizeof(s_shader_sources[0][0])); n++)
     {
-        if(strcmp("rvxFragment", shader) == 0)
-            return &rvxFragmentShaderSourceGL;
-        if(strcmp("rvxVertex", shader) == 0)
-            return &rvxVertexShaderSourceGL;
-        if(strcmp("edgeVertex", shader) == 0)
-            return &edgeVertexShaderSourceGL;
+        if(strcmp(s_shader_names[n], shader) == 0)
+            s = n;
     }
-    return NULL;
+    if(b < 0 || s < 0)
+        return NULL;
+    return s_shader_sources[b][s];
+}
+
+const char** rvx_get_shader_source(const char* backend, const char* shader)
+{
+    return rvx_shader_slot(backend, shader);
 }
 
 void rvx_set_shader_source(const char* backend, const char* shader, const char* source)
 {
-    if(strcmp("gles3", backend) == 0)
-    {
-        if(strcmp("rvxFragment", shader) == 0)
-            rvxFragmentShaderSourceGLES = source;
-        else if(strcmp("rvxVertex", shader) == 0)
-            rvxVertexShaderSourceGLES = source;
-        else if(strcmp("edgeVertex", shader) == 0)
-            edgeVertexShaderSourceGLES = source;
-    }
-    if(strcmp("gl", backend) == 0)
+    const char** slot = rvx_shader_slot(backend, shader);
+    if(slot != NULL)
+        *slot = source;
+}
+
+void rvx_get_shader_defines(int permutation, char* defines, int size)
+{
+    int length = 0;
+    defines[0] = 0;
+    for(int d = 0; d < (int)(sizeof(s_shader_defines) / sizeof(s_shader_defines[0])); d++)
     {
-        if(strcmp("rvxFragment", shader) == 0)
-            rvxFragmentShaderSourceGL = source;
-        else if(strcmp("rvxVertex", shader) == 0)
-            rvxVertexShaderSourceGL = source;
-        else if(strcmp("edgeVertex", shader) == 0)
-            edgeVertexShaderSourceGL = source;
+        if((permutation & (1 << d)) != 0)
+            length += snprintf(defines + length, size - length, "%s", s_shader_defines[d]);
     }
-}
\ No newline at end of file
+}
@@ -15,6 +15,7 @@ extern "C"
 extern const char* s_shader_names[];
 extern const char** rvx_get_shader_source(const char* backend, const char* shader);
 extern void rvx_set_shader_source(const char* backend, const char* shader, const char* source);
+extern void rvx_get_shader_defines(int permutation, char* defines, int size);
 
 #ifdef __cplusplus
 }
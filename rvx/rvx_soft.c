@@ -0,0 +1,964 @@
+/*
+    RVX Graphics Library
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rvx_soft.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define RVX_SOFT_THREADS
+typedef HANDLE             rvx_soft_thread;
+typedef SRWLOCK            rvx_soft_lock;
+typedef CONDITION_VARIABLE rvx_soft_cond;
+#define RVX_SOFT_LOCK(lock) AcquireSRWLockExclusive(lock)
+#define RVX_SOFT_UNLOCK(lock) ReleaseSRWLockExclusive(lock)
+#define RVX_SOFT_WAIT(cond, lock) SleepConditionVariableSRW(cond, lock, INFINITE, 0)
+#define RVX_SOFT_WAKE(cond) WakeAllConditionVariable(cond)
+#elif !defined(EMSCRIPTEN)
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#define RVX_SOFT_THREADS
+typedef pthread_t       rvx_soft_thread;
+typedef pthread_mutex_t rvx_soft_lock;
+typedef pthread_cond_t  rvx_soft_cond;
+#define RVX_SOFT_LOCK(lock) pthread_mutex_lock(lock)
+#define RVX_SOFT_UNLOCK(lock) pthread_mutex_unlock(lock)
+#define RVX_SOFT_WAIT(cond, lock) pthread_cond_wait(cond, lock)
+#define RVX_SOFT_WAKE(cond) pthread_cond_broadcast(cond)
+#else
+#include <time.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RVX_SOFT_SSE2
+#endif
+
+#define RVX_SOFT_VERTEX_SIZE 12 // as RVX_VERTEX_SIZE in rvx.c
+#define RVX_SOFT_EDGE_VERTEX_SIZE 16
+#define RVX_SOFT_EDGE_INSTANCE_SIZE 40
+#define RVX_SOFT_EDGE_ROW_LENGTH 24
+#define RVX_SOFT_INSTANCE_FLOATS 8
+#define RVX_SOFT_SUBPIXEL (1 << RVX_SOFT_SUBPIXEL_BITS)
+#define RVX_SOFT_HALF_PIXEL (RVX_SOFT_SUBPIXEL / 2)
+#define RVX_SOFT_CLIP_VERTICES 12 // a triangle clipped by six planes has at most nine
+#define RVX_SOFT_DEPTH_MAX 16777215.0f // depth is kept in steps of a 24-bit buffer so ties resolve as on the GPU
+
+#define RVX_SOFT_OPAQUE 0
+#define RVX_SOFT_BLEND 1 // RVX_SHADER_ALPHA, source alpha over the target as the viewer sets up GL blending
+#define RVX_SOFT_OVERDRAW 2 // RVX_SHADER_OVERDRAW, adds 1 to red without depth test
+
+// clip space position, colors are flat so nothing else is interpolated
+typedef struct
+{
+    float x;
+    float y;
+    float z;
+    float w;
+} RVX_SOFT_VERTEX;
+
+// set up for rasterizing, edge functions are in subpixels with the fill rule folded into c so inside is >= 0,
+// depth is a plane in pixels, rounded to RVX_SOFT_DEPTH_MAX steps per pixel
+typedef struct
+{
+    int64_t  a[3];
+    int64_t  b[3];
+    int64_t  c[3];
+    float    zc;
+    float    zx;
+    float    zy;
+    uint32_t color; // as RVX_RENDERER::palette
+    int      mode;
+    int      minX; // pixels whose centers may be covered
+    int      minY;
+    int      maxX;
+    int      maxY;
+} RVX_SOFT_TRIANGLE;
+
+typedef struct
+{
+    int* triangles; // in submission order
+    int  count;
+    int  capacity;
+} RVX_SOFT_BIN;
+
+struct rvx_soft_struct
+{
+    int       width;
+    int       height;
+    int       stride; // pixels per row, whole tiles
+    int       tilesX;
+    int       tilesY;
+    uint32_t* color;
+    float*    depth;
+    uint32_t  clearColor;
+    int       clearPending; // tiles are cleared by their thread at the first flush of a frame
+
+    RVX_SOFT_TRIANGLE* triangles;
+    int                numTriangles;
+    int                trianglesCapacity;
+    RVX_SOFT_BIN*      bins; // per tile
+    int                binsCapacity;
+
+    // frame times for rvx_renderer_stats, milliseconds
+    double passTime[RVX_PASSES]; // transform, clipping and binning
+    double rasterTime;
+
+    int threads; // workers plus the thread calling rvx
+#ifdef RVX_SOFT_THREADS
+    rvx_soft_thread workers[RVX_SOFT_MAX_THREADS];
+    rvx_soft_lock   lock;
+    rvx_soft_cond   start;
+    rvx_soft_cond   done;
+    int             generation; // bumped for every flush
+    int             nextTile;
+    int             tilesDone;
+    int             quit;
+#endif
+};
+
+static double rvx_soft_now(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return counter.QuadPart * 1000.0 / frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+#endif
+}
+
+static void* rvx_soft_grow(void* array, int* capacity, int size, int itemSize)
+{
+    if(size <= *capacity)
+        return array;
+
+    int grown = *capacity + *capacity / 2;
+    *capacity = grown > size ? grown : size;
+    array     = realloc(array, (size_t)*capacity * itemSize);
+    if(array == NULL)
+        abort();
+    return array;
+}
+
+// rasterization
+
+static int64_t rvx_soft_floor_div(int64_t n, int64_t d)
+{
+    int64_t q = n / d;
+    return (n % d != 0 && n < 0) ? q - 1 : q;
+}
+
+// source alpha over the target for every channel, as glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+static uint32_t rvx_soft_blend(uint32_t target, uint32_t source)
+{
+    uint32_t alpha  = source >> 24;
+    uint32_t result = 0;
+    for(int shift = 0; shift < 32; shift += 8)
+    {
+        uint32_t s = (source >> shift) & 255;
+        uint32_t t = (target >> shift) & 255;
+        result |= ((s * alpha + t * (255 - alpha) + 127) / 255) << shift;
+    }
+    return result;
+}
+
+// fills pixels x0 to x1 of a row in groups of four, the row is padded to whole tiles so groups never leave it,
+// the scalar version computes depth the same way as the SIMD one
+static void rvx_soft_fill(uint32_t* color, float* depth, int x0, int x1, float zRow, const RVX_SOFT_TRIANGLE* triangle)
+{
+#ifdef RVX_SOFT_SSE2
+    const __m128i first    = _mm_set1_epi32(x0 - 1);
+    const __m128i last     = _mm_set1_epi32(x1 + 1);
+    const __m128i lane     = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128  zx       = _mm_set1_ps(triangle->zx);
+    const __m128  z0       = _mm_set1_ps(zRow);
+    const __m128  half     = _mm_set1_ps(0.5f);
+    const __m128  depthMax = _mm_set1_ps(RVX_SOFT_DEPTH_MAX);
+    const __m128i fill     = _mm_set1_epi32((int)triangle->color);
+    const __m128i red      = _mm_set1_epi32(1);
+
+    for(int x = x0 & ~3; x <= x1; x += 4)
+    {
+        __m128i xs     = _mm_add_epi32(_mm_set1_epi32(x), lane);
+        __m128i inside = _mm_and_si128(_mm_cmpgt_epi32(xs, first), _mm_cmplt_epi32(xs, last));
+        __m128i target = _mm_loadu_si128((const __m128i*)(color + x));
+
+        if(triangle->mode == RVX_SOFT_OVERDRAW)
+        {
+            _mm_storeu_si128((__m128i*)(color + x), _mm_adds_epu8(target, _mm_and_si128(inside, red)));
+            continue;
+        }
+
+        __m128  z     = _mm_add_ps(z0, _mm_mul_ps(zx, _mm_add_ps(_mm_cvtepi32_ps(xs), half)));
+        z             = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(z, depthMax)));
+        __m128  d     = _mm_loadu_ps(depth + x);
+        __m128i write = _mm_and_si128(inside, _mm_castps_si128(_mm_cmple_ps(z, d)));
+        __m128i kept  = _mm_andnot_si128(write, _mm_castps_si128(d));
+        _mm_storeu_ps(depth + x, _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(write, _mm_castps_si128(z)), kept)));
+
+        if(triangle->mode == RVX_SOFT_OPAQUE)
+        {
+            _mm_storeu_si128((__m128i*)(color + x), _mm_or_si128(_mm_and_si128(write, fill), _mm_andnot_si128(write, target)));
+        }
+        else
+        {
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(write));
+            for(int l = 0; l < 4; l++)
+            {
+                if(mask & (1 << l))
+                    color[x + l] = rvx_soft_blend(color[x + l], triangle->color);
+            }
+        }
+    }
+#else
+    for(int x = x0; x <= x1; x++)
+    {
+        if(triangle->mode == RVX_SOFT_OVERDRAW)
+        {
+            if((color[x] & 255) != 255)
+                color[x]++;
+            continue;
+        }
+
+        float z = (float)lrintf((zRow + triangle->zx * ((float)x + 0.5f)) * RVX_SOFT_DEPTH_MAX);
+        if(z <= depth[x])
+        {
+            depth[x] = z;
+            color[x] = triangle->mode == RVX_SOFT_OPAQUE ? triangle->color : rvx_soft_blend(color[x], triangle->color);
+        }
+    }
+#endif
+}
+
+static void rvx_soft_raster_tile(RVX_SOFT* soft, int tile)
+{
+    const int tileX = (tile % soft->tilesX) * RVX_SOFT_TILE;
+    const int tileY = (tile / soft->tilesX) * RVX_SOFT_TILE;
+    const int lastX = (tileX + RVX_SOFT_TILE < soft->width ? tileX + RVX_SOFT_TILE : soft->width) - 1;
+    const int lastY = (tileY + RVX_SOFT_TILE < soft->height ? tileY + RVX_SOFT_TILE : soft->height) - 1;
+
+    if(soft->clearPending)
+    {
+        for(int y = tileY; y < tileY + RVX_SOFT_TILE; y++)
+        {
+            uint32_t* color = soft->color + (size_t)y * soft->stride;
+            float*    depth = soft->depth + (size_t)y * soft->stride;
+            for(int x = tileX; x < tileX + RVX_SOFT_TILE; x++)
+            {
+                color[x] = soft->clearColor;
+                depth[x] = RVX_SOFT_DEPTH_MAX;
+            }
+        }
+    }
+
+    const RVX_SOFT_BIN* bin = soft->bins + tile;
+    for(int i = 0; i < bin->count; i++)
+    {
+        const RVX_SOFT_TRIANGLE* triangle = soft->triangles + bin->triangles[i];
+        const int                startX   = triangle->minX > tileX ? triangle->minX : tileX;
+        const int                endX     = triangle->maxX < lastX ? triangle->maxX : lastX;
+        const int                startY   = triangle->minY > tileY ? triangle->minY : tileY;
+        const int                endY     = triangle->maxY < lastY ? triangle->maxY : lastY;
+
+        for(int y = startY; y <= endY; y++)
+        {
+            // each edge bounds the row's span from one side, solved at pixel centers so no pixel is tested
+            const int64_t centerY = (int64_t)y * RVX_SOFT_SUBPIXEL + RVX_SOFT_HALF_PIXEL;
+            int64_t       left    = startX;
+            int64_t       right   = endX;
+            for(int e = 0; e < 3 && left <= right; e++)
+            {
+                const int64_t k = triangle->a[e] * RVX_SOFT_SUBPIXEL;
+                const int64_t r = triangle->a[e] * RVX_SOFT_HALF_PIXEL + triangle->b[e] * centerY + triangle->c[e];
+                if(k > 0)
+                {
+                    int64_t bound = -rvx_soft_floor_div(r, k);
+                    left          = bound > left ? bound : left;
+                }
+                else if(k < 0)
+                {
+                    int64_t bound = rvx_soft_floor_div(r, -k);
+                    right         = bound < right ? bound : right;
+                }
+                else if(r < 0)
+                {
+                    right = left - 1;
+                }
+            }
+            if(left > right)
+                continue;
+
+            const float  zRow = triangle->zc + triangle->zy * ((float)y + 0.5f);
+            const size_t row  = (size_t)y * soft->stride;
+            rvx_soft_fill(soft->color + row, soft->depth + row, (int)left, (int)right, zRow, triangle);
+        }
+    }
+}
+
+// threads
+
+#ifdef RVX_SOFT_THREADS
+static void rvx_soft_run_tiles(RVX_SOFT* soft)
+{
+    const int tiles = soft->tilesX * soft->tilesY;
+    for(;;)
+    {
+        RVX_SOFT_LOCK(&soft->lock);
+        int tile = soft->nextTile < tiles ? soft->nextTile++ : -1;
+        RVX_SOFT_UNLOCK(&soft->lock);
+        if(tile < 0)
+            return;
+
+        rvx_soft_raster_tile(soft, tile);
+
+        RVX_SOFT_LOCK(&soft->lock);
+        if(++soft->tilesDone == tiles)
+            RVX_SOFT_WAKE(&soft->done);
+        RVX_SOFT_UNLOCK(&soft->lock);
+    }
+}
+
+static void rvx_soft_work(RVX_SOFT* soft)
+{
+    RVX_SOFT_LOCK(&soft->lock);
+    int generation = soft->generation;
+    for(;;)
+    {
+        while(!soft->quit && soft->generation == generation)
+            RVX_SOFT_WAIT(&soft->start, &soft->lock);
+        if(soft->quit)
+            break;
+
+        generation = soft->generation;
+        RVX_SOFT_UNLOCK(&soft->lock);
+        rvx_soft_run_tiles(soft);
+        RVX_SOFT_LOCK(&soft->lock);
+    }
+    RVX_SOFT_UNLOCK(&soft->lock);
+}
+
+#if defined(_WIN32)
+static DWORD WINAPI rvx_soft_worker(LPVOID soft)
+{
+    rvx_soft_work((RVX_SOFT*)soft);
+    return 0;
+}
+#else
+static void* rvx_soft_worker(void* soft)
+{
+    rvx_soft_work((RVX_SOFT*)soft);
+    return NULL;
+}
+#endif
+
+static int rvx_soft_cores(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+#endif
+}
+
+static void rvx_soft_start_workers(RVX_SOFT* soft, int threads)
+{
+    if(threads <= 0)
+        threads = rvx_soft_cores();
+    soft->threads = threads < RVX_SOFT_MAX_THREADS ? threads : RVX_SOFT_MAX_THREADS;
+    soft->quit    = 0;
+    for(int t = 1; t < soft->threads; t++)
+    {
+#if defined(_WIN32)
+        soft->workers[t] = CreateThread(NULL, 0, rvx_soft_worker, soft, 0, NULL);
+        if(soft->workers[t] == NULL)
+#else
+        if(pthread_create(&soft->workers[t], NULL, rvx_soft_worker, soft) != 0)
+#endif
+        {
+            // carry on with the threads that did start
+            soft->threads = t;
+            break;
+        }
+    }
+}
+
+static void rvx_soft_stop_workers(RVX_SOFT* soft)
+{
+    RVX_SOFT_LOCK(&soft->lock);
+    soft->quit = 1;
+    RVX_SOFT_WAKE(&soft->start);
+    RVX_SOFT_UNLOCK(&soft->lock);
+    for(int t = 1; t < soft->threads; t++)
+    {
+#if defined(_WIN32)
+        WaitForSingleObject(soft->workers[t], INFINITE);
+        CloseHandle(soft->workers[t]);
+#else
+        pthread_join(soft->workers[t], NULL);
+#endif
+    }
+    soft->threads = 1;
+}
+#endif
+
+// setup
+
+static void rvx_soft_bin(
+    RVX_SOFT* soft, const RVX_SOFT_VERTEX* v0, const RVX_SOFT_VERTEX* v1, const RVX_SOFT_VERTEX* v2, uint32_t color, int mode)
+{
+    const RVX_SOFT_VERTEX* v[3] = {v0, v1, v2};
+    int64_t                x[3], y[3];
+    float                  z[3];
+    for(int i = 0; i < 3; i++)
+    {
+        // viewport transform, rows top first
+        float invW = 1.0f / v[i]->w;
+        float sx   = (v[i]->x * invW + 1.0f) * 0.5f * soft->width;
+        float sy   = (1.0f - v[i]->y * invW) * 0.5f * soft->height;
+        x[i]       = (int64_t)floorf(sx * RVX_SOFT_SUBPIXEL + 0.5f);
+        y[i]       = (int64_t)floorf(sy * RVX_SOFT_SUBPIXEL + 0.5f);
+        z[i]       = v[i]->z * invW * 0.5f + 0.5f;
+    }
+
+    // GL's counter-clockwise front faces are clockwise with rows top first, back faces and slivers are culled
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if(area >= 0)
+        return;
+
+    int64_t swapX = x[1], swapY = y[1];
+    float   swapZ = z[1];
+    x[1] = x[2], y[1] = y[2], z[1] = z[2];
+    x[2] = swapX, y[2] = swapY, z[2] = swapZ;
+
+    int64_t minX = x[0] < x[1] ? (x[0] < x[2] ? x[0] : x[2]) : (x[1] < x[2] ? x[1] : x[2]);
+    int64_t maxX = x[0] > x[1] ? (x[0] > x[2] ? x[0] : x[2]) : (x[1] > x[2] ? x[1] : x[2]);
+    int64_t minY = y[0] < y[1] ? (y[0] < y[2] ? y[0] : y[2]) : (y[1] < y[2] ? y[1] : y[2]);
+    int64_t maxY = y[0] > y[1] ? (y[0] > y[2] ? y[0] : y[2]) : (y[1] > y[2] ? y[1] : y[2]);
+
+    RVX_SOFT_TRIANGLE triangle;
+    triangle.minX = (int)-rvx_soft_floor_div(RVX_SOFT_HALF_PIXEL - minX, RVX_SOFT_SUBPIXEL);
+    triangle.maxX = (int)rvx_soft_floor_div(maxX - RVX_SOFT_HALF_PIXEL, RVX_SOFT_SUBPIXEL);
+    triangle.minY = (int)-rvx_soft_floor_div(RVX_SOFT_HALF_PIXEL - minY, RVX_SOFT_SUBPIXEL);
+    triangle.maxY = (int)rvx_soft_floor_div(maxY - RVX_SOFT_HALF_PIXEL, RVX_SOFT_SUBPIXEL);
+    triangle.minX = triangle.minX > 0 ? triangle.minX : 0;
+    triangle.minY = triangle.minY > 0 ? triangle.minY : 0;
+    triangle.maxX = triangle.maxX < soft->width - 1 ? triangle.maxX : soft->width - 1;
+    triangle.maxY = triangle.maxY < soft->height - 1 ? triangle.maxY : soft->height - 1;
+    if(triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+        return;
+
+    for(int e = 0; e < 3; e++)
+    {
+        int i         = e;
+        int j         = (e + 1) % 3;
+        triangle.a[e] = y[i] - y[j];
+        triangle.b[e] = x[j] - x[i];
+        triangle.c[e] = -(triangle.a[e] * x[i] + triangle.b[e] * y[i]);
+
+        // pixels centered on an edge go to one of the two triangles sharing it, left and bottom edges keep them as
+        // GL's lower left origin makes top-left rules do
+        if(!(triangle.a[e] > 0 || (triangle.a[e] == 0 && triangle.b[e] < 0)))
+            triangle.c[e] -= 1;
+    }
+
+    // constant depth, which every quad facing the camera has, stays exact so ties resolve by draw order
+    double fx[3], fy[3];
+    for(int i = 0; i < 3; i++)
+    {
+        fx[i] = (double)x[i] / RVX_SOFT_SUBPIXEL;
+        fy[i] = (double)y[i] / RVX_SOFT_SUBPIXEL;
+    }
+    double det    = (fx[1] - fx[0]) * (fy[2] - fy[0]) - (fx[2] - fx[0]) * (fy[1] - fy[0]);
+    double zx     = ((z[1] - z[0]) * (fy[2] - fy[0]) - (z[2] - z[0]) * (fy[1] - fy[0])) / det;
+    double zy     = ((fx[1] - fx[0]) * (z[2] - z[0]) - (fx[2] - fx[0]) * (z[1] - z[0])) / det;
+    triangle.zx    = (float)zx;
+    triangle.zy    = (float)zy;
+    triangle.zc    = (float)(z[0] - zx * fx[0] - zy * fy[0]);
+    triangle.color = color;
+    triangle.mode  = mode;
+
+    int index          = soft->numTriangles;
+    soft->triangles    = (RVX_SOFT_TRIANGLE*)rvx_soft_grow(soft->triangles, &soft->trianglesCapacity, index + 1, sizeof(RVX_SOFT_TRIANGLE));
+    soft->triangles[index] = triangle;
+    soft->numTriangles++;
+
+    for(int ty = triangle.minY / RVX_SOFT_TILE; ty <= triangle.maxY / RVX_SOFT_TILE; ty++)
+    {
+        for(int tx = triangle.minX / RVX_SOFT_TILE; tx <= triangle.maxX / RVX_SOFT_TILE; tx++)
+        {
+            RVX_SOFT_BIN* bin = soft->bins + ty * soft->tilesX + tx;
+            bin->triangles    = (int*)rvx_soft_grow(bin->triangles, &bin->capacity, bin->count + 1, sizeof(int));
+            bin->triangles[bin->count++] = index;
+        }
+    }
+}
+
+// signed distance to a clip plane, near, far, then the guard band left, right, bottom and top
+static float rvx_soft_plane_distance(const RVX_SOFT_VERTEX* v, int plane)
+{
+    switch(plane)
+    {
+    case 0:
+        return v->z + v->w;
+    case 1:
+        return v->w - v->z;
+    case 2:
+        return v->x + RVX_SOFT_GUARD_BAND * v->w;
+    case 3:
+        return RVX_SOFT_GUARD_BAND * v->w - v->x;
+    case 4:
+        return v->y + RVX_SOFT_GUARD_BAND * v->w;
+    default:
+        return RVX_SOFT_GUARD_BAND * v->w - v->y;
+    }
+}
+
+static void rvx_soft_triangle(
+    RVX_SOFT* soft, const RVX_SOFT_VERTEX* v0, const RVX_SOFT_VERTEX* v1, const RVX_SOFT_VERTEX* v2, uint32_t color, int mode)
+{
+    int clip = 0;
+    for(int plane = 0; plane < 6; plane++)
+    {
+        int outside = (rvx_soft_plane_distance(v0, plane) < 0) + (rvx_soft_plane_distance(v1, plane) < 0) +
+                      (rvx_soft_plane_distance(v2, plane) < 0);
+        if(outside == 3)
+            return;
+        if(outside > 0)
+            clip |= 1 << plane;
+    }
+
+    if(clip == 0)
+    {
+        rvx_soft_bin(soft, v0, v1, v2, color, mode);
+        return;
+    }
+
+    // Sutherland-Hodgman against the crossed planes, then a fan keeps the winding
+    RVX_SOFT_VERTEX polygon[2][RVX_SOFT_CLIP_VERTICES];
+    int             count   = 3;
+    int             current = 0;
+    polygon[0][0]           = *v0;
+    polygon[0][1]           = *v1;
+    polygon[0][2]           = *v2;
+    for(int plane = 0; plane < 6 && count >= 3; plane++)
+    {
+        if(!(clip & (1 << plane)))
+            continue;
+
+        const RVX_SOFT_VERTEX* in      = polygon[current];
+        RVX_SOFT_VERTEX*       out     = polygon[current ^ 1];
+        int                    clipped = 0;
+        for(int i = 0; i < count; i++)
+        {
+            const RVX_SOFT_VERTEX* a  = in + i;
+            const RVX_SOFT_VERTEX* b  = in + (i + 1) % count;
+            float                  da = rvx_soft_plane_distance(a, plane);
+            float                  db = rvx_soft_plane_distance(b, plane);
+            if(da >= 0)
+                out[clipped++] = *a;
+            if((da >= 0) != (db >= 0))
+            {
+                float t          = da / (da - db);
+                out[clipped].x   = a->x + (b->x - a->x) * t;
+                out[clipped].y   = a->y + (b->y - a->y) * t;
+                out[clipped].z   = a->z + (b->z - a->z) * t;
+                out[clipped++].w = a->w + (b->w - a->w) * t;
+            }
+        }
+        count   = clipped;
+        current ^= 1;
+    }
+
+    for(int i = 1; i + 1 < count; i++)
+        rvx_soft_bin(soft, polygon[current], polygon[current] + i, polygon[current] + i + 1, color, mode);
+}
+
+// vertex stage
+
+static void rvx_soft_transform(const float* m, float x, float y, float z, RVX_SOFT_VERTEX* out)
+{
+    out->x = m[0] * x + m[4] * y + m[8] * z + m[12];
+    out->y = m[1] * x + m[5] * y + m[9] * z + m[13];
+    out->z = m[2] * x + m[6] * y + m[10] * z + m[14];
+    out->w = m[3] * x + m[7] * y + m[11] * z + m[15];
+}
+
+// EDGE_VERTEX_SHADER_ALIGN, edge is width, spacing, height and align flags
+static void rvx_soft_align(const float* m, float x, float y, float z, const int edge[4], RVX_SOFT_VERTEX* position)
+{
+    float dvx    = 0;
+    float dvy    = 0;
+    int   minmax = 0;
+    if(edge[3] & 1)
+    {
+        dvx    = (float)edge[0];
+        dvy    = position->x < 0.0f ? (float)-edge[1] : (float)edge[1];
+        minmax = -1;
+    }
+    else if(edge[3] & 2)
+    {
+        dvx    = (float)-edge[0];
+        dvy    = position->x > 0.0f ? (float)-edge[1] : (float)edge[1];
+        minmax = 1;
+    }
+    if(edge[3] & 3)
+    {
+        RVX_SOFT_VERTEX reference;
+        rvx_soft_transform(m, x + dvx, y + dvy, z, &reference);
+        float newX  = reference.x / reference.w * position->w;
+        position->x = minmax == -1 ? fminf(newX, position->x) : fmaxf(newX, position->x);
+    }
+    if(edge[3] & 12)
+    {
+        RVX_SOFT_VERTEX front;
+        rvx_soft_transform(m, x, y - edge[1], z + edge[2] * 16.0f, &front);
+        position->y = front.y / front.w * position->w;
+    }
+}
+
+// shade() of the vertex shader, color is as RVX_RENDERER::palette
+static uint32_t rvx_soft_shade(const RVX_RENDERER* renderer, int permutation, uint32_t color, int colorIndex, int shadow)
+{
+    if(permutation & RVX_SHADER_PALETTE)
+        color = renderer->palette[colorIndex & 255];
+
+    uint32_t alpha = 255;
+    if(permutation & RVX_SHADER_ALPHA)
+    {
+        float a = renderer->alpha < 0.0f ? 0.0f : renderer->alpha > 1.0f ? 1.0f : renderer->alpha;
+        alpha   = (uint32_t)(a * 255.0f + 0.5f);
+    }
+    return (shadow ? 0 : (color & 0xFFFFFF)) | (alpha << 24);
+}
+
+static int rvx_soft_mode(int permutation)
+{
+    return (permutation & RVX_SHADER_OVERDRAW) ? RVX_SOFT_OVERDRAW : (permutation & RVX_SHADER_ALPHA) ? RVX_SOFT_BLEND : RVX_SOFT_OPAQUE;
+}
+
+// model vertices are x, y, z * 16 and padding as shorts then red, green, blue and color index
+static void rvx_soft_draw_model(RVX_RENDERER* renderer, RVX_MODEL* model, int permutation, int first, int count, const float* instance)
+{
+    const float*   m        = renderer->transformMatrix;
+    const int      mode     = rvx_soft_mode(permutation);
+    const uint8_t* vertices = (const uint8_t*)model->buffer + (size_t)first * RVX_SOFT_VERTEX_SIZE;
+
+    for(int t = 0; t + 2 < count; t += 3)
+    {
+        RVX_SOFT_VERTEX clip[3];
+        for(int i = 0; i < 3; i++)
+        {
+            int16_t position[3];
+            memcpy(position, vertices + (size_t)(t + i) * RVX_SOFT_VERTEX_SIZE, sizeof(position));
+            float x = position[0];
+            float y = position[1];
+            float z = position[2];
+            if(instance != NULL)
+            {
+                x = x * instance[4] + instance[0];
+                y = y * instance[5] + instance[1];
+                z = z * instance[6] + instance[2];
+                if(instance[3] != 0.0f)
+                {
+                    y += (z - instance[2]) / 16.0f;
+                    z = instance[2];
+                }
+            }
+            rvx_soft_transform(m, x, y, z, clip + i);
+        }
+
+        // flat shading takes the last vertex
+        const uint8_t* rgbi  = vertices + (size_t)(t + 2) * RVX_SOFT_VERTEX_SIZE + 4 * sizeof(int16_t);
+        uint32_t       color = rgbi[0] | (rgbi[1] << 8) | (rgbi[2] << 16);
+        int            shade = instance != NULL && instance[3] != 0.0f;
+        rvx_soft_triangle(renderer->soft, clip, clip + 1, clip + 2, rvx_soft_shade(renderer, permutation, color, rgbi[3], shade), mode);
+    }
+}
+
+// edge vertices add width, spacing, height and align flags as bytes, see qlVertex7f
+static void rvx_soft_draw_edges(RVX_RENDERER* renderer, RVX_MODEL* model, int permutation, int count)
+{
+    const float*   m        = renderer->transformMatrix;
+    const int      mode     = rvx_soft_mode(permutation);
+    const uint8_t* vertices = (const uint8_t*)model->edgeBuffer;
+
+    for(int t = 0; t + 2 < count; t += 3)
+    {
+        RVX_SOFT_VERTEX clip[3];
+        for(int i = 0; i < 3; i++)
+        {
+            const uint8_t* vertex = vertices + (size_t)(t + i) * RVX_SOFT_EDGE_VERTEX_SIZE;
+            int16_t        position[3];
+            memcpy(position, vertex, sizeof(position));
+            const uint8_t* bytes   = vertex + 6 * sizeof(int16_t);
+            const int      edge[4] = {bytes[0], bytes[1], bytes[2], bytes[3]};
+            rvx_soft_transform(m, position[0], position[1], position[2], clip + i);
+            rvx_soft_align(m, position[0], position[1], position[2], edge, clip + i);
+        }
+
+        const uint8_t* rgbi  = vertices + (size_t)(t + 2) * RVX_SOFT_EDGE_VERTEX_SIZE + 4 * sizeof(int16_t);
+        uint32_t       color = rgbi[0] | (rgbi[1] << 8) | (rgbi[2] << 16);
+        rvx_soft_triangle(renderer->soft, clip, clip + 1, clip + 2, rvx_soft_shade(renderer, permutation, color, rgbi[3], 0), mode);
+    }
+}
+
+// instanced edges build their quads from the vertex index like RVX_VERTEX_SHADER_BODY, a record is bounds, params
+// and shape as shorts then the four corner colors, see rvx_update_edge_instance; first is the bucket's first record
+static void rvx_soft_draw_edge_instances(
+    RVX_RENDERER* renderer, RVX_MODEL* model, int permutation, int first, int count, int numInstances)
+{
+    const float* m    = renderer->transformMatrix;
+    const int    mode = rvx_soft_mode(permutation);
+
+    for(int e = first; e < first + numInstances; e++)
+    {
+        const uint8_t* record = (const uint8_t*)model->edgeBuffer + (size_t)e * RVX_SOFT_EDGE_INSTANCE_SIZE;
+        int16_t        fields[12];
+        memcpy(fields, record, sizeof(fields));
+        const int16_t* bounds = fields;
+        const int16_t* params = fields + 4;
+        const int16_t* shape  = fields + 8;
+        const uint8_t* colors = record + sizeof(fields);
+
+        const int split = bounds[0] + (params[3] == -1 ? shape[0] : bounds[1] - bounds[0] + 1 - shape[0]);
+        const int midZ  = params[1] + 1 - shape[1];
+
+        for(int row = 0; row * RVX_SOFT_EDGE_ROW_LENGTH < count; row++)
+        {
+            const int y = bounds[2] + row * params[2];
+            if(y > bounds[3])
+                break;
+
+            for(int quad = 0; quad < 4; quad++)
+            {
+                const uint8_t* color = colors + quad * sizeof(Color4);
+                if(color[3] == 0)
+                    continue;
+
+                const int right      = (quad & 1) != 0;
+                const int bottom     = quad >= 2;
+                const int side       = (bottom ? 8 : 4) | (right ? 1 : 2);
+                const int dirFlag    = params[3] == -1 ? 2 : 1;
+                const int colorIndex = ((bottom ? shape[3] : shape[2]) >> (right ? 8 : 0)) & 255;
+                const int rgb        = color[0] | (color[1] << 8) | (color[2] << 16);
+
+                RVX_SOFT_VERTEX clip[6];
+                for(int corner = 0; corner < 6; corner++)
+                {
+                    const int endX    = corner == 1 || corner == 3 || corner == 4;
+                    const int endZ    = corner == 1 || corner == 2 || corner == 4;
+                    const int align   = (endZ ? (side & 8) : (side & 4)) | (((endX ? side & 2 : side & 1) != 0) ? dirFlag : 0);
+                    const int edge[4] = {shape[0], params[2], shape[1], align};
+                    const float x     = (float)(endX ? (right ? bounds[1] + 1 : split) : (right ? split : bounds[0]));
+                    const float z     = (float)(endZ ? (bottom ? midZ : params[1] + 1) : (bottom ? params[0] : midZ)) * 16.0f;
+                    rvx_soft_transform(m, x, (float)y, z, clip + corner);
+                    rvx_soft_align(m, x, (float)y, z, edge, clip + corner);
+                }
+
+                uint32_t shaded = rvx_soft_shade(renderer, permutation, rgb, colorIndex, 0);
+                rvx_soft_triangle(renderer->soft, clip, clip + 1, clip + 2, shaded, mode);
+                rvx_soft_triangle(renderer->soft, clip + 3, clip + 4, clip + 5, shaded, mode);
+            }
+        }
+    }
+}
+
+// rvx interface
+
+RVX_SOFT* rvx_soft_new(void)
+{
+    RVX_SOFT* soft = (RVX_SOFT*)calloc(1, sizeof(RVX_SOFT));
+    if(soft == NULL)
+        abort();
+
+    soft->clearColor = 0xFF000000; // opaque black
+    soft->threads    = 1;
+#ifdef RVX_SOFT_THREADS
+#if defined(_WIN32)
+    InitializeSRWLock(&soft->lock);
+    InitializeConditionVariable(&soft->start);
+    InitializeConditionVariable(&soft->done);
+#else
+    pthread_mutex_init(&soft->lock, NULL);
+    pthread_cond_init(&soft->start, NULL);
+    pthread_cond_init(&soft->done, NULL);
+#endif
+    rvx_soft_start_workers(soft, 0);
+#endif
+    return soft;
+}
+
+void rvx_soft_free(RVX_SOFT* soft)
+{
+#ifdef RVX_SOFT_THREADS
+    rvx_soft_stop_workers(soft);
+#if !defined(_WIN32)
+    pthread_mutex_destroy(&soft->lock);
+    pthread_cond_destroy(&soft->start);
+    pthread_cond_destroy(&soft->done);
+#endif
+#endif
+    for(int b = 0; b < soft->binsCapacity; b++)
+        free(soft->bins[b].triangles);
+    free(soft->bins);
+    free(soft->triangles);
+    free(soft->color);
+    free(soft->depth);
+    free(soft);
+}
+
+void rvx_soft_begin(RVX_RENDERER* renderer)
+{
+    RVX_SOFT* soft = renderer->soft;
+    if(renderer->renderWidth != soft->width || renderer->renderHeight != soft->height)
+    {
+        soft->width  = renderer->renderWidth > 0 ? renderer->renderWidth : 1;
+        soft->height = renderer->renderHeight > 0 ? renderer->renderHeight : 1;
+        soft->tilesX = (soft->width + RVX_SOFT_TILE - 1) / RVX_SOFT_TILE;
+        soft->tilesY = (soft->height + RVX_SOFT_TILE - 1) / RVX_SOFT_TILE;
+        soft->stride = soft->tilesX * RVX_SOFT_TILE;
+
+        // whole tiles so groups of four never leave the buffer
+        size_t pixels = (size_t)soft->stride * soft->tilesY * RVX_SOFT_TILE;
+        free(soft->color);
+        free(soft->depth);
+        soft->color = (uint32_t*)malloc(pixels * sizeof(uint32_t));
+        soft->depth = (float*)malloc(pixels * sizeof(float));
+        if(soft->color == NULL || soft->depth == NULL)
+            abort();
+
+        int tiles = soft->tilesX * soft->tilesY;
+        if(tiles > soft->binsCapacity)
+        {
+            soft->bins = (RVX_SOFT_BIN*)realloc(soft->bins, tiles * sizeof(RVX_SOFT_BIN));
+            if(soft->bins == NULL)
+                abort();
+            memset(soft->bins + soft->binsCapacity, 0, (tiles - soft->binsCapacity) * sizeof(RVX_SOFT_BIN));
+            soft->binsCapacity = tiles;
+        }
+    }
+
+    soft->numTriangles = 0;
+    for(int b = 0; b < soft->binsCapacity; b++)
+        soft->bins[b].count = 0;
+    soft->clearPending = 1;
+    soft->rasterTime   = 0;
+    for(int p = 0; p < RVX_PASSES; p++)
+        soft->passTime[p] = 0;
+}
+
+void rvx_soft_draw(
+    RVX_RENDERER* renderer, RVX_MODEL* model, int permutation, int first, int count, const float* instances, int numInstances)
+{
+    RVX_SOFT* soft  = renderer->soft;
+    double    start = renderer->timing ? rvx_soft_now() : 0;
+
+    if((permutation & RVX_SHADER_EDGES) && (permutation & RVX_SHADER_INSTANCED))
+    {
+        rvx_soft_draw_edge_instances(renderer, model, permutation, first, count, numInstances);
+    }
+    else if(permutation & RVX_SHADER_EDGES)
+    {
+        rvx_soft_draw_edges(renderer, model, permutation, count);
+    }
+    else if(permutation & RVX_SHADER_INSTANCED)
+    {
+        for(int i = 0; i < numInstances; i++)
+            rvx_soft_draw_model(renderer, model, permutation, first, count, instances + i * RVX_SOFT_INSTANCE_FLOATS);
+    }
+    else
+    {
+        rvx_soft_draw_model(renderer, model, permutation, first, count, NULL);
+    }
+
+    if(renderer->timing)
+        soft->passTime[renderer->currentPass >= 0 ? renderer->currentPass : RVX_PASS_MODELS] += rvx_soft_now() - start;
+}
+
+void rvx_soft_flush(RVX_RENDERER* renderer)
+{
+    RVX_SOFT* soft  = renderer->soft;
+    const int tiles = soft->tilesX * soft->tilesY;
+    if(soft->numTriangles == 0 && !soft->clearPending)
+        return;
+
+    double start = renderer->timing ? rvx_soft_now() : 0;
+#ifdef RVX_SOFT_THREADS
+    RVX_SOFT_LOCK(&soft->lock);
+    soft->nextTile  = 0;
+    soft->tilesDone = 0;
+    soft->generation++;
+    RVX_SOFT_WAKE(&soft->start);
+    RVX_SOFT_UNLOCK(&soft->lock);
+
+    rvx_soft_run_tiles(soft);
+
+    RVX_SOFT_LOCK(&soft->lock);
+    while(soft->tilesDone < tiles)
+        RVX_SOFT_WAIT(&soft->done, &soft->lock);
+    RVX_SOFT_UNLOCK(&soft->lock);
+#else
+    for(int t = 0; t < tiles; t++)
+        rvx_soft_raster_tile(soft, t);
+#endif
+    if(renderer->timing)
+        soft->rasterTime += rvx_soft_now() - start;
+
+    // later draws of the frame go over what is there
+    soft->numTriangles = 0;
+    for(int t = 0; t < tiles; t++)
+        soft->bins[t].count = 0;
+    soft->clearPending = 0;
+}
+
+void rvx_soft_end(RVX_RENDERER* renderer)
+{
+    // CPU times are known right away, reported where GL reports GPU times
+    RVX_SOFT* soft = renderer->soft;
+    if(renderer->timing)
+    {
+        renderer->stats.gpuFrameTime = soft->rasterTime;
+        for(int p = 0; p < RVX_PASSES; p++)
+        {
+            renderer->stats.gpuTime[p] = soft->passTime[p];
+            renderer->stats.gpuFrameTime += soft->passTime[p];
+        }
+        renderer->stats.gpuFrame = renderer->frame;
+    }
+}
+
+void rvx_soft_read_pixels(RVX_RENDERER* renderer, uint8_t* rgba)
+{
+    const RVX_SOFT* soft = renderer->soft;
+    for(int y = 0; y < soft->height; y++)
+        memcpy(rgba + (size_t)y * soft->width * 4, soft->color + (size_t)y * soft->stride, (size_t)soft->width * 4);
+}
+
+void rvx_soft_set_threads(RVX_RENDERER* renderer, int threads)
+{
+#ifdef RVX_SOFT_THREADS
+    rvx_soft_stop_workers(renderer->soft);
+    rvx_soft_start_workers(renderer->soft, threads);
+#endif
+}
+
+void rvx_soft_set_clear_color(RVX_RENDERER* renderer, Color4 color)
+{
+    renderer->soft->clearColor = (color.a << 24) + (color.b << 16) + (color.g << 8) + color.r;
+}
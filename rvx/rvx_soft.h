@@ -0,0 +1,40 @@
+/*
+    RVX Graphics Library
+    (c) 2022 mausimus.github.io
+    MIT License
+*/
+
+#ifndef RVX_SOFT_H
+#define RVX_SOFT_H
+
+#include "rvx.h"
+
+// CPU rasterizer behind rvx_backend_soft, needs no GL context, draws into renderWidth by renderHeight color and depth
+// buffers owned by the renderer, draws are transformed and binned into tiles when submitted and the tiles are
+// rasterized in parallel at rvx_renderer_flush, each tile by one thread in submission order so output does not depend
+// on the number of threads
+
+#define RVX_SOFT_TILE 32 // pixels square, a multiple of the SIMD width
+#define RVX_SOFT_SUBPIXEL_BITS 8 // fixed point precision of screen positions, as most GPUs
+#define RVX_SOFT_GUARD_BAND 4.0f // triangles are clipped to this many viewports around the screen
+#define RVX_SOFT_MAX_THREADS 16
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    // called by rvx.c for renderers made with rvx_backend_soft
+    extern RVX_SOFT* rvx_soft_new(void);
+    extern void      rvx_soft_free(RVX_SOFT* soft);
+    extern void      rvx_soft_begin(RVX_RENDERER* renderer);
+    extern void      rvx_soft_draw(
+             RVX_RENDERER* renderer, RVX_MODEL* model, int permutation, int first, int count, const float* instances, int numInstances);
+    extern void      rvx_soft_flush(RVX_RENDERER* renderer);
+    extern void      rvx_soft_end(RVX_RENDERER* renderer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif